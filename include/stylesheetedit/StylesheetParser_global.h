@@ -22,7 +22,9 @@ Permission is hereby granted, free of charge, to any person obtaining a copy of
 
 #include <QtCore/qglobal.h>
 
-#if defined(STYLESHEETPARSER_LIBRARY)
+#if defined(STYLESHEETPARSER_STATIC)
+#  define STYLESHEETPARSER_EXPORT
+#elif defined(STYLESHEETPARSER_LIBRARY)
 #  define STYLESHEETPARSER_EXPORT Q_DECL_EXPORT
 #else
 #  define STYLESHEETPARSER_EXPORT Q_DECL_IMPORT
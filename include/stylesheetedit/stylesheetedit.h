@@ -82,6 +82,22 @@ public:
   void setShowNewlineMarkers(bool show);
   bool showNewlineMarkers();
 
+  //! Parses the stylesheet on a background thread so that large stylesheets
+  //! do not block the editor. The default is false.
+  void setBackgroundParse(bool background);
+  bool isBackgroundParse();
+
+  //! Only runs the fuzzy search for unknown names when a suggestion is
+  //! needed rather than while parsing. The default is false.
+  void setLazyFuzzySearch(bool lazy);
+  bool isLazyFuzzySearch();
+
+  //! Parses the top level rules of large stylesheets concurrently on the
+  //! global thread pool. The result is the same as a sequential parse. The
+  //! default is false.
+  void setParallelParse(bool parallel);
+  bool isParallelParse();
+
   //! Reimplemented from QPlainText::stylesheet()
   QString styleSheet() const;
   //! Reimplemented from QPlainText::setStylesheet()
@@ -0,0 +1,105 @@
+/*
+   Copyright 2020 Simon Meaden
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#ifndef STYLESHEETPARSER_H
+#define STYLESHEETPARSER_H
+
+#include <QList>
+#include <QMap>
+#include <QObject>
+
+#include "StylesheetParser_global.h"
+
+class DataStore;
+class Parser;
+class Node;
+class WidgetNodes;
+class ControlBase;
+class PropertyNode;
+
+//! A problem found in a stylesheet by StylesheetParser.
+struct StylesheetDiagnostic
+{
+  enum Kind
+  {
+    BadWidget,
+    BadIdSelector,
+    BadSubControl,
+    BadPseudoState,
+    BadPropertyName,
+    MissingPropertyMarker,
+    MissingPropertyEndMarker,
+    BadValueCount,
+    BadPropertyValue,
+    MissingStartBrace,
+    MissingEndBrace,
+  };
+
+  Kind kind;
+  int position = -1;
+  int length = 0;
+  QString text;
+  //! True if the text is close to a known name.
+  bool fuzzy = false;
+};
+
+//! Parses and validates stylesheets without an editor, for instance in a
+//! batch job. No widgets are created and a QCoreApplication is enough.
+//!
+//! The nodes are the same as those built for the editor, but as there is no
+//! text layout their rectangles are empty.
+class STYLESHEETPARSER_EXPORT StylesheetParser : public QObject
+{
+  Q_OBJECT
+public:
+  explicit StylesheetParser(QObject* parent = nullptr);
+  ~StylesheetParser();
+
+  //! Parses the text, replacing the nodes of any previous parse.
+  void parse(const QString& text);
+
+  //! The nodes of the last parse keyed on their start position. The nodes
+  //! are owned by the parser and are deleted by the next parse().
+  QMap<int, Node*> nodes() const;
+
+  //! The problems found by the last parse in document order.
+  QList<StylesheetDiagnostic> diagnostics() const;
+
+  //! Parses the top level rules of large stylesheets concurrently, see
+  //! StylesheetEdit::setParallelParse().
+  void setParallelParse(bool parallel);
+  bool isParallelParse() const;
+
+private:
+  DataStore* m_datastore;
+  Parser* m_parser;
+
+  void widgetDiagnostics(WidgetNodes* widgets,
+                         QList<StylesheetDiagnostic>& diagnostics) const;
+  void controlDiagnostics(ControlBase* control,
+                          StylesheetDiagnostic::Kind kind,
+                          QList<StylesheetDiagnostic>& diagnostics) const;
+  void propertyDiagnostics(PropertyNode* property,
+                           bool finalProperty,
+                           QList<StylesheetDiagnostic>& diagnostics) const;
+};
+
+#endif // STYLESHEETPARSER_H
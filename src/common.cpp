@@ -21,15 +21,17 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "common.h"
 #include "node.h"
 
+#include <charconv>
+
 bool
-operator==(NodeSection& left, NodeSection& right)
+operator==(const NodeSection& left, const NodeSection& right)
 {
   return (left.type == right.type && left.position == right.position &&
           left.node == right.node && left.propertyIndex == right.propertyIndex);
 }
 
 bool
-operator!=(NodeSection& left, NodeSection& right)
+operator!=(const NodeSection& left, const NodeSection& right)
 {
   return !(left == right);
 }
@@ -109,7 +111,7 @@ PropertyStatus::maxCount() const
 void
 PropertyStatus::setMaxCount(int maxCount)
 {
-  m_maxCount = maxCount;
+  m_maxCount = qint16(maxCount);
 }
 
 int
@@ -121,5 +123,306 @@ PropertyStatus::minCount() const
 void
 PropertyStatus::setMinCount(int minCount)
 {
-  m_minCount = minCount;
+  m_minCount = qint16(minCount);
+}
+
+NumberLiteral
+lexNumber(QStringView text)
+{
+  NumberLiteral literal;
+  // Longer than any sensible number, anything that does not fit is not one.
+  char buffer[64];
+  int size = 0;
+  while (size < text.size() && size < int(sizeof(buffer))) {
+    auto c = text.at(size).unicode();
+    if (c > 0x7f) {
+      break;
+    }
+    buffer[size++] = char(c);
+  }
+
+  // std::from_chars() does not accept a leading plus sign.
+  int first = (size > 0 && buffer[0] == '+' ? 1 : 0);
+  if (first && size > 1 && buffer[1] == '-') {
+    return literal;
+  }
+
+  // std::from_chars() also accepts "inf" and "nan", which are not numbers
+  // in a stylesheet.
+  int digit = (first < size && buffer[first] == '-' ? first + 1 : first);
+  auto lead = (digit < size ? buffer[digit] : '\0');
+  if (lead != '.' && (lead < '0' || lead > '9')) {
+    return literal;
+  }
+
+  double value = 0.0;
+  auto [end, error] = std::from_chars(buffer + first, buffer + size, value);
+  if (error != std::errc() || end == buffer + first) {
+    return literal;
+  }
+
+  literal.value = value;
+  literal.numberLength = int(end - buffer);
+  literal.isInteger = true;
+  for (auto c = buffer + first; c < end; c++) {
+    if (!(*c == '-' || (*c >= '0' && *c <= '9'))) {
+      literal.isInteger = false;
+      break;
+    }
+  }
+
+  literal.length = literal.numberLength;
+  auto unit = text.mid(literal.numberLength);
+  if (unit.startsWith(QLatin1Char('%'))) {
+    literal.unit = PercentLengthUnit;
+    literal.length += 1;
+  } else {
+    if (unit.startsWith(QLatin1String("px"), Qt::CaseInsensitive)) {
+      literal.unit = PxLengthUnit;
+    } else if (unit.startsWith(QLatin1String("pt"), Qt::CaseInsensitive)) {
+      literal.unit = PtLengthUnit;
+    } else if (unit.startsWith(QLatin1String("em"), Qt::CaseInsensitive)) {
+      literal.unit = EmLengthUnit;
+    } else if (unit.startsWith(QLatin1String("ex"), Qt::CaseInsensitive)) {
+      literal.unit = ExLengthUnit;
+    }
+    if (literal.unit != NoLengthUnit) {
+      literal.length += 2;
+    }
+  }
+
+  return literal;
+}
+
+NumberLiteral
+parseNumber(QStringView text)
+{
+  text = text.trimmed();
+  auto literal = lexNumber(text);
+  if (literal.length != text.size()) {
+    return NumberLiteral();
+  }
+  return literal;
+}
+
+static bool
+isHexDigit(QChar c)
+{
+  return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+          (c >= 'A' && c <= 'F'));
+}
+
+static int
+hexValue(QChar c)
+{
+  auto u = c.unicode();
+  if (u >= '0' && u <= '9') {
+    return u - '0';
+  } else if (u >= 'a' && u <= 'f') {
+    return u - 'a' + 10;
+  }
+  return u - 'A' + 10;
+}
+
+/*
+   Reads an unsigned decimal number, or a 0x hex number of one or two digits,
+   filling the whole of text. Returns -1 if text is anything else.
+*/
+static int
+colorComponentValue(QStringView text, bool allowHex)
+{
+  if (text.isEmpty()) {
+    return -1;
+  }
+  if (allowHex && text.size() >= 3 && text.size() <= 4 && text.at(0) == '0' &&
+      text.at(1) == 'x') {
+    int value = 0;
+    for (int i = 2; i < text.size(); i++) {
+      if (!isHexDigit(text.at(i))) {
+        return -1;
+      }
+      value = value * 16 + hexValue(text.at(i));
+    }
+    return value;
+  }
+  int value = 0;
+  for (auto c : text) {
+    if (!c.isDigit() || c.unicode() > '9') {
+      return -1;
+    }
+    // anything this long is out of range whatever it is.
+    value = qMin(value * 10 + (c.unicode() - '0'), 100000);
+  }
+  return value;
+}
+
+static void
+readColorComponent(QStringView text,
+                   int index,
+                   ColorLiteral::Form form,
+                   ColorLiteral::Component& component,
+                   int& value)
+{
+  auto isHue = (index == 0 && form >= ColorLiteral::HsvColor);
+  if (!isHue && text.endsWith(QLatin1Char('%'))) {
+    auto percent = colorComponentValue(text.chopped(1), false);
+    if (percent < 0 || percent > 100) {
+      component.state = BadNumericalValue_100;
+    } else {
+      value = (percent * 255 + 50) / 100;
+    }
+    return;
+  }
+
+  value = colorComponentValue(text, true);
+  auto max = (isHue ? 359 : 255);
+  if (value < 0 || value > max) {
+    component.state = (isHue ? BadNumericalValue_359 : BadNumericalValue_255);
+  }
+}
+
+static void
+parseHashColor(QStringView text, ColorLiteral& color)
+{
+  color.form = ColorLiteral::HashColor;
+  auto digits = text.size() - 1;
+  for (int i = 1; i < text.size(); i++) {
+    if (!isHexDigit(text.at(i))) {
+      return;
+    }
+  }
+
+  // #rgb, #rrggbb, #aarrggbb, #rrrgggbbb and #rrrrggggbbbb as QColor does.
+  int r = 0, g = 0, b = 0, a = 255;
+  auto channel = [text](int from, int width) {
+    int value = 0;
+    for (int i = 0; i < width; i++) {
+      value = value * 16 + hexValue(text.at(from + i));
+    }
+    return value;
+  };
+  switch (digits) {
+    case 3:
+      r = channel(1, 1) * 17;
+      g = channel(2, 1) * 17;
+      b = channel(3, 1) * 17;
+      break;
+    case 6:
+      r = channel(1, 2);
+      g = channel(3, 2);
+      b = channel(5, 2);
+      break;
+    case 8:
+      a = channel(1, 2);
+      r = channel(3, 2);
+      g = channel(5, 2);
+      b = channel(7, 2);
+      break;
+    case 9:
+      r = channel(1, 3) >> 4;
+      g = channel(4, 3) >> 4;
+      b = channel(7, 3) >> 4;
+      break;
+    case 12:
+      r = channel(1, 4) >> 8;
+      g = channel(5, 4) >> 8;
+      b = channel(9, 4) >> 8;
+      break;
+    default:
+      return;
+  }
+  color.goodHash = true;
+  color.rgb = qRgba(r, g, b, a);
+}
+
+ColorLiteral
+parseColor(QStringView text)
+{
+  ColorLiteral color;
+  if (text.startsWith(QLatin1Char('#'))) {
+    parseHashColor(text, color);
+    return color;
+  }
+
+  static const struct
+  {
+    const char* name;
+    ColorLiteral::Form form;
+    int count;
+  } functions[] = {
+    { "rgba", ColorLiteral::RgbaColor, 4 }, { "rgb", ColorLiteral::RgbColor, 3 },
+    { "hsva", ColorLiteral::HsvaColor, 4 }, { "hsv", ColorLiteral::HsvColor, 3 },
+    { "hsla", ColorLiteral::HslaColor, 4 }, { "hsl", ColorLiteral::HslColor, 3 },
+  };
+  for (auto& function : functions) {
+    if (text.startsWith(QLatin1String(function.name), Qt::CaseInsensitive)) {
+      color.form = function.form;
+      color.expected = function.count;
+      break;
+    }
+  }
+  if (color.form == ColorLiteral::NoColor) {
+    return color;
+  }
+
+  int open = 0;
+  while (open < text.size() && text.at(open) != '(') {
+    open++;
+  }
+  if (open == text.size()) {
+    return color;
+  }
+
+  int values[4] = { 0, 0, 0, 255 };
+  int i = open + 1;
+  while (true) {
+    int end = i;
+    while (end < text.size() && text.at(end) != ',' && text.at(end) != ')') {
+      end++;
+    }
+    int first = i, last = end;
+    while (first < last && text.at(first).isSpace()) {
+      first++;
+    }
+    while (last > first && text.at(last - 1).isSpace()) {
+      last--;
+    }
+
+    if (color.count < 4) {
+      auto& component = color.components[color.count];
+      component.offset = first;
+      component.length = last - first;
+      readColorComponent(text.mid(first, last - first),
+                         color.count,
+                         color.form,
+                         component,
+                         values[color.count]);
+    }
+    color.count++;
+
+    if (end >= text.size() || text.at(end) == ')') {
+      break;
+    }
+    i = end + 1;
+  }
+
+  if (color.isValid()) {
+    switch (color.form) {
+      case ColorLiteral::RgbColor:
+      case ColorLiteral::RgbaColor:
+        color.rgb = qRgba(values[0], values[1], values[2], values[3]);
+        break;
+      case ColorLiteral::HsvColor:
+      case ColorLiteral::HsvaColor:
+        color.rgb =
+          QColor::fromHsv(values[0], values[1], values[2], values[3]).rgba();
+        break;
+      default:
+        color.rgb =
+          QColor::fromHsl(values[0], values[1], values[2], values[3]).rgba();
+        break;
+    }
+  }
+
+  return color;
 }
@@ -25,8 +25,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <QFont>
 #include <QList>
 #include <QString>
+#include <QStringView>
 #include <QTextCharFormat>
-#include <QTextCursor>
+#include <QVarLengthArray>
+#include <QVector>
 
 class Node;
 //#include "node.h"
@@ -170,12 +172,13 @@ struct PartialType
   Type type;
 };
 
-class NodeSection : public QObject
+//! The part of a node found at a point. NodeSection is a plain value so
+//! that hit testing does not allocate.
+class NodeSection
 {
 public:
-  NodeSection(QObject* parent, SectionType t = None, int p = -1, int i = -1)
-    : QObject(parent)
-    , type(t)
+  NodeSection(SectionType t = None, int p = -1, int i = -1)
+    : type(t)
     , position(p)
     , node(nullptr)
     , propertyIndex(i)
@@ -220,7 +223,7 @@ public:
   {
     type = None;
     position = -1;
-    propertyIndex - 1;
+    propertyIndex = -1;
     node = nullptr;
   }
   bool isCommentType()
@@ -233,8 +236,8 @@ public:
     }
   }
 
-  friend bool operator==(NodeSection& left, NodeSection& right);
-  friend bool operator!=(NodeSection& left, NodeSection& right);
+  friend bool operator==(const NodeSection& left, const NodeSection& right);
+  friend bool operator!=(const NodeSection& left, const NodeSection& right);
   SectionType type;
   int position;
   Node* node;
@@ -242,9 +245,9 @@ public:
 };
 
 bool
-operator==(NodeSection& left, NodeSection& right);
+operator==(const NodeSection& left, const NodeSection& right);
 bool
-operator!=(NodeSection& left, NodeSection& right);
+operator!=(const NodeSection& left, const NodeSection& right);
 
 enum NodeType
 {
@@ -362,11 +365,25 @@ enum NodeState
   //
   CommentState = 0x10000000,
   NewLineState = 0x20000000,
+  //! Not a keyword, the fuzzy search has been deferred.
+  FuzzyPendingState = 0x40000000,
 
 };
 Q_DECLARE_FLAGS(NodeStates, NodeState);
 Q_DECLARE_OPERATORS_FOR_FLAGS(NodeStates)
 
+//! The vocabularies a token belongs to, a token can be in several.
+enum KeywordType
+{
+  NoKeyword = 0,
+  WidgetKeyword = 0x1,
+  PropertyKeyword = 0x2,
+  PseudoStateKeyword = 0x4,
+  SubControlKeyword = 0x8,
+};
+Q_DECLARE_FLAGS(KeywordTypes, KeywordType);
+Q_DECLARE_OPERATORS_FOR_FLAGS(KeywordTypes)
+
 enum NodeIsIn
 {
   InNode,
@@ -374,9 +391,159 @@ enum NodeIsIn
   AfterNode,
 };
 
+//! Records the edits made to the document so that the positions held by the
+//! nodes can be brought up to date when they are next read, rather than
+//! every position being updated on every edit.
+//!
+//! The log only holds the edits since the positions were last all brought
+//! up to date, see DataStore::compactEdits().
+class OffsetMap
+{
+public:
+  //! Records an edit as reported by QTextDocument::contentsChange().
+  void addEdit(int position, int charsRemoved, int charsAdded)
+  {
+    m_edits.append({ position, charsRemoved, charsAdded });
+  }
+
+  //! The number of edits recorded so far.
+  int revision() const { return m_base + m_edits.size(); }
+  //! The number of edits that are still held in the log.
+  int pendingEdits() const { return m_edits.size(); }
+
+  //! Maps an offset that was valid at revision onto the current text and
+  //! sets revision to the current revision.
+  int map(int offset, int& revision) const
+  {
+    for (int i = qMax(revision - m_base, 0); i < m_edits.size(); i++) {
+      auto& edit = m_edits.at(i);
+      offset = shift(offset, edit.position, edit.removed, edit.added);
+    }
+    revision = this->revision();
+    return offset;
+  }
+
+  //! Maps an offset across a single edit. Tables that hold plain offsets use
+  //! this to follow each edit as it is made.
+  static int shift(int offset, int position, int removed, int added)
+  {
+    if (offset < position) {
+      return offset;
+    } else if (offset >= position + removed) {
+      return offset + added - removed;
+    }
+    // the text at offset was removed.
+    return position + added;
+  }
+
+  //! Discards the recorded edits. Positions that have not caught up with
+  //! them are no longer mapped so this should only be called when the nodes
+  //! are replaced, or once every position has been brought up to date.
+  void clear()
+  {
+    m_base += m_edits.size();
+    m_edits.clear();
+  }
+
+private:
+  struct Edit
+  {
+    int position;
+    int removed;
+    int added;
+  };
+  QVector<Edit> m_edits;
+  int m_base = 0;
+};
+
+//! A document offset that follows the edits recorded in an OffsetMap.
+//!
+//! A default constructed TextPosition is null and has a position of -1.
+class TextPosition
+{
+public:
+  TextPosition() = default;
+  TextPosition(int offset, const OffsetMap* map)
+    : m_offset(offset)
+    , m_revision(map ? map->revision() : 0)
+    , m_map(map)
+  {}
+
+  bool isNull() const { return m_offset < 0; }
+  int position() const
+  {
+    if (m_map && m_offset >= 0 && m_revision != m_map->revision()) {
+      m_offset = m_map->map(m_offset, m_revision);
+    }
+    return m_offset;
+  }
+  int anchor() const { return position(); }
+
+  //! Attaches the position to map. If it already follows map it is brought
+  //! up to date with it instead.
+  void setOffsetMap(const OffsetMap* map)
+  {
+    if (map && map == m_map) {
+      position();
+      return;
+    }
+    m_map = map;
+    m_revision = (map ? map->revision() : 0);
+  }
+
+  bool operator==(const TextPosition& other) const
+  {
+    return position() == other.position();
+  }
+  bool operator!=(const TextPosition& other) const
+  {
+    return position() != other.position();
+  }
+  bool operator<(const TextPosition& other) const
+  {
+    return position() < other.position();
+  }
+
+private:
+  mutable int m_offset = -1;
+  mutable int m_revision = 0;
+  const OffsetMap* m_map = nullptr;
+};
+
+//! A token found by WidgetModel::nextToken(). The token holds no text of
+//! its own, only the offset and length of the token within the parsed text.
+struct Token
+{
+  enum Kind
+  {
+    End,          //!< No more tokens, offset is the end of the text.
+    Name,         //!< A name or a number.
+    Symbol,       //!< Punctuation such as '{', ':' or "::".
+    Bracketed,    //!< A value that contains brackets, e.g. url(...).
+    Quoted,       //!< A quoted string.
+    CommentStart, //!< The "/*" that starts a comment.
+    Newline,      //!< A newline when line markers are shown.
+  };
+
+  Kind kind = End;
+  int offset = -1;
+  int length = 0;
+
+  bool isEmpty() const { return length == 0; }
+  int end() const { return offset + length; }
+  QStringView view(const QString& text) const
+  {
+    return QStringView(text).mid(offset, length);
+  }
+  QString toString(const QString& text) const
+  {
+    return text.mid(offset, length);
+  }
+};
+
 struct CursorData
 {
-  QTextCursor cursor;
+  TextPosition cursor;
   Node* node = nullptr;
   Node* prevNode = nullptr;
 };
@@ -420,41 +587,44 @@ enum PropertyValueState
   WrongType,
 };
 
+//! The check of a value, or of one part of a value, as a fixed size record.
+//! The records of a value that is checked in several parts are held next to
+//! each other, in a PropertyStatusList or a PropertyNode, and next() steps
+//! from one to the following one. A record only holds where its text is,
+//! name() slices the text out of the document when it is wanted.
 class PropertyStatus
 {
   //  static const QStringList names;
   struct Internal
   {
-    QString name;
-    QTextCursor offset;
+    TextPosition offset;
+    int length;
     PropertyValueState state;
-    QRect rect;
   };
 
 public:
   PropertyStatus(PropertyValueState state = PropertyValueState::GoodValue,
-                 const QString& name = QString(),
-                 QTextCursor offset = QTextCursor())
-    : m_name(name)
-    , m_state(state)
+                 TextPosition offset = TextPosition(),
+                 int length = 0)
+    : m_state(state)
     , m_offset(offset)
+    , m_length(length)
   {}
 
-  ~PropertyStatus() { qDeleteAll(m_internals); }
-
-  int length() const { return name().length(); }
+  int length() const { return m_length; }
+  void setLength(int length) { m_length = length; }
   PropertyStatus* lastStatus()
   {
-    auto status = m_next;
+    auto status = next();
     while (status) {
-      if (status->m_next)
-        status = status->m_next;
+      if (status->next())
+        status = status->next();
       else
         return status;
     }
     return nullptr;
   }
-  QTextCursor lastOffset()
+  TextPosition lastOffset()
   {
     auto next = lastStatus();
     if (next)
@@ -471,107 +641,77 @@ public:
       return m_offset.anchor() + length();
   }
 
-  int sectionCount() { return m_internals.size(); }
-  QString name() const { return m_name; }
-  QString sectionName(int index)
+  int sectionCount() const { return m_internals.size(); }
+  //! Returns the text of the status from text, the text of the document.
+  QString name(QStringView text) const
   {
-    if (index >= 0 && index < m_internals.length())
-      return m_internals.at(index)->name;
-    return QString();
+    return text.mid(offset(), m_length).toString();
   }
-  void setName(const QString name) { m_name = name; }
-  void setSectionName(int index, const QString name)
+  QString sectionName(int index, QStringView text) const
   {
-    if (index > 0 && index < m_internals.length())
-      m_internals.at(index)->name = name;
+    if (index >= 0 && index < m_internals.size())
+      return text.mid(sectionOffset(index), sectionLength(index)).toString();
+    return QString();
   }
 
   PropertyValueState state() const { return m_state; }
   PropertyValueState sectionState(int index) const
   {
-    return m_internals.at(index)->state;
+    return m_internals.at(index).state;
   }
-  bool isGoodValue() { return (m_state == GoodValue); }
+  bool isGoodValue() const { return (m_state == GoodValue); }
   void setState(const PropertyValueState& state) { m_state = state; }
   void setSectionState(int index, const PropertyValueState& state)
   {
-    if (index >= 0 && index < m_internals.length())
-      m_internals.at(index)->state = state;
+    if (index >= 0 && index < m_internals.size())
+      m_internals[index].state = state;
   }
 
   int offset() const { return m_offset.anchor(); }
   int sectionOffset(int index) const
   {
-    if (index >= 0 && index < m_internals.length())
-      return m_internals.at(index)->offset.anchor();
+    if (index >= 0 && index < m_internals.size())
+      return m_internals.at(index).offset.anchor();
     return -1;
   }
-  void setOffset(QTextCursor offset) { m_offset = offset; }
-  void setSectionOffset(int index, QTextCursor offset)
+  void setOffset(TextPosition offset) { m_offset = offset; }
+  void setSectionOffset(int index, TextPosition offset)
   {
-    if (index >= 0 && index < m_internals.length())
-      m_internals.at(index)->offset = offset;
+    if (index >= 0 && index < m_internals.size())
+      m_internals[index].offset = offset;
   }
-  int sectionLength(int index) { return m_internals.at(index)->name.length(); }
+  int sectionLength(int index) const { return m_internals.at(index).length; }
 
-  QRect rect() const { return m_rect; }
-  bool isInRect(QPoint pos)
+  //! Returns the status after this one if it is linked to it.
+  PropertyStatus* next() { return (m_linked ? this + 1 : nullptr); }
+  const PropertyStatus* next() const
   {
-    auto x = pos.x();
-    auto y = pos.y();
-    if (x >= m_rect.left() && x < m_rect.right() && y >= m_rect.top() &&
-        y < m_rect.bottom()) {
-      return true;
-    }
-    return false;
-  }
-  QRect sectionRect(int index) const
-  {
-    if (index >= 0 && index < m_internals.length())
-      return m_internals.at(index)->rect;
-    return QRect();
-  }
-  bool isInSectionRect(int index, QPoint pos)
-  {
-    if (index > 0 && index < m_internals.length()) {
-      auto x = pos.x();
-      auto y = pos.y();
-      auto rect = m_internals.at(index)->rect;
-      if (x >= rect.left() && x < rect.right() && y >= rect.top() &&
-          y < rect.bottom()) {
-        return true;
-      }
-    }
-    return false;
+    return (m_linked ? this + 1 : nullptr);
   }
-  void setRect(const QRect& rect) { m_rect = rect; }
-  void setSectionRect(int index, const QRect& rect)
+  bool isLinked() const { return m_linked; }
+  void setLinked(bool linked) { m_linked = linked; }
+
+  void addSectionValue(const PropertyValueState& state,
+                       TextPosition offset,
+                       int length)
   {
-    if (index > 0 && index < m_internals.length())
-      m_internals.at(0)->rect = rect;
+    m_internals.append({ offset, length, state });
   }
 
-  PropertyStatus* next() { return m_next; }
-  void setNext(PropertyStatus* status) { m_next = status; }
-
-  void addSectionValue(const PropertyValueState& state,
-                       const QString& name,
-                       QTextCursor offset,
-                       const QRect& rect)
+  //! Attaches the offsets of this status to map.
+  void setOffsetMap(const OffsetMap* map)
   {
-    auto internal = new Internal();
-    internal->offset = offset;
-    internal->name = name;
-    internal->state = state;
-    internal->rect = rect;
-    m_internals.append(internal);
+    m_offset.setOffsetMap(map);
+    for (auto& internal : m_internals) {
+      internal.offset.setOffsetMap(map);
+    }
   }
 
   PropertyValueState sectionsState()
   {
     // if ANY internal state is not good return bad.
-    for (auto internal : m_internals) {
-      if (!(internal->state == GoodValue || internal->state == GoodName)) {
+    for (auto& internal : m_internals) {
+      if (!(internal.state == GoodValue || internal.state == GoodName)) {
         return BadValue;
       }
     }
@@ -585,16 +725,152 @@ public:
 
 private:
   PropertyValueState m_state;
-  QString m_name;
-  QTextCursor m_offset;
-  int m_minCount;
-  int m_maxCount;
-  PropertyStatus* m_next = nullptr;
-  QRect m_rect;
-  QList<Internal*> m_internals;
+  TextPosition m_offset;
+  int m_length;
+  qint16 m_minCount = 0;
+  qint16 m_maxCount = 0;
+  bool m_linked = false;
+  // only the parts of a value that are in error get a section, so there
+  // are seldom more than two.
+  QVarLengthArray<Internal, 2> m_internals;
+};
+
+//! The linked statuses of one value as returned by the WidgetModel checks.
+//! The statuses are held inline so a check does not allocate. An empty list
+//! means that the check did not recognise the value, a list converts to
+//! false and -> reaches its first status so that it reads like the status
+//! that it starts with.
+class PropertyStatusList
+{
+public:
+  PropertyStatusList(std::nullptr_t = nullptr) {}
+  PropertyStatusList(PropertyValueState state,
+                     TextPosition offset = TextPosition(),
+                     int length = 0)
+  {
+    m_statuses.append(PropertyStatus(state, offset, length));
+  }
+
+  explicit operator bool() const { return !m_statuses.isEmpty(); }
+  PropertyStatus* operator->() { return m_statuses.data(); }
+  const PropertyStatus* operator->() const { return m_statuses.data(); }
+
+  int size() const { return m_statuses.size(); }
+  bool isEmpty() const { return m_statuses.isEmpty(); }
+  const PropertyStatus& at(int index) const { return m_statuses.at(index); }
+
+  //! Links status after the last status of the list.
+  void append(const PropertyStatus& status)
+  {
+    if (!m_statuses.isEmpty()) {
+      m_statuses.last().setLinked(true);
+    }
+    m_statuses.append(status);
+    m_statuses.last().setLinked(false);
+  }
+
+private:
+  QVarLengthArray<PropertyStatus, 1> m_statuses;
 };
 
 QDebug
 operator<<(QDebug debug, const PropertyStatus& status);
 
+//! The unit that follows a number in a length value.
+enum LengthUnit
+{
+  NoLengthUnit,
+  PxLengthUnit,
+  PtLengthUnit,
+  EmLengthUnit,
+  ExLengthUnit,
+  PercentLengthUnit,
+};
+
+//! A number, and any unit that immediately follows it, read from the text of
+//! a value.
+struct NumberLiteral
+{
+  double value = 0.0;
+  LengthUnit unit = NoLengthUnit;
+  //! The characters used by the number, not counting the unit.
+  int numberLength = 0;
+  //! The characters used by the number and its unit.
+  int length = 0;
+  //! The number has no fraction or exponent.
+  bool isInteger = false;
+
+  //! A number was found, an invalid literal uses no characters at all.
+  bool isValid() const { return numberLength > 0; }
+};
+
+//! Reads a number, with an optional unit, from the start of text. Nothing is
+//! allocated, text is read through a small ASCII buffer on the stack.
+NumberLiteral
+lexNumber(QStringView text);
+
+//! Reads text as a single number with an optional unit, ignoring any
+//! surrounding blanks. The literal is invalid if text holds anything else.
+NumberLiteral
+parseNumber(QStringView text);
+
+//! A colour value read from text, either a #hex value or one of the rgb(),
+//! rgba(), hsv(), hsva(), hsl() or hsla() functions.
+struct ColorLiteral
+{
+  enum Form
+  {
+    NoColor,
+    HashColor,
+    RgbColor,
+    RgbaColor,
+    HsvColor,
+    HsvaColor,
+    HslColor,
+    HslaColor,
+  };
+  //! The position of a function component within the text, and whether it
+  //! was in range.
+  struct Component
+  {
+    int offset = 0;
+    int length = 0;
+    PropertyValueState state = GoodValue;
+  };
+
+  Form form = NoColor;
+  //! The colour, only meaningful if the literal is valid.
+  QRgb rgb = 0;
+  //! The number of components the function takes.
+  int expected = 0;
+  //! The number of components found, only the first four are kept.
+  int count = 0;
+  Component components[4];
+  //! A #hex value has one of the lengths that QColor accepts.
+  bool goodHash = false;
+
+  bool isFunction() const { return form > HashColor; }
+  bool isValid() const
+  {
+    if (form == HashColor) {
+      return goodHash;
+    }
+    if (form == NoColor || count != expected) {
+      return false;
+    }
+    for (int i = 0; i < count; i++) {
+      if (components[i].state != GoodValue) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+//! Reads a colour literal in a single pass without allocating. Names are not
+//! recognised, a literal that is not a #hex value or colour function has the
+//! NoColor form.
+ColorLiteral
+parseColor(QStringView text);
+
 #endif // COMMON_H
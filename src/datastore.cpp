@@ -22,14 +22,16 @@
 #include "datastore.h"
 #include "node.h"
 #include "parser.h"
+#include "scanner.h"
 //#include "safe_lib.h"
 #include "datastore.h"
 #include "qyamlcpp/qyamlcpp.h"
 #include "rapidfuzz/fuzz.hpp"
 #include "rapidfuzz/utils.hpp"
 #include "string"
-#include "stylesheetedit/stylesheetedit.h"
-#include "stylesheetedit_p.h"
+#include "stylesheetview.h"
+
+#include <limits>
 
 const QFont DataStore::NORMALFONT =
   QFont("Source Code Pro", 9, QFont::Normal, false);
@@ -44,20 +46,8 @@ const QString DataStore::URL_REGEX =
   "museum|us|ca|uk)(\\:[0-9]+)*(/"
   "($|[a-zA-Z0-9\\.\\,\\;\?\'\\\\+&%\\$#\\=~_\\-]+))*$";
 
-DataStore::DataStore(QWidget* parent)
+DataStore::DataStore(QObject* parent)
   : QObject(parent)
-  , m_parent(parent)
-  , m_invalidIcon(":/icons/invalid")
-  , m_validIcon(":/icons/valid")
-  , m_addSemiColonIcon(":/icons/add-scolon")
-  , m_addDColonIcon(":/icons/add-dcolon")
-  , m_addColonIcon(":/icons/add-colon")
-  , m_badIcon(":/icons/bad")
-  , m_badSColonIcon(":/icons/bad-scolon")
-  , m_badColonIcon(":/icons/bad-colon")
-  , m_badDColonIcon(":/icons/bad-dcolon")
-  , m_noIcon(":/icons/no")
-  , m_fuzzyIcon(":/icons/fuzzy")
   , m_braceCount(0)
   , m_manualMove(false)
   , m_hasSuggestion(false)
@@ -82,32 +72,90 @@ DataStore::~DataStore()
 }
 
 void
-DataStore::setEditor(StylesheetEditor* editor)
+DataStore::setEditor(StylesheetView* editor)
 {
   m_editor = editor;
 }
 
+TextPosition
+DataStore::textPosition(int position)
+{
+  if (QThread::currentThread() != thread()) {
+    // the edit map belongs to the GUI thread.
+    return TextPosition(position, nullptr);
+  }
+  return TextPosition(position, &m_offsetMap);
+}
+
+const OffsetMap*
+DataStore::offsetMap() const
+{
+  return &m_offsetMap;
+}
+
+void
+DataStore::addEdit(int position, int charsRemoved, int charsAdded)
+{
+  QMutexLocker locker(&m_mutex);
+  m_offsetMap.addEdit(position, charsRemoved, charsAdded);
+  shiftNodeIndex(position, charsRemoved, charsAdded);
+  shiftBraces(position, charsRemoved, charsAdded);
+  if (m_offsetMap.pendingEdits() >= MAX_PENDING_EDITS) {
+    compactEdits();
+  }
+}
+
+//! Brings every position held by the nodes up to date and then empties the
+//! edit log, so that the log does not grow with every keystroke between
+//! full reparses and a position never replays more than MAX_PENDING_EDITS
+//! edits. Must be called with m_mutex held.
+void
+DataStore::compactEdits()
+{
+  for (auto it = m_nodes.cbegin(); it != m_nodes.cend(); ++it) {
+    // the keys are copies of the node positions so are brought up to date
+    // as well, their order is unchanged.
+    it.key().position();
+    it.value()->attach(&m_offsetMap, m_editor);
+  }
+  m_offsetMap.clear();
+}
+
+void
+DataStore::clearEdits()
+{
+  m_offsetMap.clear();
+}
+
 QTextCursor
 DataStore::getCursorForPosition(int position)
 {
+  if (!m_editor) {
+    return QTextCursor();
+  }
   QTextCursor cursor(m_editor->document());
   cursor.setPosition(position);
   return cursor;
 }
 
 QRect
-DataStore::getRectForText(int start, const QString& text)
+DataStore::getRectForText(int start, int length)
 {
+  // there is no layout available off the GUI thread, or without an editor.
+  if (!m_editor || QThread::currentThread() != thread()) {
+    return QRect();
+  }
   // TODO So far this assumes that a complex value is only over a single line.
-  auto cursor = getCursorForPosition(start);
-  auto rect = m_editor->cursorRect(cursor);
-  rect.setWidth(m_editor->fontMetrics().horizontalAdvance(text));
+  auto rect = m_editor->cursorRect(getCursorForPosition(start));
+  auto end = m_editor->cursorRect(getCursorForPosition(start + length));
+  rect.setWidth(end.left() - rect.left());
   return rect;
 }
 
 QPair<int, int>
 DataStore::attributeCounts(const QString& name)
 {
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->attributeCounts(name);
 }
 
@@ -183,18 +231,13 @@ DataStore::loadXmlTheme(const QString& /*name*/)
 }
 
 bool
-DataStore::saveXmlScheme(const QString& name)
+DataStore::saveXmlScheme(const QString& name, bool overwrite)
 {
   QString filename = QDir(m_configDir).filePath(name + ".xml");
   QFile file(filename);
   QMap<QString, QList<QString>> names;
-  if (file.exists()) {
-    // TODO OVERWRITE ??
-    if (QMessageBox::question(
-          m_parent, tr("File already exists!"), tr("Press Yes to Overwrite")) ==
-        QMessageBox::No) {
-      return false;
-    }
+  if (file.exists() && !overwrite) {
+    return false;
   }
 
   if (file.open(QFile::ReadOnly | QFile::Text)) {
@@ -406,48 +449,50 @@ DataStore::readCustomThemes()
 void
 DataStore::addWidget(const QString& widget, const QString& parent)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   m_widgetModel->addWidget(widget, parent);
 }
 
 void
 DataStore::removeWidget(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   m_widgetModel->removeWidget(name);
 }
 
 bool
 DataStore::containsWidget(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
+  QReadLocker locker(&m_modelLock);
   // NOT toLower() as widget names are cased.
-  return m_widgetModel->hasWidget(name);
+  return m_widgetModel->keywordTypes(name).testFlag(WidgetKeyword);
 }
 
 QMultiMap<int, QString>
 DataStore::fuzzySearchWidgets(const QString& name)
 {
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->fuzzySearchWidgets(name);
 }
 
 bool
 DataStore::containsProperty(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
-  return m_widgetModel->containsProperty(name.toLower());
+  QReadLocker locker(&m_modelLock);
+  return m_widgetModel->keywordTypes(name).testFlag(PropertyKeyword);
 }
 
 QMultiMap<int, QString>
 DataStore::fuzzySearchProperty(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->fuzzySearchProperty(name);
 }
 
 QMultiMap<int, QString>
 DataStore::fuzzySearchPropertyValue(const QString& name, const QString& value)
 {
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->fuzzySearchPropertyValue(name, value);
 }
 
@@ -461,47 +506,58 @@ DataStore::fuzzySearchPropertyValue(const QString& name, const QString& value)
 bool
 DataStore::containsPseudoState(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
-  return m_widgetModel->containsPseudoState(name.toLower());
+  QReadLocker locker(&m_modelLock);
+  return m_widgetModel->keywordTypes(name).testFlag(PseudoStateKeyword);
 }
 
 QMultiMap<int, QString>
 DataStore::fuzzySearchPseudoStates(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->fuzzySearchPseudoStates(name);
 }
 
 bool
 DataStore::containsSubControl(const QString& name)
 {
-  return m_widgetModel->containsSubControl(name);
+  QReadLocker locker(&m_modelLock);
+  return m_widgetModel->keywordTypes(name.trimmed())
+    .testFlag(SubControlKeyword);
+}
+
+KeywordTypes
+DataStore::keywordTypes(const QString& name)
+{
+  QReadLocker locker(&m_modelLock);
+  return m_widgetModel->keywordTypes(name);
 }
 
 bool
 DataStore::isValidSubControlForWidget(const QString& widget,
                                       const QString& subcontrol)
 {
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->isValidSubControlForWidget(widget, subcontrol);
 }
 
 QMultiMap<int, QString>
 DataStore::fuzzySearchSubControl(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->fuzzySearchSubControl(name);
 }
 
 QMultiMap<int, QString>
 DataStore::fuzzySearchColorNames(const QString& name)
 {
-  QMutexLocker locker(&m_mutex);
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->fuzzySearchColorNames(name);
 }
 
 bool
 DataStore::addCustomWidget(const QString& name, const QString& parent)
 {
+  QWriteLocker locker(&m_modelLock);
   return m_widgetModel->addCustomWidget(name, parent);
 }
 
@@ -509,6 +565,7 @@ bool
 DataStore::addCustomWidgetPseudoStates(const QString& name,
                                        const QStringList& states)
 {
+  QWriteLocker locker(&m_modelLock);
   return m_widgetModel->addCustomWidgetPseudoStates(name, states);
 }
 
@@ -516,6 +573,7 @@ bool
 DataStore::addCustomWidgetSubControls(const QString& name,
                                       const QStringList& controls)
 {
+  QWriteLocker locker(&m_modelLock);
   return m_widgetModel->addCustomWidgetSubControls(name, controls);
 }
 
@@ -523,6 +581,7 @@ bool
 DataStore::addCustomWidgetProperties(const QString& name,
                                      const QStringList& properties)
 {
+  QWriteLocker locker(&m_modelLock);
   return m_widgetModel->addCustomWidgetProperties(name, properties);
 }
 
@@ -531,6 +590,7 @@ DataStore::addCustomWidgetPropertyValue(const QString& widget,
                                         const QString& property,
                                         const QString& value)
 {
+  QWriteLocker locker(&m_modelLock);
   return m_widgetModel->addCustomWidgetPropertyValue(widget, property, value);
 }
 
@@ -539,6 +599,7 @@ DataStore::addCustomWidgetPropertyValues(const QString& widget,
                                          const QString& property,
                                          QStringList values)
 {
+  QWriteLocker locker(&m_modelLock);
   return m_widgetModel->addCustomWidgetPropertyValues(widget, property, values);
 }
 
@@ -560,59 +621,37 @@ DataStore::checkSubControlForWidget(const QString& widget, const QString& name)
   return m_widgetModel->checkSubControlForWidget(widget, name);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkAlignment(const QString& value, int start) const
 {
   if (m_alignmentValues.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkAttachment(const QString& value, int start) const
 {
   if (m_attachment.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     status->setState(PropertyValueState::GoodValue);
     return status;
   }
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBackground(const QString& value, int start) const
 {
-  auto status = checkBrush(value, start);
-  if (status)
-    return status;
-
-  status = checkUrl(value, start);
-  if (status)
-    return status;
-
-  status = checkRepeat(value, start);
-  if (status)
-    return status;
-
-  status = checkAlignment(value, start);
-
-  return status;
+  return matchValueGrammar(Background, value, start);
 }
 
 // PropertyStatus*
@@ -620,7 +659,7 @@ WidgetModel::checkBackground(const QString& value, int start) const
 //{
 //  if (value == "true" || value == "false") {
 //    int pos = start - value.length();
-//    auto status = new PropertyStatus(PropertyValueState::GoodValue, value,
+//    auto status = PropertyStatusList(PropertyValueState::GoodValue, value,
 //    pos); if (start != -1) {
 //      auto rect = m_datastore->getRectForText(pos, value);
 //      status->setRect(rect);
@@ -631,41 +670,27 @@ WidgetModel::checkBackground(const QString& value, int start) const
 //  return nullptr;
 //}
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBoolean(const QString& value, int start) const
 {
   QString lValue = value.toLower();
   if (value == "0" || value == "1" || lValue == "true" || lValue == "false") {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBorder(const QString& value, int start) const
 {
-  auto status = checkBorderStyle(value, start);
-  if (status)
-    return status;
-
-  status = checkLength(value, start);
-  if (status)
-    return status;
-
-  status = checkBrush(value, start);
-
-  return status;
+  return matchValueGrammar(Border, value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBorderImage(const QString& value, int start) const
 {
   auto status = checkUrl(value, start);
@@ -679,31 +704,23 @@ WidgetModel::checkBorderImage(const QString& value, int start) const
 
   if (m_borderImage.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBorderStyle(const QString& value, int start) const
 {
   if (m_borderStyle.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     status->setState(PropertyValueState::GoodValue);
     return status;
   }
@@ -711,314 +728,118 @@ WidgetModel::checkBorderStyle(const QString& value, int start) const
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBoxColors(const QString& value, int& pos) const
 {
   // this is a 1-4 count item.
-  return checkColor(value, pos);
+  return matchValueGrammar(BoxColors, value, pos);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBoxLengths(const QString& value, int& pos) const
 {
   // this is a 1-4 count item.
   return checkLength(value, pos);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkBrush(const QString& value, int start) const
 {
-  auto status = checkColor(value, start);
-  if (status)
-    return status;
-
-  status = checkGradient(value, start);
-  if (status)
-    return status;
-
-  status = checkPaletteRole(value, start);
-
-  return status;
+  return matchValueGrammar(Brush, value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkColorName(int start, const QString& value) const
 {
   int pos = start - value.length();
   if (m_colors.contains(value.toLower())) {
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   auto fuzzylist = fuzzySearch(value.toLower(), m_colors);
   if (!fuzzylist.isEmpty()) {
-    auto status = new PropertyStatus(PropertyValueState::FuzzyColorValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::FuzzyColorValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkColorHashValue(int start, const QString& value) const
 {
   if (value.startsWith("#")) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::BadHashColorValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (value.length() == 4 || value.length() == 7) {
-      bool ok = false;
-      QString val = value.right(value.length() - 1);
-      val.toUInt(&ok, 16);
-      if (ok) {
-        status->setState(PropertyValueState::GoodValue);
-      }
-    }
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
+    auto status = PropertyStatusList(PropertyValueState::BadHashColorValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
+    if (parseColor(value).isValid()) {
+      status->setState(PropertyValueState::GoodValue);
     }
     return status;
   }
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkColorRGB(int start, const QString& value) const
 {
-  QString name;
-  int count = 0;
-  int pos = start - value.length();
-  if (value.toLower().startsWith("rgba")) {
-    count = 4;
-    name = "rgba";
-  } else if (value.toLower().startsWith("rgb")) {
-    count = 3;
-    name = "rgb";
-  } else {
+  auto color = parseColor(value);
+  if (!(color.form == ColorLiteral::RgbColor ||
+        color.form == ColorLiteral::RgbaColor)) {
     return nullptr;
   }
-  if (count < 3 || count > 4) {
-    return nullptr;
-  }
-
-  auto status = new PropertyStatus(PropertyValueState::GoodName,
-                                   value,
-                                   m_datastore->getCursorForPosition(pos));
-  status->setMinCount(1);
-  status->setMaxCount(count);
-  if (start != -1) {
-    auto rect = m_datastore->getRectForText(pos, value);
-    status->setRect(rect);
-  }
-
-  auto offset = value.indexOf('(');
-  auto rgb = value.mid(offset + 1);
-  auto endOffset = rgb.indexOf(")");
-  if (endOffset) {
-    rgb = rgb.left(endOffset);
-    endOffset = pos + offset + 1 + rgb.length();
-  }
-  QStringList parts = rgb.split(',');
-
-  if (parts.count() != count) {
-    status->setState(PropertyValueState::BadValueCount);
-    return status;
-  } else {
-    auto ok = false;
-    auto val = 0;
-    QRect rect;
-    offset = 0; // reset to start of truncated string
-
-    for (auto part : parts) {
-      part = part.trimmed();
-      offset = value.indexOf(part, offset);
-
-      if (part.endsWith('%')) {
-        auto nPart = part.left(part.length() - 1);
-        if (offset != -1) {
-          rect = m_datastore->getRectForText(offset, part);
-        }
-        val = nPart.toInt(&ok);
-        if (!ok || val < 0 || val > 100) {
-          status->addSectionValue(
-            PropertyValueState::BadNumericalValue_100,
-            part,
-            m_datastore->getCursorForPosition(pos + offset),
-            rect);
-        } else {
-          status->addSectionValue(
-            PropertyValueState::GoodValue,
-            part,
-            m_datastore->getCursorForPosition(pos + offset),
-            rect);
-        }
-        offset += part.length();
-      } else {
-        //        part = part.left(part.length() - 1);
-        if (offset != -1) {
-          rect = m_datastore->getRectForText(offset, part);
-        }
-        auto l = part.length();
-        if (part.startsWith("0x") && (l == 3 || l == 4)) {
-          val = part.toUInt(&ok, 16);
-        } else {
-          val = part.toUInt(&ok);
-        }
-        if (!ok || val < 0 || val > 255) {
-          status->addSectionValue(
-            PropertyValueState::BadNumericalValue_255,
-            part,
-            m_datastore->getCursorForPosition(pos + offset),
-            rect);
-        } else {
-          status->addSectionValue(
-            PropertyValueState::GoodValue,
-            part,
-            m_datastore->getCursorForPosition(pos + offset),
-            rect);
-        }
-        offset += part.length();
-      }
-    }
-  }
-  status->setRect(m_datastore->getRectForText(start, value));
-  return status;
+  return colorFunctionStatus(color, start, value);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkColorHS(int start, const QString& value) const
 {
-  QString name;
-  auto count = 0;
-  int pos = start - value.length();
-  if (value.toLower().startsWith("hsla")) {
-    count = 4;
-    name = "hsla";
-  } else if (value.toLower().startsWith("hsva")) {
-    count = 4;
-    name = "hsva";
-  } else if (value.toLower().startsWith("hsl")) {
-    count = 3;
-    name = "hsl";
-  } else if (value.toLower().startsWith("hsv")) {
-    count = 3;
-    name = "hsv";
-  } else {
+  auto color = parseColor(value);
+  if (!(color.form == ColorLiteral::HsvColor ||
+        color.form == ColorLiteral::HsvaColor ||
+        color.form == ColorLiteral::HslColor ||
+        color.form == ColorLiteral::HslaColor)) {
     return nullptr;
   }
-  if (count < 3 || count > 4)
-    return nullptr;
+  return colorFunctionStatus(color, start, value);
+}
 
-  auto status = new PropertyStatus(PropertyValueState::GoodName,
-                                   value,
-                                   m_datastore->getCursorForPosition(pos));
+/*
+   Only the components that are out of range get a section, a good colour
+   needs nothing more than its status.
+*/
+PropertyStatusList
+WidgetModel::colorFunctionStatus(const ColorLiteral& color,
+                                 int start,
+                                 const QString& value) const
+{
+  int pos = start - value.length();
+  auto status = PropertyStatusList(PropertyValueState::GoodName,
+                                   m_datastore->textPosition(pos),
+                                   value.length());
   status->setMinCount(1);
-  status->setMaxCount(count);
-  if (start != -1) {
-    auto rect = m_datastore->getRectForText(pos, value);
-    status->setRect(rect);
-  }
-
-  auto offset = value.indexOf('(');
-  auto hs = value.mid(offset + 1);
-  auto endOffset = hs.indexOf(")");
-  if (endOffset) {
-    hs = hs.left(endOffset);
-    endOffset = pos + offset + 1 + hs.length();
-  }
-  QStringList parts = hs.split(',');
+  status->setMaxCount(color.expected);
 
-  if (parts.count() != count) {
+  if (color.count != color.expected) {
     status->setState(PropertyValueState::BadValueCount);
     return status;
-  } else {
-    auto ok = false;
-    auto val = 0;
-    QRect rect;
-
-    for (auto i = 0; i < parts.size(); i++) {
-      auto part = parts.at(i).trimmed();
-      offset = value.indexOf(part, offset + 1);
-
-      if (i > 0 && part.endsWith('%')) {
-        auto nPart = part.left(part.length() - 1);
-        if (offset != -1) {
-          rect = m_datastore->getRectForText(offset, part);
-        }
-        val = nPart.toInt(&ok);
-        if (!ok || val < 0 || val > 100) {
-          status->addSectionValue(
-            PropertyValueState::BadNumericalValue_100,
-            part,
-            m_datastore->getCursorForPosition(pos + offset),
-            rect);
-        } else {
-          status->addSectionValue(
-            PropertyValueState::GoodValue,
-            part,
-            m_datastore->getCursorForPosition(pos + offset),
-            rect);
-        }
-        offset += part.length();
-      } else {
-        part = part.trimmed();
-        if (offset != -1) {
-          rect = m_datastore->getRectForText(offset, part);
-        }
-        auto l = part.length();
-        if (part.startsWith("0x") && (l == 3 || l == 4)) {
-          val = part.toUInt(&ok, 16);
-        } else {
-          val = part.toUInt(&ok);
-        }
-        if (i == 0) {
-          if (!ok || val < 0 || val > 359) {
-            status->addSectionValue(
-              PropertyValueState::BadNumericalValue_359,
-              part,
-              m_datastore->getCursorForPosition(pos + offset),
-              rect);
-          } else {
-            status->addSectionValue(
-              PropertyValueState::GoodValue,
-              part,
-              m_datastore->getCursorForPosition(pos + offset),
-              rect);
-          }
-        } else {
-          if (!ok || val < 0 || val > 255) {
-            status->addSectionValue(
-              PropertyValueState::BadNumericalValue_255,
-              part,
-              m_datastore->getCursorForPosition(pos + offset),
-              rect);
-          } else {
-            status->addSectionValue(
-              PropertyValueState::GoodValue,
-              part,
-              m_datastore->getCursorForPosition(pos + offset),
-              rect);
-          }
-        }
-        offset += part.length();
-      }
+  }
+
+  for (int i = 0; i < color.count; i++) {
+    auto& component = color.components[i];
+    if (component.state != PropertyValueState::GoodValue) {
+      status->addSectionValue(
+        component.state,
+        m_datastore->textPosition(pos + component.offset),
+        component.length);
     }
   }
-  status->setRect(m_datastore->getRectForText(start, value));
   return status;
 }
 
@@ -1039,16 +860,13 @@ WidgetModel::skipBlanks(const QString& text,
                         int& pos,
                         bool showLineMarkers) const
 {
-  QChar c;
-
-  for (; pos < text.length(); pos++) {
-    c = text.at(pos);
-
-    if (showLineMarkers && c == '\n') {
-      break;
-    } else if (c.isSpace() /* || c == '\n' || c == '\r' || c == '\t'*/) {
-      continue;
+  while (pos < text.length()) {
+    pos = Scanner::skipSpaces(text, pos, showLineMarkers);
 
+    // the scanner only knows ASCII whitespace.
+    if (pos < text.length() && text.at(pos).unicode() > 0x7f &&
+        text.at(pos).isSpace()) {
+      pos++;
     } else {
       break;
     }
@@ -1067,146 +885,177 @@ DataStore::findNext(const QString& text, int& pos, bool showLineMarkers) const
   return m_widgetModel->findNext(text, pos, showLineMarkers);
 }
 
+Token
+DataStore::nextToken(const QString& text, int& pos, bool showLineMarkers) const
+{
+  return m_widgetModel->nextToken(text, pos, showLineMarkers);
+}
+
 QString
 WidgetModel::findNext(const QString& text, int& pos, bool showLineMarkers) const
 {
-  QString block;
+  return nextToken(text, pos, showLineMarkers).toString(text);
+}
+
+//! Returns true if the text from start to end is an integer, optionally
+//! preceded by a minus sign.
+static bool
+isInteger(const QString& text, int start, int end)
+{
+  if (start < end && text.at(start) == '-') {
+    start++;
+  }
+  if (start >= end) {
+    return false;
+  }
+  for (int i = start; i < end; i++) {
+    auto c = text.at(i).unicode();
+    if (c < '0' || c > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+//! Finds the next token in text starting at pos, leaving pos after the end of
+//! the token. No text is copied, the token only holds its offset and length.
+//!
+//! Newline tokens are the exception, pos is left at the newline.
+Token
+WidgetModel::nextToken(const QString& text,
+                       int& pos,
+                       bool showLineMarkers) const
+{
+  Token token;
   QChar c;
+  // brackets nest, eg qlineargradient(stop: 0 rgb(0, 0, 0), ...), so the
+  // token only ends at the bracket that closes the first one.
+  int depth = 0;
   bool insideBrackets = false;
   bool insideQuotes = false;
+  bool quotedInBrackets = false;
   skipBlanks(text, pos, showLineMarkers);
+  token.offset = pos;
 
-  if (pos < text.length()) {
+  while (pos < text.length()) {
     c = text.at(pos);
-    while (pos < text.length()) {
-      if (c.isNull()) {
-        return block;
-      }
+    // the token so far is text[token.offset, pos).
+    auto length = pos - token.offset;
 
-      if (insideBrackets) {
-        if (c == ')') {
-          //          insideBrackets = false;
-          block += c;
-          pos++;
-          return block;
-        } else { // end of url or gradient.
-          block += c;
-        }
-        pos++;
-      } else if (insideQuotes) {
-        if (c == "\"") {
-          //          insideQuotes = false;
-          block += c;
-          pos++;
-          return block;
-        } else { // end of url or gradient.
-          block += c;
-        }
-        pos++;
-      } else if (c.isLetterOrNumber() || c == '-') {
-        if (!block.isEmpty()) {
-          QChar b = block.back();
-          if (b == '{' || b == '}' || b == ';' || b == ':' || b == "#") {
-            return block;
-          }
-        }
-        block += c;
-        pos++;
-      } else if (c == ".") {
-        if (!block.isEmpty()) {
-          auto ok = false;
-          block.toInt(&ok);
-          if (ok) {
-            // the prev section is an integer.
-            block += c;
-            pos++;
-          } else {
-            // returns if a . char is detected when the block
-            // is NOT an integer. ie a real value is expected.
-            return block;
-          }
-        }
+    if (c.isNull()) {
+      break;
+    }
+
+    if (insideQuotes) {
+      pos++;
+      if (c == '"') {
+        break;
+      }
+    } else if (depth > 0) {
+      pos++;
+      if (quotedInBrackets) {
+        quotedInBrackets = (c != '"');
+      } else if (c == '"') {
+        quotedInBrackets = true;
       } else if (c == '(') {
-        insideBrackets = true;
-        block += c;
-        pos++;
-      } else if (c == "\"") {
-        insideQuotes = true;
-        block += c;
-        pos++;
-      } else if (showLineMarkers && c == '\n') {
-        if (block.isEmpty()) {
-          block += c;
-        }
-        return block;
-      } else if (c.isSpace() && !block.isEmpty()) {
-        return block;
-      } else if (c == '{' || c == '}' || c == ';' || c == ':' || c == ',' ||
-                 c == '#') {
-        if (!block.isEmpty()) {
-          if (block.back().isLetterOrNumber()) {
-            // a possibly correct name/number string
-            return block;
-          }
+        depth++;
+      } else if (c == ')' && --depth == 0) {
+        break;
+      }
+    } else if (c.isLetterOrNumber() || c == '-') {
+      if (length > 0) {
+        QChar b = text.at(pos - 1);
+        if (b == '{' || b == '}' || b == ';' || b == ':' || b == '#') {
+          break;
         }
-        block += c;
+      }
+      // the rest of an ASCII name is skipped in one go.
+      pos = Scanner::skipName(text, pos + 1);
+    } else if (c == '.') {
+      if (length == 0) {
+        // a lone '.', ie a class selector.
         pos++;
-      } else if (c == '/') {
-        if (pos < text.length() - 1) {
-          if (text.at(pos + 1) == '*') {
-            // a comment
-            if (!block.isEmpty()) {
-              pos--; // step back.
-              return block;
-
-            } else {
-              pos += 2;
-              return "/*";
-            }
-          }
-        }
+        break;
+      } else if (isInteger(text, token.offset, pos)) {
+        // the prev section is an integer.
+        pos++;
+      } else {
+        // returns if a . char is detected when the block
+        // is NOT an integer. ie a real value is expected.
+        break;
       }
-
-      if (pos < text.length()) {
-        c = text.at(pos);
+    } else if (c == '(') {
+      insideBrackets = true;
+      depth = 1;
+      pos++;
+    } else if (c == '"') {
+      insideQuotes = true;
+      pos++;
+    } else if (showLineMarkers && c == '\n') {
+      if (length == 0) {
+        token.kind = Token::Newline;
+        token.length = 1;
+        return token;
+      }
+      break;
+    } else if (c.isSpace()) {
+      break;
+    } else if (c == '{' || c == '}' || c == ';' || c == ':' || c == ',' ||
+               c == '#') {
+      // each symbol is a token of its own, the only pair is "::".
+      if (length > 0 && !(length == 1 && c == ':' && text.at(pos - 1) == ':')) {
+        break;
+      }
+      pos++;
+    } else if (c == '/' && pos < text.length() - 1 &&
+               text.at(pos + 1) == '*') {
+      // a comment
+      if (length == 0) {
+        pos += 2;
+        token.kind = Token::CommentStart;
+        token.length = 2;
+        return token;
+      }
+      break;
+    } else {
+      // any other character is a token of its own.
+      if (length == 0) {
+        pos++;
       }
+      break;
     }
   }
 
-  return block;
+  token.length = pos - token.offset;
+  if (token.length == 0) {
+    token.kind = Token::End;
+  } else if (insideBrackets) {
+    token.kind = Token::Bracketed;
+  } else if (insideQuotes) {
+    token.kind = Token::Quoted;
+  } else if (text.at(token.offset).isLetterOrNumber() ||
+             text.at(token.offset) == '-') {
+    token.kind = Token::Name;
+  } else {
+    token.kind = Token::Symbol;
+  }
+  return token;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkColor(const QString& value, int start) const
 {
-  PropertyStatus* status = nullptr;
-  if ((status = checkColorName(start, value)))
-    return status;
-
-  if ((status = checkColorHashValue(start, value)))
-    return status;
-
-  if ((status = checkColorRGB(start, value)))
-    return status;
-
-  if ((status = checkColorHS(start, value)))
-    return status;
-
-  return nullptr;
+  return matchValueGrammar(Color, value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkFontStyle(const QString& value, int start) const
 {
   if (m_fontStyle.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     status->setState(PropertyValueState::GoodValue);
     return status;
   }
@@ -1214,444 +1063,325 @@ WidgetModel::checkFontStyle(const QString& value, int start) const
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkString(const QString& value, int start) const
 {
   if (value.toLower().startsWith("\"") && value.toLower().endsWith("\"")) {
     // enclosed within " characters so a string
     // The actual value is NOT tested.
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkFont(const QString& value, int start) const
 {
-  auto status = checkFontSize(value, start);
-  if (status)
-    return status;
-
-  status = checkFontStyle(value, start);
-  if (status)
-    return status;
-
-  status = checkFontWeight(value, start);
-  if (status)
-    return status;
-
-  status = checkString(value, start);
-  return status;
+  return matchValueGrammar(Font, value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkFontSize(const QString& value, int start) const
 {
-  if (m_fontSizes.contains(value.toLower())) {
-    int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
-    return status;
-  }
-
-  auto status = checkLength(value, start);
-  if (status) {
-    if (!(value.endsWith("px") || value.endsWith("pt"))) {
-      // in Qt only pt and pixels are allowed for fonts.
-      status->setState(PropertyValueState::BadFontUnit);
-    }
-  }
-  return status;
+  return matchValueGrammar(FontSize, value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkFontWeight(const QString& value, int start) const
 {
   if (m_fontWeight.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
-  bool ok;
-  value.toInt(&ok);
-  if (ok) {
+  auto number = parseNumber(value);
+  if (number.isValid() && number.unit == NoLengthUnit && number.isInteger &&
+      number.value >= std::numeric_limits<int>::min() &&
+      number.value <= std::numeric_limits<int>::max()) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-QPair<PropertyStatus*, int>
-WidgetModel::calculateNumericalStatus(const QString& section,
-                                      const QString& cleanValue,
-                                      const QString& number,
-                                      int start,
-                                      int offset,
-                                      QStringList parts) const
-{
-  auto nextOffset = offset;
-  auto status =
-    new PropertyStatus(PropertyValueState::GoodValue,
-                       section,
-                       m_datastore->getCursorForPosition(start + offset));
+/*
+   The names of the coordinates of each kind of gradient, in the order they
+   are held in GradientLiteral::coordinates.
+*/
+static const char16_t* const gradientCoordinates[][5] = {
+  {},
+  { u"x1", u"y1", u"x2", u"y2", nullptr },
+  { u"cx", u"cy", u"fx", u"fy", u"radius" },
+  { u"cx", u"cy", u"angle", nullptr, nullptr },
+};
 
-  if (parts.size() == 3) {
-    status->setState(PropertyValueState::BadValueCount);
-    status->setMaxCount(2);
+/*!
+   \brief Reads a gradient function in one pass over the value.
+
+   The kind comes from the name before the bracket, unless the name is not
+   an exact match in which case the fuzzy matched kind is used. Nested
+   brackets, as in rgba() stop colours, are skipped over when the arguments
+   are split.
+*/
+GradientLiteral
+WidgetModel::parseGradient(const QString& value,
+                           GradientLiteral::Kind kind) const
+{
+  GradientLiteral gradient;
+  auto open = value.indexOf('(');
+  int first = 0, last = (open < 0 ? value.length() : open);
+  while (first < last && value.at(first).isSpace()) {
+    first++;
+  }
+  while (last > first && value.at(last - 1).isSpace()) {
+    last--;
+  }
+  gradient.nameOffset = first;
+  gradient.nameLength = last - first;
+  gradient.argumentsOffset = open;
+
+  auto name = QStringView(value).mid(first, last - first);
+  for (int i = 0; i < m_gradient.size(); i++) {
+    if (name.compare(m_gradient.at(i), Qt::CaseInsensitive) == 0) {
+      kind = GradientLiteral::Kind(i + 1);
+      break;
+    }
+  }
+  gradient.kind = kind;
+  if (kind == GradientLiteral::NoGradient || open < 0) {
+    return gradient;
   }
 
-  if (!checkGradientNumber(number.trimmed())) {
-    nextOffset = cleanValue.indexOf(number, offset);
-    auto next =
-      new PropertyStatus(PropertyValueState::BadNumericalValue,
-                         number,
-                         m_datastore->getCursorForPosition(nextOffset));
-    status->setNext(next);
-    nextOffset += next->length();
+  auto start = open + 1;
+  auto depth = 0;
+  for (int i = start; i <= value.length(); i++) {
+    auto c = (i < value.length() ? value.at(i) : QChar(')'));
+    if (c == '(') {
+      depth++;
+    } else if (c == ')' && depth > 0) {
+      depth--;
+    } else if ((c == ',' && depth == 0) || c == ')') {
+      parseGradientArgument(value, start, i, gradient);
+      if (c == ')') {
+        break;
+      }
+      start = i + 1;
+    }
   }
-  return qMakePair<PropertyStatus*, int>(status, nextOffset);
+
+  return gradient;
 }
 
-QPair<PropertyStatus*, int>
-WidgetModel::calculateStopStatus(const QString& section,
-                                 const QString& cleanValue,
-                                 const QString& number,
-                                 const QString& color,
-                                 int start,
-                                 int offset,
-                                 QStringList parts) const
-{
-  auto nextOffset = offset;
-  auto status =
-    new PropertyStatus(PropertyValueState::GoodValue,
-                       section,
-                       m_datastore->getCursorForPosition(start + offset));
+void
+WidgetModel::parseGradientArgument(const QString& value,
+                                   int first,
+                                   int last,
+                                   GradientLiteral& gradient) const
+{
+  auto isSeparator = [&value](int i) {
+    return (value.at(i).isSpace() || value.at(i) == ':');
+  };
+  while (first < last && value.at(first).isSpace()) {
+    first++;
+  }
+  while (last > first && value.at(last - 1).isSpace()) {
+    last--;
+  }
+  if (first == last) {
+    return;
+  }
 
-  if (parts.size() == 2) { // should be 3
-    status->setState(PropertyValueState::BadValueCount);
+  auto addError = [&gradient](int offset,
+                              int length,
+                              PropertyValueState state,
+                              int maxCount = -1) {
+    GradientLiteral::Error error;
+    error.offset = offset;
+    error.length = length;
+    error.state = state;
+    error.maxCount = maxCount;
+    gradient.errors.append(error);
+  };
+
+  // name:number [colour], the colour is the rest of the argument.
+  int nameEnd = first;
+  while (nameEnd < last && !isSeparator(nameEnd)) {
+    nameEnd++;
+  }
+  int numberStart = nameEnd;
+  while (numberStart < last && isSeparator(numberStart)) {
+    numberStart++;
+  }
+  int numberEnd = numberStart;
+  while (numberEnd < last && !isSeparator(numberEnd)) {
+    numberEnd++;
+  }
+  int colorStart = numberEnd;
+  while (colorStart < last && isSeparator(colorStart)) {
+    colorStart++;
   }
 
-  if (!checkGradientNumber(number.trimmed())) {
-    nextOffset = cleanValue.indexOf(number, nextOffset);
-    auto next =
-      new PropertyStatus(PropertyValueState::BadNumericalValue,
-                         number,
-                         m_datastore->getCursorForPosition(nextOffset));
-    status->setNext(next);
-    nextOffset += next->length();
+  if (numberStart == last) {
+    addError(first, last - first, BadValueCount, 3);
+    return;
   }
 
-  GradientCheck::FuzzyCheck check;
-  if ((check = checkGradientColor(color.trimmed())) != GradientCheck::Good) {
-    nextOffset = cleanValue.indexOf(color, nextOffset);
-    if (check == GradientCheck::Fuzzy)
-      status->setState(PropertyValueState::FuzzyColorValue);
-    else
-      status->setState(PropertyValueState::BadColorValue);
+  auto name = QStringView(value).mid(first, nameEnd - first);
+  auto number = parseNumber(
+    QStringView(value).mid(numberStart, numberEnd - numberStart));
+  auto goodNumber = (number.isValid() && number.unit == NoLengthUnit);
+  auto hasColor = (colorStart < last);
+
+  if (name.compare(QStringView(u"stop"), Qt::CaseInsensitive) == 0) {
+    if (!hasColor) {
+      addError(first, last - first, BadValueCount);
+      return;
+    }
+    // stops must lie between 0 and 1, each after the one before.
+    if (!goodNumber || number.value < 0.0 || number.value > 1.0 ||
+        (!gradient.stops.isEmpty() &&
+         number.value < gradient.stops.last().position)) {
+      addError(numberStart, numberEnd - numberStart, BadNumericalValue);
+    }
+
+    GradientLiteral::Stop stop;
+    stop.position = number.value;
+    auto colorText = QStringView(value).mid(colorStart, last - colorStart);
+    auto color = parseColor(colorText);
+    auto check = GradientLiteral::BadColor;
+    if (color.form != ColorLiteral::NoColor) {
+      if (color.isValid()) {
+        check = GradientLiteral::GoodColor;
+        stop.rgb = color.rgb;
+      }
+    } else {
+      auto colorName = colorText.toString();
+      check = checkGradientColor(colorName);
+      if (check == GradientLiteral::GoodColor) {
+        stop.rgb = QColor(colorName).rgba();
+      }
+    }
+    if (check != GradientLiteral::GoodColor) {
+      addError(colorStart,
+               last - colorStart,
+               (check == GradientLiteral::FuzzyColor ? FuzzyColorValue
+                                                     : BadColorValue));
+    }
+    gradient.stops.append(stop);
+    return;
   }
 
-  return qMakePair<PropertyStatus*, int>(status, nextOffset);
-}
+  auto names = gradientCoordinates[gradient.kind];
+  int index = 0;
+  while (index < 5 && names[index] &&
+         name.compare(QStringView(names[index]), Qt::CaseInsensitive) != 0) {
+    index++;
+  }
+  if (index == 5 || !names[index]) {
+    addError(first, last - first, BadValueName);
+    return;
+  }
 
-GradientCheck*
-WidgetModel::getCorrectCheck(const QString& name) const
-{
-  GradientCheck* check = nullptr;
-  if (name.toLower() == "qlineargradient") {
-    check = new LinearCheck();
-  } else if (name.toLower() == "qradialgradient") {
-    check = new RadialCheck();
-  } else if (name.toLower() == "qconicalgradient") {
-    check = new ConicalCheck();
+  auto bit = quint8(1 << index);
+  if (gradient.coordinatesSet & bit) {
+    addError(first, last - first, RepeatValueName);
+    return;
+  }
+  gradient.coordinatesSet |= bit;
+
+  if (hasColor) {
+    addError(first, last - first, BadValueCount, 2);
+  } else if (!goodNumber) {
+    addError(numberStart, numberEnd - numberStart, BadNumericalValue);
+  } else {
+    gradient.coordinates[index] = number.value;
   }
-  return check;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkGradient(const QString& value, int start) const
 {
-  QString cleanValue = value.toLower();
-  QString correctType, actualType;
-  GradientCheck* gCheck = nullptr;
-  int offset = 0;
-  PropertyStatus *head, *next;
   int pos = start - value.length();
-
-  for (auto& g : m_gradient) {
-    if (cleanValue.toLower().contains(g)) {
-      gCheck = getCorrectCheck(g);
-      head = new PropertyStatus(PropertyValueState::GoodName,
-                                g,
-                                m_datastore->getCursorForPosition(pos));
-      if (start != -1) {
-        auto rect = m_datastore->getRectForText(pos, value);
-        head->setRect(rect);
-      }
-      next = head;
-      correctType = g; // the type it SHOULD be!
-      actualType = g;
-      break;
-    }
-  }
-
-  if (!gCheck) {
-    auto fuzzy = cleanValue.split("(").first();
-    for (auto& g : m_gradient) {
+  auto gradient = parseGradient(value);
+  auto name = value.mid(gradient.nameOffset, gradient.nameLength);
+  PropertyStatusList statuses;
+
+  if (gradient.kind != GradientLiteral::NoGradient) {
+    statuses = PropertyStatusList(
+      PropertyValueState::GoodName,
+      m_datastore->textPosition(pos + gradient.nameOffset),
+      gradient.nameLength);
+  } else {
+    auto fuzzyName = name.toLower().toStdString();
+    for (int i = 0; i < m_gradient.size(); i++) {
       double score =
-        rapidfuzz::fuzz::ratio(g.toStdString(), fuzzy.toStdString());
-      if (/*score < 100.0 &&*/ score > 90.0) { // TODO Increase minimum ??
-        // score can be greater than 100
-        gCheck = getCorrectCheck(g);
-        head = new PropertyStatus(PropertyValueState::FuzzyValueName,
-                                  fuzzy,
-                                  m_datastore->getCursorForPosition(pos));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, value);
-          head->setRect(rect);
-        }
-        next = head;
-        correctType = g; // the type it SHOULD be!
-        actualType = fuzzy;
+        rapidfuzz::fuzz::ratio(m_gradient.at(i).toStdString(), fuzzyName);
+      if (score > 90.0) {
+        gradient = parseGradient(value, GradientLiteral::Kind(i + 1));
+        statuses = PropertyStatusList(
+          PropertyValueState::FuzzyValueName,
+          m_datastore->textPosition(pos + gradient.nameOffset),
+          name.length());
         break;
       }
     }
   }
 
-  if (!gCheck) {
+  if (!statuses) {
     return nullptr;
   }
 
-  offset = cleanValue.indexOf("(");
-  auto position = pos + offset;
-  auto sections =
-    cleanValue.split(QRegularExpression("[,()]"), Qt::SkipEmptyParts);
-  if (sections.length() > 0 && sections.first() == actualType) {
-    sections.removeFirst();
+  // one status covers the arguments, the errors are drawn over it.
+  if (gradient.argumentsOffset >= 0) {
+    auto offset = pos + gradient.argumentsOffset;
+    statuses.append(PropertyStatus(PropertyValueState::GoodValue,
+                                   m_datastore->textPosition(offset),
+                                   value.length() - gradient.argumentsOffset));
   }
 
-  QString name, number, color;
-
-  for (auto& section : sections) {
-    section = section.trimmed();
-    auto parts =
-      section.split(QRegularExpression("[\\s:]"), Qt::SkipEmptyParts);
-    offset = cleanValue.indexOf(section, offset);
-    position = pos + offset;
-
-    // only two or three parts is valid.
-    if (parts.size() < 2 || parts.size() > 3) {
-      auto status = new PropertyStatus(
-        BadValueCount, section, m_datastore->getCursorForPosition(position));
-      status->setMaxCount(3);
-      if (start != -1) {
-        auto rect = m_datastore->getRectForText(position, section);
-        status->setRect(rect);
-      }
-      next->setNext(status);
-      next = status;
-      continue;
-    }
-
-    name = parts.at(0);
-    number = parts.at(1);
-    if (parts.size() == 3) {
-      color = parts.at(2);
-    }
-
-    if ((dynamic_cast<LinearCheck*>(gCheck))) {
-      auto check = gCheck->set(name);
-      if (check == GradientCheck::GoodName) {
-        auto [status, nextOffset] = calculateNumericalStatus(
-          section, cleanValue, number, pos, offset, parts);
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(position, section);
-          status->setRect(rect);
-        }
-        offset = nextOffset;
-        next->setNext(status);
-        next = status;
-        continue;
-      } else if (check == GradientCheck::Stop) {
-        auto [status, nextOffset] = calculateStopStatus(
-          section, cleanValue, number, color, pos, offset, parts);
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(position, section);
-          status->setRect(rect);
-        }
-        offset = nextOffset;
-        next->setNext(status);
-        next = status;
-        continue;
-      } else if (check == GradientCheck::Repeat) {
-        PropertyStatus* status = new PropertyStatus(
-          RepeatValueName, section, m_datastore->getCursorForPosition(offset));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(position, section);
-          status->setRect(rect);
-        }
-        next->setNext(status);
-        next = status;
-      } else {
-        PropertyStatus* status = new PropertyStatus(
-          BadValueName, section, m_datastore->getCursorForPosition(offset));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        next->setNext(status);
-        next = status;
-        continue;
-      }
-    } else if ((dynamic_cast<RadialCheck*>(gCheck))) {
-      auto check = gCheck->set(name);
-      if (check == GradientCheck::GoodName) {
-        auto [status, nextOffset] = calculateNumericalStatus(
-          section, cleanValue, number, pos, offset, parts);
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        offset = nextOffset;
-        next->setNext(status);
-        next = status;
-        continue;
-      } else if (check == GradientCheck::Stop) {
-        auto [status, nextOffset] = calculateStopStatus(
-          section, cleanValue, number, color, pos, offset, parts);
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        offset = nextOffset;
-        next->setNext(status);
-        next = status;
-        continue;
-      } else if (check == GradientCheck::Repeat) {
-        PropertyStatus* status = new PropertyStatus(
-          RepeatValueName, section, m_datastore->getCursorForPosition(offset));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        next->setNext(status);
-        next = status;
-      } else {
-        // an invalid name.
-        PropertyStatus* status = new PropertyStatus(
-          BadValueName, section, m_datastore->getCursorForPosition(offset));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        next->setNext(status);
-        next = status;
-      }
-    } else if ((dynamic_cast<ConicalCheck*>(gCheck))) {
-      auto check = gCheck->set(name);
-      if (check == GradientCheck::GoodName) {
-        auto [status, nextOffset] = calculateNumericalStatus(
-          section, cleanValue, number, pos, offset, parts);
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        offset = nextOffset;
-        next->setNext(status);
-        next = status;
-        continue;
-      } else if (check == GradientCheck::Stop) {
-        auto [status, nextOffset] = calculateStopStatus(
-          section, cleanValue, number, color, pos, offset, parts);
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        offset = nextOffset;
-        next->setNext(status);
-        next = status;
-        continue;
-      } else if (check == GradientCheck::Repeat) {
-        PropertyStatus* status = new PropertyStatus(
-          RepeatValueName, section, m_datastore->getCursorForPosition(offset));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          status->setRect(rect);
-        }
-        next->setNext(status);
-        next = status;
-      } else {
-        PropertyStatus* status = new PropertyStatus(
-          BadValueName, section, m_datastore->getCursorForPosition(offset));
-        next->setOffset(m_datastore->getCursorForPosition(offset));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, section);
-          next->setRect(rect);
-        }
-        next->setNext(status);
-        next = status;
-        continue;
-      }
+  for (auto& error : gradient.errors) {
+    PropertyStatus status(error.state,
+                          m_datastore->textPosition(pos + error.offset),
+                          error.length);
+    if (error.maxCount >= 0) {
+      status.setMaxCount(error.maxCount);
     }
+    statuses.append(status);
   }
-  delete gCheck;
-  return head;
+
+  return statuses;
 }
 
-GradientCheck::FuzzyCheck
+GradientLiteral::ColorCheck
 WidgetModel::checkGradientColor(const QString& value, int start) const
 {
-  auto status = checkColor(value, start);
-  if (start != -1) {
-    auto rect = m_datastore->getRectForText(start, value);
-    status->setRect(rect);
+  auto color = parseColor(value);
+  if (color.form != ColorLiteral::NoColor) {
+    return (color.isValid() ? GradientLiteral::GoodColor
+                            : GradientLiteral::BadColor);
   }
-  if (status->isGoodValue())
-    return GradientCheck::Good;
-  else if (status->state() == FuzzyColorValue)
-    return GradientCheck::Fuzzy;
-  return GradientCheck::Bad;
-}
 
-bool
-WidgetModel::checkGradientNumber(const QString& value) const
-{
-  bool ok;
-  value.toDouble(&ok);
-  if (!ok) {
-    return false;
-  }
-  return true;
+  auto status = checkColor(value, start);
+  auto check = GradientLiteral::BadColor;
+  if (status && status->isGoodValue())
+    check = GradientLiteral::GoodColor;
+  else if (status && status->state() == FuzzyColorValue)
+    check = GradientLiteral::FuzzyColor;
+  return check;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkIcon(const QString& value, int start) const
 {
   auto status = checkUrl(value, start);
@@ -1660,119 +1390,71 @@ WidgetModel::checkIcon(const QString& value, int start) const
 
   if (m_icon.contains(value)) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkLength(const QString& value, int start) const
 {
-  bool ok;
   auto pos = start - value.length();
-  PropertyStatus* status = nullptr;
-  auto lvalue = value.toLower();
-
-  if (lvalue.endsWith("px") || lvalue.endsWith("pt") || lvalue.endsWith("em") ||
-      lvalue.endsWith("ex")) {
-    status = new PropertyStatus(PropertyValueState::BadLengthUnit,
-                                value,
-                                m_datastore->getCursorForPosition(pos));
-    auto numValue = value.left(value.length() - 2);
-    numValue.toDouble(&ok);
-    if (ok) {
+  PropertyStatusList status;
+  auto number = parseNumber(value);
+
+  if (value.endsWith("px", Qt::CaseInsensitive) ||
+      value.endsWith("pt", Qt::CaseInsensitive) ||
+      value.endsWith("em", Qt::CaseInsensitive) ||
+      value.endsWith("ex", Qt::CaseInsensitive)) {
+    status = PropertyStatusList(PropertyValueState::BadLengthUnit,
+                                m_datastore->textPosition(pos),
+                                value.length());
+    if (number.isValid() && number.unit != NoLengthUnit) {
       status->setState(PropertyValueState::GoodValue);
     }
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
-  } else {
+  } else if (number.isValid() && number.unit == NoLengthUnit) {
     // in Qt measurement units must be set.
-    value.toDouble(&ok);
-    if (ok) {
-      status = new PropertyStatus(PropertyValueState::BadLengthUnit,
-                                  value,
-                                  m_datastore->getCursorForPosition(pos));
-      auto numValue = value.left(value.length() - 2);
-      if (start != -1) {
-        auto rect = m_datastore->getRectForText(pos, value);
-        status->setRect(rect);
-      }
-    }
+    status = PropertyStatusList(PropertyValueState::BadLengthUnit,
+                                m_datastore->textPosition(pos),
+                                value.length());
   }
 
   return status;
 }
 
-QPair<PropertyStatus*, qreal>
+QPair<PropertyStatusList, qreal>
 WidgetModel::checkNumber(const QString& value, int start) const
 {
-  bool ok;
-  // don't actually need the value, I only want to know
-  // if it actually is a number.
-  auto v = value.toDouble(&ok);
-  if (ok) {
+  auto number = parseNumber(value);
+  if (number.isValid() && number.unit == NoLengthUnit) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
-    return qMakePair<PropertyStatus*, qreal>(status, v);
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
+    return qMakePair(status, qreal(number.value));
   }
 
-  return qMakePair<PropertyStatus*, qreal>(nullptr, -1);
+  return qMakePair(PropertyStatusList(), qreal(-1));
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkOutline(const QString& value, int start) const
 {
-  auto status = checkOutlineColor(value, start);
-  if (status)
-    return status;
-
-  status = checkOutlineWidth(value, start);
-  if (status)
-    return status;
-
-  status = checkOutlineStyle(value, start);
-  if (status)
-    return status;
-
-  status = checkOutlineWidth(value, start);
-  if (status)
-    return status;
-
-  status = checkOutlineRadius(value, start);
-  if (status)
-    return status;
-
-  return checkOutlineOffset(value, start);
+  return matchValueGrammar(Outline, value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkOrigin(const QString& value, int start) const
 {
   if (m_origin.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::BadValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::BadValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     status->setState(PropertyValueState::GoodValue);
     return status;
   }
@@ -1780,117 +1462,62 @@ WidgetModel::checkOrigin(const QString& value, int start) const
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkOutlineStyle(const QString& value, int start) const
 {
   if (m_outlineStyle.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-PropertyStatus*
-WidgetModel::checkOutlineColor(const QString& value, int start) const
-{
-  if (value.toLower() == m_outlineColor) {
-    int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
-    status->setState(PropertyValueState::GoodValue);
-    return status;
-  }
-
-  return checkColor(value, start);
-}
-
-PropertyStatus*
-WidgetModel::checkOutlineWidth(const QString& value, int start) const
-{
-  if (m_outlineWidth.contains(value.toLower())) {
-    int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
-    return status;
-  }
-
-  return checkLength(value, start);
-}
-
-PropertyStatus*
-WidgetModel::checkOutlineOffset(const QString& value, int start) const
-{
-  return checkLength(value, start);
-}
-
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkOutlineRadius(const QString& value, int start) const
 {
   return checkRadius(value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkPaletteRole(const QString& value, int start) const
 {
   if (m_paletteRoles.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkRadius(const QString& value, int start) const
 {
   // This is 1 or 2 lengths.
   return checkLength(value, start);
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkRepeat(const QString& value, int start) const
 {
   if (m_repeat.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
 
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkUrl(const QString& value, int start) const
 {
   auto startPartOffset = value.indexOf('(');
@@ -1899,13 +1526,9 @@ WidgetModel::checkUrl(const QString& value, int start) const
 
   if (lName == "url") {
     auto name = value.mid(0, startPartOffset).trimmed();
-    auto status = new PropertyStatus(PropertyValueState::GoodName,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodName,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
 
     auto closePartOffset = value.indexOf(')');
     QString urlStr;
@@ -1926,11 +1549,9 @@ WidgetModel::checkUrl(const QString& value, int start) const
     if (urlStr.isEmpty()) {
       status->setState(PropertyValueState::BadUrlValue);
     } else {
-      auto rect = m_datastore->getRectForText(offset, urlStr);
       status->addSectionValue(PropertyValueState::GoodValue,
-                              urlStr,
-                              m_datastore->getCursorForPosition(pos + offset),
-                              rect);
+                              m_datastore->textPosition(pos + offset),
+                              urlStr.length());
     }
 
     return status;
@@ -1939,81 +1560,343 @@ WidgetModel::checkUrl(const QString& value, int start) const
   return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkPosition(const QString& value, int start) const
 {
   if (m_position.contains(value.toLower())) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
-    }
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
     return status;
   }
-  return nullptr;
+  return nullptr;
+}
+
+PropertyStatusList
+WidgetModel::checkTextDecoration(const QString& value, int start) const
+{
+  if (m_textDecoration.contains(value.toLower())) {
+    int pos = start - value.length();
+    auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                     m_datastore->textPosition(pos),
+                                     value.length());
+    return status;
+  }
+  return nullptr;
+}
+
+void
+DataStore::initialiseWidgetModel()
+{
+  m_widgetModel = new WidgetModel(this);
+}
+
+//! Reads value as a whole unsigned number, as QString::toUInt() would.
+static bool
+parseUInt(const QString& value, uint& result)
+{
+  auto number = parseNumber(value);
+  if (!number.isValid() || number.unit != NoLengthUnit || !number.isInteger ||
+      number.value < 0 || number.value > std::numeric_limits<uint>::max()) {
+    return false;
+  }
+  result = uint(number.value);
+  return true;
+}
+
+PropertyStatusList
+WidgetModel::checkUIntNumber(const QString& value, int start, quint16 max = -1)
+{
+  int pos = start - value.length();
+  auto status = PropertyStatusList(PropertyValueState::GoodValue,
+                                   m_datastore->textPosition(pos),
+                                   value.length());
+  // check if number is in valid range.
+  uint v = 0;
+  if (parseUInt(value, v)) {
+    if (max >= 0) {
+      if (v > max) {
+        if (max == 31)
+          status->setState(PropertyValueState::BadNumericalValue_31);
+        else if (max == 255)
+          status->setState(PropertyValueState::BadNumericalValue_255);
+      }
+    }
+  } /* else {
+     status->setState(PropertyValueState::BadNumericalValue);
+   }*/
+  return status;
+}
+
+/*
+   The value grammar of the attributes whose values can take several forms.
+   Each rule lists its alternatives in the order they are tried, an alternative
+   is either a terminal or the name of another rule. A new value form is
+   added by adding it to the rule, the rules are compiled once when the model
+   is created.
+*/
+struct ValueRule
+{
+  AttributeType attribute;
+  const char* name;
+  const char* alternatives;
+};
+
+static const ValueRule valueGrammar[] = {
+  { Color, "color", "color-name | color-hash | color-rgb | color-hs" },
+  { BoxColors, "box-colors", "color" },
+  { Brush, "brush", "color | gradient | palette-role" },
+  { Background, "background", "brush | url | repeat | alignment" },
+  { Border, "border", "border-style | length | brush" },
+  { FontSize, "font-size", "font-size-name | font-length" },
+  { Font, "font", "font-size | font-style | font-weight | string" },
+  { NoAttributeValue, "outline-color", "invert | color" },
+  { NoAttributeValue, "outline-width", "outline-width-name | length" },
+  { Outline,
+    "outline",
+    "outline-color | outline-width | outline-style | length" },
+};
+
+void
+WidgetModel::initValueGrammar()
+{
+  addValueKeywords(m_colors, ColorNameTerm);
+  addValueKeywords(m_paletteRoles, PaletteRoleTerm);
+  addValueKeywords(m_repeat, RepeatTerm);
+  addValueKeywords(m_alignmentValues, AlignmentTerm);
+  addValueKeywords(m_borderStyle, BorderStyleTerm);
+  addValueKeywords(m_fontSizes, FontSizeNameTerm);
+  addValueKeywords(m_fontStyle, FontStyleTerm);
+  addValueKeywords(m_fontWeight, FontWeightTerm);
+  addValueKeywords(QStringList() << m_outlineColor, InvertTerm);
+  addValueKeywords(m_outlineWidth, OutlineWidthNameTerm);
+  addValueKeywords(m_outlineStyle, OutlineStyleTerm);
+
+  QHash<QString, QString> rules;
+  for (auto& rule : valueGrammar) {
+    rules.insert(rule.name, rule.alternatives);
+  }
+
+  for (auto& rule : valueGrammar) {
+    if (rule.attribute != NoAttributeValue) {
+      compileValueRule(rule.name, rules, m_valueGrammar[rule.attribute]);
+    }
+  }
+}
+
+void
+WidgetModel::addValueKeywords(const QStringList& keywords, ValueTerm term)
+{
+  for (auto& keyword : keywords) {
+    m_valueKeywords[keyword] |= (1u << term);
+  }
+}
+
+void
+WidgetModel::compileValueRule(const QString& name,
+                              const QHash<QString, QString>& rules,
+                              QVector<ValueTerm>& terms) const
+{
+  static const QHash<QString, ValueTerm> terminals = {
+    { "color-name", ColorNameTerm },
+    { "color-hash", ColorHashTerm },
+    { "color-rgb", ColorRGBTerm },
+    { "color-hs", ColorHSTerm },
+    { "gradient", GradientTerm },
+    { "palette-role", PaletteRoleTerm },
+    { "url", UrlTerm },
+    { "repeat", RepeatTerm },
+    { "alignment", AlignmentTerm },
+    { "border-style", BorderStyleTerm },
+    { "length", LengthTerm },
+    { "font-size-name", FontSizeNameTerm },
+    { "font-length", FontLengthTerm },
+    { "font-style", FontStyleTerm },
+    { "font-weight", FontWeightTerm },
+    { "string", StringTerm },
+    { "invert", InvertTerm },
+    { "outline-width-name", OutlineWidthNameTerm },
+    { "outline-style", OutlineStyleTerm },
+  };
+
+  for (auto& alternative : rules.value(name).split('|')) {
+    auto altName = alternative.trimmed();
+    if (terminals.contains(altName)) {
+      auto term = terminals.value(altName);
+      // A terminal that has already been tried can never match later on.
+      if (!terms.contains(term)) {
+        terms.append(term);
+      }
+    } else if (rules.contains(altName)) {
+      compileValueRule(altName, rules, terms);
+    } else {
+      qWarning() << "Unknown value grammar alternative" << altName << "in"
+                 << name;
+    }
+  }
+}
+
+WidgetModel::ValueToken
+WidgetModel::classifyValue(const QString& value) const
+{
+  ValueToken token;
+  token.lower = value.toLower();
+  token.keywords = m_valueKeywords.value(token.lower);
+
+  // colour names are all letters so nothing else can fuzzy match one.
+  token.letters = true;
+  for (auto c : token.lower) {
+    if (c < 'a' || c > 'z') {
+      token.letters = false;
+      break;
+    }
+  }
+
+  // anything that lexNumber() might accept.
+  int i = 0;
+  while (i < token.lower.length() && token.lower.at(i).isSpace()) {
+    i++;
+  }
+  if (i < token.lower.length() &&
+      (token.lower.at(i) == '+' || token.lower.at(i) == '-')) {
+    i++;
+  }
+  if (i < token.lower.length()) {
+    auto c = token.lower.at(i);
+    token.numeric = c.isDigit() || c == '.';
+  }
+
+  token.unit = token.lower.endsWith("px") || token.lower.endsWith("pt") ||
+               token.lower.endsWith("em") || token.lower.endsWith("ex");
+
+  return token;
+}
+
+bool
+WidgetModel::mayBeGradient(const QString& lower) const
+{
+  // checkGradient() fuzzy matches the name before the bracket.
+  int length = lower.left(lower.indexOf('(')).trimmed().toStdString().size();
+  for (auto& g : m_gradient) {
+    if (lower.contains(g)) {
+      return true;
+    }
+    // A fuzz ratio above 90 needs the lengths to differ by less than
+    // a tenth of their total length.
+    if (qAbs(length - g.length()) * 10 < length + g.length()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+WidgetModel::mayMatchTerm(ValueTerm term, const ValueToken& token) const
+{
+  switch (term) {
+    case ColorNameTerm:
+      return (token.keywords & (1u << term)) || token.letters;
+    case ColorHashTerm:
+      return token.lower.startsWith('#');
+    case ColorRGBTerm:
+      return token.lower.startsWith("rgb");
+    case ColorHSTerm:
+      return token.lower.startsWith("hs");
+    case GradientTerm:
+      return mayBeGradient(token.lower);
+    case UrlTerm:
+      return token.lower.trimmed().startsWith("url");
+    case LengthTerm:
+    case FontLengthTerm:
+      return token.numeric || token.unit;
+    case FontWeightTerm:
+      return (token.keywords & (1u << term)) || token.numeric;
+    case StringTerm:
+      return token.lower.startsWith('"') && token.lower.endsWith('"');
+    default:
+      return (token.keywords & (1u << term));
+  }
 }
 
-PropertyStatus*
-WidgetModel::checkTextDecoration(const QString& value, int start) const
+PropertyStatusList
+WidgetModel::checkTerm(ValueTerm term,
+                       const ValueToken& token,
+                       const QString& value,
+                       int start) const
 {
-  if (m_textDecoration.contains(value.toLower())) {
+  if (token.keywords & (1u << term)) {
     int pos = start - value.length();
-    auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                     value,
-                                     m_datastore->getCursorForPosition(pos));
-    if (start != -1) {
-      auto rect = m_datastore->getRectForText(pos, value);
-      status->setRect(rect);
+    return PropertyStatusList(PropertyValueState::GoodValue,
+                              m_datastore->textPosition(pos),
+                              value.length());
+  }
+
+  switch (term) {
+    case ColorNameTerm:
+      return checkColorName(start, value);
+    case ColorHashTerm:
+      return checkColorHashValue(start, value);
+    case ColorRGBTerm:
+      return checkColorRGB(start, value);
+    case ColorHSTerm:
+      return checkColorHS(start, value);
+    case GradientTerm:
+      return checkGradient(value, start);
+    case UrlTerm:
+      return checkUrl(value, start);
+    case LengthTerm:
+      return checkLength(value, start);
+    case FontLengthTerm: {
+      auto status = checkLength(value, start);
+      if (status) {
+        if (!(value.endsWith("px") || value.endsWith("pt"))) {
+          // in Qt only pt and pixels are allowed for fonts.
+          status->setState(PropertyValueState::BadFontUnit);
+        }
+      }
+      return status;
     }
-    return status;
+    case FontWeightTerm:
+      return checkFontWeight(value, start);
+    case StringTerm:
+      return checkString(value, start);
+    default:
+      return nullptr;
   }
-  return nullptr;
 }
 
-void
-DataStore::initialiseWidgetModel()
-{
-  m_widgetModel = new WidgetModel(this);
-}
+/*!
+   \brief Validates the value against the compiled grammar for the attribute.
 
-PropertyStatus*
-WidgetModel::checkUIntNumber(const QString& value, int start, quint16 max = -1)
-{
-  int pos = start - value.length();
-  auto status = new PropertyStatus(PropertyValueState::GoodValue,
-                                   value,
-                                   m_datastore->getCursorForPosition(pos));
-  if (start != -1) {
-    auto rect = m_datastore->getRectForText(pos, value);
-    status->setRect(rect);
-  }
-  // check if number is in valid range.
-  bool ok = false;
-  auto v = value.toUInt(&ok);
-  if (ok) {
-    if (max >= 0) {
-      if (v > max) {
-        if (max == 31)
-          status->setState(PropertyValueState::BadNumericalValue_31);
-        else if (max == 255)
-          status->setState(PropertyValueState::BadNumericalValue_255);
-      }
+   The value is classified once and only the alternatives that could accept
+   a value of that shape are tried, in the grammar order. The first
+   alternative that recognises the value decides its status.
+*/
+PropertyStatusList
+WidgetModel::matchValueGrammar(AttributeType attribute,
+                               const QString& value,
+                               int start) const
+{
+  auto token = classifyValue(value);
+  for (auto term : m_valueGrammar.value(attribute)) {
+    if (!mayMatchTerm(term, token)) {
+      continue;
     }
-  } /* else {
-     status->setState(PropertyValueState::BadNumericalValue);
-   }*/
-  return status;
+    auto status = checkTerm(term, token, value, start);
+    if (status) {
+      return status;
+    }
+  }
+  return nullptr;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::checkPropertyValue(const QString& propertyname,
                                 int& start,
                                 const QString& value)
 {
-  PropertyStatus* status = nullptr;
+  PropertyStatusList status;
   AttributeType propertyAttribute = m_attributes.value(propertyname);
   switch (propertyAttribute) {
     case Alignment:
@@ -2095,17 +1978,12 @@ WidgetModel::checkPropertyValue(const QString& propertyname,
     case Number: // TODO not supported.
       if (propertyname == "button-layout") {
         int pos = start - value.length();
-        status = new PropertyStatus(PropertyValueState::GoodValue,
-                                    value,
-                                    m_datastore->getCursorForPosition(pos));
-        if (start != -1) {
-          auto rect = m_datastore->getRectForText(pos, value);
-          status->setRect(rect);
-        }
+        status = PropertyStatusList(PropertyValueState::GoodValue,
+                                    m_datastore->textPosition(pos),
+                                    value.length());
         // check if number is in valid range.
-        bool ok = false;
-        auto v = value.toUInt(&ok);
-        if (ok) {
+        uint v = 0;
+        if (parseUInt(value, v)) {
           // only valid values for button-layout
           if (!(v == 0 || v == 1 || v == 2 || v == 3 || v == 5)) {
             status->setState(PropertyValueState::BadButtonLayoutValue);
@@ -2120,18 +1998,15 @@ WidgetModel::checkPropertyValue(const QString& propertyname,
       } else if (propertyname == "opacity") {
         status = checkUIntNumber(value, start, 255);
       } else if (propertyname == "lineedit-password-character") {
-        auto [s, v] = checkNumber(value, start);
-        status = s;
-        bool ok = false;
-        QChar c(value.toUInt(&ok));
-        if (ok) {
-          if (c.isNull()) {
-            s->setState(PropertyValueState::BadNumericalValue);
+        status = checkNumber(value, start).first;
+        uint code = 0;
+        if (parseUInt(value, code)) {
+          if (QChar(code).isNull()) {
+            status->setState(PropertyValueState::BadNumericalValue);
           }
         }
       } else {
-        auto [s, v] = checkNumber(value, start);
-        status = s;
+        status = checkNumber(value, start).first;
       }
       break;
 
@@ -2187,23 +2062,36 @@ WidgetModel::checkPropertyValue(const QString& propertyname,
       break;
   }
 
-  if (status && status->name().isEmpty()) {
-    status->setName(value);
+  if (status && status->length() == 0) {
+    status->setLength(value.length());
   }
 
   return status;
 }
 
-PropertyStatus*
+PropertyStatusList
 DataStore::isValidPropertyValueForProperty(const QString& propertyname,
                                            int& start,
                                            const QString& valuename/*,
                                            const QString& text*/)
 {
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->isValidPropertyValueForProperty(
     propertyname, start, valuename);
 }
 
+int
+DataStore::validationCacheHits() const
+{
+  return m_widgetModel->validationCacheHits();
+}
+
+int
+DataStore::validationCacheMisses() const
+{
+  return m_widgetModel->validationCacheMisses();
+}
+
 QStringList
 DataStore::possibleWidgetsForSubControl(const QString& name)
 {
@@ -2213,13 +2101,14 @@ DataStore::possibleWidgetsForSubControl(const QString& name)
 QStringList
 DataStore::possibleSubControlsForWidget(const QString& widget)
 {
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->possibleSubControlsForWidget(widget);
 }
 
 void
 DataStore::addSubControl(const QString& control, const QString& widget)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   QStringList widgets;
   widgets << widget;
   m_widgetModel->addSubControl(control, widgets);
@@ -2228,59 +2117,58 @@ DataStore::addSubControl(const QString& control, const QString& widget)
 void
 DataStore::addSubControl(const QString& control, QStringList& widgets)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   m_widgetModel->addSubControl(control, widgets);
 }
 
 void
 DataStore::removeSubControl(const QString& control)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   m_widgetModel->removeSubControl(control.trimmed());
 }
 
 void
 DataStore::addPseudoState(const QString& state)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   m_widgetModel->addPseudoState(state, true);
 }
 
 void
 DataStore::removePseudoState(const QString& state)
 {
-  QMutexLocker locker(&m_mutex);
+  QWriteLocker locker(&m_modelLock);
   m_widgetModel->removePseudoState(state);
 }
 
 int
 DataStore::braceCount()
 {
-  QMutexLocker locker(&m_mutex);
-  return m_braceCount;
+  return m_braceCount.loadAcquire();
 }
 
 void
 DataStore::setBraceCount(int value)
 {
-  QMutexLocker locker(&m_mutex);
-  m_braceCount = value;
+  m_braceCount.storeRelease(value);
 }
 
 void
 DataStore::incrementBraceCount()
 {
-  QMutexLocker locker(&m_mutex);
-  m_braceCount++;
+  m_braceCount.ref();
 }
 
 bool
 DataStore::decrementBraceCount()
 {
-  QMutexLocker locker(&m_mutex);
-  if (m_braceCount > 0) {
-    m_braceCount--;
-    return true;
+  int count = m_braceCount.loadAcquire();
+  while (count > 0) {
+    if (m_braceCount.testAndSetOrdered(count, count - 1)) {
+      return true;
+    }
+    count = m_braceCount.loadAcquire();
   }
   return false;
 }
@@ -2309,18 +2197,52 @@ DataStore::decrementBraceCount()
 //  }
 //}
 
-QMap<QTextCursor, Node*>
+QMap<TextPosition, Node*>
 DataStore::nodes()
 {
-  QMutexLocker locker(&m_mutex);
-  return m_nodes;
+  return nodeSnapshot()->nodes;
+}
+
+//! Readers only load the published snapshot, it is built when the nodes
+//! change so reading never takes the mutex.
+NodeSnapshotPtr
+DataStore::nodeSnapshot() const
+{
+  return std::atomic_load(&m_snapshot);
+}
+
+int
+DataStore::nodeGeneration() const
+{
+  return m_generation.loadAcquire();
+}
+
+//! Builds the immutable snapshot of the nodes and swaps it in. The keys are
+//! taken from the node index, which already holds them as plain offsets in
+//! document order, so they can be read on any thread. Readers that hold the
+//! previous snapshot keep it until they let go of it. Must be called with
+//! m_mutex held, after the node index is brought up to date.
+void
+DataStore::publishNodes()
+{
+  auto snapshot = std::make_shared<NodeSnapshot>();
+  for (auto& extent : m_nodeIndex) {
+    snapshot->nodes.insert(
+      snapshot->nodes.cend(), TextPosition(extent.start, nullptr), extent.node);
+  }
+  snapshot->generation = m_generation.fetchAndAddOrdered(1) + 1;
+  snapshot->arena = m_arena;
+  std::atomic_store(&m_snapshot, NodeSnapshotPtr(std::move(snapshot)));
 }
 
 void
-DataStore::insertNode(QTextCursor cursor, Node* node)
+DataStore::insertNode(TextPosition cursor, Node* node)
 {
   QMutexLocker locker(&m_mutex);
   m_nodes.insert(cursor, node);
+  addBraces(node);
+  rebuildNodeIndex();
+  publishNodes();
   //  switch (node->type()) {
   //    case StartBraceType:
   //      pushStartBrace(qobject_cast<StartBraceNode*>(node));
@@ -2342,162 +2264,457 @@ DataStore::clearNodes()
 {
   QMutexLocker locker(&m_mutex);
   m_nodes.clear();
+  m_arena.reset();
+  m_braces.clear();
+  rebuildNodeIndex();
+  publishNodes();
 }
 
 void
-DataStore::setNodes(QMap<QTextCursor, Node*> nodes)
+DataStore::setNodes(QMap<TextPosition, Node*> nodes,
+                    std::shared_ptr<NodeArena> arena)
 {
   QMutexLocker locker(&m_mutex);
   m_nodes = nodes;
+  m_arena = arena;
+  m_braces.clear();
+  for (auto node : nodes) {
+    addBraces(node);
+  }
+  rebuildNodeIndex();
+  publishNodes();
 }
 
-int
-DataStore::maxSuggestionCount()
+//! Replaces the nodes that start within [start, end) by nodes. The node
+//! index finds the old nodes so only the replaced part of the map and the
+//! index are touched.
+QList<Node*>
+DataStore::replaceNodes(int start,
+                        int end,
+                        QMap<TextPosition, Node*> nodes,
+                        std::shared_ptr<NodeArena> arena)
 {
   QMutexLocker locker(&m_mutex);
-  return m_maxSuggestionCount;
+  QList<Node*> removed;
+  m_arena = arena;
+
+  auto byStart = [](const NodeExtent& extent, int position) {
+    return extent.start < position;
+  };
+  auto first = int(
+    std::lower_bound(m_nodeIndex.cbegin(), m_nodeIndex.cend(), start, byStart) -
+    m_nodeIndex.cbegin());
+  auto last = int(
+    std::lower_bound(m_nodeIndex.cbegin(), m_nodeIndex.cend(), end, byStart) -
+    m_nodeIndex.cbegin());
+
+  for (int i = first; i < last; i++) {
+    auto& extent = m_nodeIndex.at(i);
+    // the keys follow the same edits as the index so they are found by it.
+    auto it = m_nodes.find(TextPosition(extent.start, nullptr));
+    if (it == m_nodes.end() || it.value() != extent.node) {
+      it = std::find(m_nodes.begin(), m_nodes.end(), extent.node);
+    }
+    if (it != m_nodes.end()) {
+      m_nodes.erase(it);
+    }
+    removeBraces(extent.node);
+    removed.append(extent.node);
+  }
+
+  for (auto [cursor, node] : asKeyValueRange(nodes)) {
+    m_nodes.insert(cursor, node);
+    addBraces(node);
+  }
+  spliceNodeIndex(first, last - first, nodes.values());
+  publishNodes();
+
+  return removed;
 }
 
+//! The braces are held as plain offsets in position order, see
+//! shiftBraces().
 void
-DataStore::setMaxSuggestionCount(int maxSuggestionCount)
+DataStore::addBraces(Node* node)
 {
-  QMutexLocker locker(&m_mutex);
-  m_maxSuggestionCount = maxSuggestionCount;
+  auto widgets = node_cast<WidgetNodes>(node);
+  if (!widgets) {
+    return;
+  }
+
+  int start = (widgets->hasStartBrace() ? widgets->startBracePosition() : -1);
+  int end = (widgets->hasEndBrace() ? widgets->endBracePosition() : -1);
+  auto insert = [this](const BraceEntry& entry) {
+    auto it = std::upper_bound(m_braces.begin(), m_braces.end(), entry);
+    m_braces.insert(it, entry);
+  };
+
+  if (start >= 0) {
+    insert({ start, end, node, true });
+  }
+  if (end >= 0) {
+    insert({ end, start, node, false });
+  }
 }
 
-bool
-DataStore::hasSuggestion()
+void
+DataStore::removeBraces(Node* node)
 {
-  QMutexLocker locker(&m_mutex);
-  return m_hasSuggestion;
+  auto widgets = node_cast<WidgetNodes>(node);
+  if (!widgets) {
+    return;
+  }
+
+  // a removed brace can share its position with another brace if the text
+  // between them was deleted so only the entries of this rule are removed.
+  auto remove = [this, node](int position) {
+    BraceEntry key;
+    key.position = position;
+    auto range = std::equal_range(m_braces.begin(), m_braces.end(), key);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->rule == node) {
+        m_braces.erase(it);
+        return;
+      }
+    }
+  };
+
+  if (widgets->hasStartBrace()) {
+    remove(widgets->startBracePosition());
+  }
+  if (widgets->hasEndBrace()) {
+    remove(widgets->endBracePosition());
+  }
 }
 
+//! Moves the braces after an edit in the same way that a TextPosition
+//! follows it, so the table agrees with the node positions. The mapping
+//! keeps the order so the table stays sorted.
 void
-DataStore::setHasSuggestion(bool suggestion)
+DataStore::shiftBraces(int position, int charsRemoved, int charsAdded)
 {
-  QMutexLocker locker(&m_mutex);
-  m_hasSuggestion = suggestion;
+  for (auto& entry : m_braces) {
+    if (entry.position >= position) {
+      entry.position =
+        OffsetMap::shift(entry.position, position, charsRemoved, charsAdded);
+    }
+    if (entry.partner >= position) {
+      entry.partner =
+        OffsetMap::shift(entry.partner, position, charsRemoved, charsAdded);
+    }
+  }
 }
 
 bool
-DataStore::isManualMove()
+DataStore::braceAt(int position, int& partner)
 {
   QMutexLocker locker(&m_mutex);
-  return m_manualMove;
+  BraceEntry key;
+  key.position = position;
+  auto it = std::lower_bound(m_braces.cbegin(), m_braces.cend(), key);
+  if (it == m_braces.cend() || it->position != position) {
+    partner = -1;
+    return false;
+  }
+  partner = it->partner;
+  return true;
 }
 
-void
-DataStore::setManualMove(bool manualMove)
+QList<QPair<int, int>>
+DataStore::bracePairs()
+{
+  QMutexLocker locker(&m_mutex);
+  QList<QPair<int, int>> pairs;
+  for (auto& entry : m_braces) {
+    if (entry.start && entry.partner >= 0) {
+      pairs.append(qMakePair(entry.position, entry.partner));
+    }
+  }
+  return pairs;
+}
+
+QList<int>
+DataStore::unmatchedStartBraces()
 {
   QMutexLocker locker(&m_mutex);
-  m_manualMove = manualMove;
+  return unmatchedBraces(true);
 }
 
-Node*
-DataStore::currentNode()
+QList<int>
+DataStore::unmatchedEndBraces()
 {
   QMutexLocker locker(&m_mutex);
-  return m_currentNode;
+  return unmatchedBraces(false);
+}
+
+QList<int>
+DataStore::unmatchedBraces(bool start)
+{
+  QList<int> braces;
+  for (auto& entry : m_braces) {
+    if (entry.start == start && entry.partner < 0) {
+      braces.append(entry.position);
+    }
+  }
+  return braces;
 }
 
 void
-DataStore::setCurrentWidget(WidgetNode* widget)
+DataStore::nodesInRange(int start, int end, QVector<Node*>& nodes)
 {
   QMutexLocker locker(&m_mutex);
-  m_currentNode = widget;
+
+  // nodes before first all end before start.
+  nodes.clear();
+  auto first = std::lower_bound(
+    m_nodeIndex.cbegin(),
+    m_nodeIndex.cend(),
+    start,
+    [](const NodeExtent& extent, int position) {
+      return extent.reach < position;
+    });
+  for (auto it = first; it != m_nodeIndex.cend(); ++it) {
+    if (it->start >= end) {
+      break;
+    }
+    if (it->limit >= start) {
+      nodes.append(it->node);
+    }
+  }
 }
 
-bool
-DataStore::isCurrentWidget(WidgetNode* node)
+void
+DataStore::extendToNodes(int& start, int& end)
 {
   QMutexLocker locker(&m_mutex);
-  return (m_currentNode == node);
+
+  // nodes before first all end before start - 1.
+  auto first = std::lower_bound(
+    m_nodeIndex.cbegin(),
+    m_nodeIndex.cend(),
+    start - 1,
+    [](const NodeExtent& extent, int position) {
+      return extent.endReach < position;
+    });
+  int from = start;
+  int to = end;
+  for (auto it = first; it != m_nodeIndex.cend(); ++it) {
+    if (it->start > end) {
+      break;
+    }
+    if (it->end + 1 >= start) {
+      from = qMin(from, it->start);
+      to = qMax(to, it->end + 1);
+    }
+  }
+  start = from;
+  end = to;
 }
 
-QTextCursor
-DataStore::currentCursor()
+Node*
+DataStore::lastNode()
 {
   QMutexLocker locker(&m_mutex);
-  return m_currentCursor;
+  for (auto it = m_nodeIndex.crbegin(); it != m_nodeIndex.crend(); ++it) {
+    if (it->node->type() != NewlineType) {
+      return it->node;
+    }
+  }
+  return nullptr;
 }
 
+//! Rebuilds the node index from the node map, only needed when all of the
+//! nodes are replaced. Must be called with m_mutex held.
 void
-DataStore::setCurrentCursor(const QTextCursor& currentCursor)
+DataStore::rebuildNodeIndex()
+{
+  m_nodeIndex.clear();
+  m_nodeIndex.reserve(m_nodes.size());
+  spliceNodeIndex(0, 0, m_nodes.values());
+  m_lastNodeAt = 0;
+}
+
+//! Replaces count extents from first by those of nodes, which are in
+//! document order, and brings the reach of the following extents up to
+//! date.
+void
+DataStore::spliceNodeIndex(int first, int count, const QList<Node*>& nodes)
+{
+  m_nodeIndex.remove(first, count);
+  m_nodeIndex.insert(first, nodes.size(), NodeExtent());
+  for (int i = 0; i < nodes.size(); i++) {
+    auto node = nodes.at(i);
+    auto position = node->position();
+    m_nodeIndex[first + i] = {
+      node, position, position + node->length(), node->end(), 0, 0
+    };
+  }
+  updateNodeReach(first, first + nodes.size());
+  m_lastNodeAt = qMin(m_lastNodeAt, qMax(m_nodeIndex.size() - 1, 0));
+}
+
+//! Recalculates the reach from the extent at from. The extents from fixed
+//! onwards hold a reach that was correct before the change so once one of
+//! them is unchanged all of the rest are too.
+void
+DataStore::updateNodeReach(int from, int fixed)
+{
+  int reach = (from > 0 ? m_nodeIndex.at(from - 1).reach : -1);
+  int endReach = (from > 0 ? m_nodeIndex.at(from - 1).endReach : -1);
+
+  for (int i = from; i < m_nodeIndex.size(); i++) {
+    auto& extent = m_nodeIndex[i];
+    reach = qMax(reach, extent.limit);
+    endReach = qMax(endReach, extent.end);
+    if (i >= fixed && extent.reach == reach && extent.endReach == endReach) {
+      break;
+    }
+    extent.reach = reach;
+    extent.endReach = endReach;
+  }
+}
+
+//! Moves the extents after an edit in the same way that a TextPosition
+//! follows it. A deletion moves offsets left, but OffsetMap::shift() never
+//! swaps two offsets, a < b gives shift(a) <= shift(b). So the index stays
+//! sorted, and as the largest limit before an extent is still the largest
+//! once shifted, the shifted reach is still exactly the furthest limit.
+//! Extents whose reach lies before the edit are not moved by it.
+void
+DataStore::shiftNodeIndex(int position, int charsRemoved, int charsAdded)
+{
+  auto first = std::lower_bound(
+    m_nodeIndex.begin(),
+    m_nodeIndex.end(),
+    position,
+    [](const NodeExtent& extent, int position) {
+      return qMax(extent.reach, extent.endReach) < position;
+    });
+  auto shift = [=](int offset) {
+    return OffsetMap::shift(offset, position, charsRemoved, charsAdded);
+  };
+
+  for (auto it = first; it != m_nodeIndex.end(); ++it) {
+    it->start = shift(it->start);
+    it->limit = shift(it->limit);
+    it->end = shift(it->end);
+    it->reach = shift(it->reach);
+    it->endReach = shift(it->endReach);
+  }
+}
+
+Node*
+DataStore::nodeAt(int position, Node** previous)
 {
   QMutexLocker locker(&m_mutex);
-  m_currentCursor = currentCursor;
+
+  // The wanted node is the first one that reaches position, every node
+  // before it ends before position. Try the last hit and the node after it
+  // before searching.
+  auto isFirstToReach = [this, position](int i) {
+    return (i < m_nodeIndex.size() &&
+            m_nodeIndex.at(i).endReach >= position &&
+            (i == 0 || m_nodeIndex.at(i - 1).endReach < position));
+  };
+
+  int index = m_lastNodeAt;
+  if (!isFirstToReach(index) && !isFirstToReach(++index)) {
+    index = int(std::lower_bound(m_nodeIndex.cbegin(),
+                                 m_nodeIndex.cend(),
+                                 position,
+                                 [](const NodeExtent& extent, int position) {
+                                   return extent.endReach < position;
+                                 }) -
+                m_nodeIndex.cbegin());
+  }
+
+  if (previous) {
+    *previous = (index > 0 ? m_nodeIndex.at(index - 1).node : nullptr);
+  }
+  if (index >= m_nodeIndex.size()) {
+    return nullptr;
+  }
+
+  m_lastNodeAt = index;
+  auto& extent = m_nodeIndex.at(index);
+  return (extent.start <= position ? extent.node : nullptr);
 }
 
-QIcon
-DataStore::invalidIcon() const
+int
+DataStore::maxSuggestionCount()
 {
-  return m_invalidIcon;
+  return m_maxSuggestionCount.loadAcquire();
 }
 
-QIcon
-DataStore::validIcon() const
+void
+DataStore::setMaxSuggestionCount(int maxSuggestionCount)
 {
-  return m_validIcon;
+  m_maxSuggestionCount.storeRelease(maxSuggestionCount);
 }
 
-QIcon
-DataStore::addDColonIcon() const
+bool
+DataStore::hasSuggestion()
 {
-  return m_addDColonIcon;
+  return m_hasSuggestion.loadAcquire();
 }
 
-QIcon
-DataStore::addSemiColonIcon() const
+void
+DataStore::setHasSuggestion(bool suggestion)
 {
-  return m_addSemiColonIcon;
+  m_hasSuggestion.storeRelease(suggestion);
 }
 
-QIcon
-DataStore::addColonIcon() const
+bool
+DataStore::isManualMove()
 {
-  return m_addColonIcon;
+  return m_manualMove.loadAcquire();
 }
 
-QIcon
-DataStore::badIcon() const
+void
+DataStore::setManualMove(bool manualMove)
 {
-  return m_badIcon;
+  m_manualMove.storeRelease(manualMove);
 }
 
-QIcon
-DataStore::badSemiColonIcon() const
+Node*
+DataStore::currentNode()
 {
-  return m_badSColonIcon;
+  QMutexLocker locker(&m_mutex);
+  return m_currentNode;
 }
 
-QIcon
-DataStore::badColonIcon() const
+void
+DataStore::setCurrentWidget(WidgetNode* widget)
 {
-  return m_badColonIcon;
+  QMutexLocker locker(&m_mutex);
+  m_currentNode = widget;
 }
 
-QIcon
-DataStore::badDColonIcon() const
+bool
+DataStore::isCurrentWidget(WidgetNode* node)
 {
-  return m_badDColonIcon;
+  QMutexLocker locker(&m_mutex);
+  return (m_currentNode == node);
 }
 
-QIcon
-DataStore::noIcon() const
+QTextCursor
+DataStore::currentCursor()
 {
-  return m_noIcon;
+  QMutexLocker locker(&m_mutex);
+  return m_currentCursor;
 }
 
-QIcon
-DataStore::fuzzyIcon() const
+void
+DataStore::setCurrentCursor(const QTextCursor& currentCursor)
 {
-  return m_fuzzyIcon;
+  QMutexLocker locker(&m_mutex);
+  m_currentCursor = currentCursor;
 }
 
 AttributeType
 DataStore::propertyValueAttribute(const QString& value)
 {
-  QMutexLocker locker(&m_mutex);
+  QReadLocker locker(&m_modelLock);
   return m_widgetModel->propertyValueAttribute(value);
 }
 
@@ -3065,6 +3282,7 @@ WidgetModel::initWidgetTree()
 {
   m_root = new WidgetItem("QWidget", nullptr);
   m_widgets.insert("QWidget", m_root);
+  addKeyword("QWidget", WidgetKeyword);
 
   addWidget("QWidget", "QAbstractButton");
   addWidget("QAbstractButton", "QPushButton");
@@ -3517,6 +3735,10 @@ WidgetModel::WidgetModel(DataStore* datastore)
   initRepeat();
   initTextDecoration();
   initAttributeMap();
+  initValueGrammar();
+
+  // bounds the number of distinct property values that are remembered.
+  m_validationCache.setMaxCost(2000);
 
 //  for (auto control : m_subControls.keys()) {
 //    if (m_properties.contains(control)) {
@@ -3559,6 +3781,7 @@ WidgetModel::addWidget(const QString& parentName,
       item->setExtraWidget(extraWidget);
       parent->addChild(item);
       m_widgets.insert(name, item);
+      addKeyword(name, WidgetKeyword);
     }
   }
 }
@@ -3570,6 +3793,7 @@ WidgetModel::removeWidget(const QString& name)
   if (parent->isExtraWidget()) {
     m_widgets.remove(name);
     parent->removeChild(name);
+    removeKeyword(name, WidgetKeyword);
   }
 }
 
@@ -3606,6 +3830,7 @@ WidgetModel::addSubControl(const QString& control, QStringList widgets)
       items.append(item);
     }
     m_subControls.insert(control, items);
+    addKeyword(control, SubControlKeyword);
   }
 }
 
@@ -3622,6 +3847,7 @@ WidgetModel::removeSubControl(const QString& control)
     }
     if (items.isEmpty()) {
       m_subControls.remove(control);
+      removeKeyword(control, SubControlKeyword);
     } else {
       m_subControls.insert(control, items);
     }
@@ -3669,24 +3895,122 @@ WidgetModel::isValidSubControlForWidget(const QString& widget,
   return false;
 }
 
-PropertyStatus*
+PropertyStatusList
 WidgetModel::isValidPropertyValueForProperty(const QString& propertyname,
                                              int& start,
                                              const QString& valuename/*,
                                              const QString& text*/)
 {
   if (valuename.isEmpty()) {
-    auto status = new PropertyStatus(PropertyValueState::BadValueName);
+    auto status = PropertyStatusList(PropertyValueState::BadValueName);
     return status;
   }
 
-  return checkPropertyValue(propertyname, start, valuename);
+  // the same declarations are repeated throughout a stylesheet so the checks
+  // are cached by property and value, only the position differs.
+  int base = start - valuename.length();
+  if (base < 0) {
+    return checkPropertyValue(propertyname, start, valuename);
+  }
+
+  QMutexLocker locker(&m_validationMutex);
+  auto it = m_propertyIds.find(propertyname);
+  if (it == m_propertyIds.end()) {
+    it = m_propertyIds.insert(propertyname, m_propertyIds.size());
+  }
+  ValidationKey key{ it.value(), valuename };
+  auto cached = m_validationCache.object(key);
+  if (cached) {
+    m_validationHits++;
+    return restoreValidation(*cached, base);
+  }
+  m_validationMisses++;
+  locker.unlock();
+
+  auto status = checkPropertyValue(propertyname, start, valuename);
+
+  locker.relock();
+  m_validationCache.insert(key, cacheValidation(status, base));
+  return status;
+}
+
+int
+WidgetModel::validationCacheHits() const
+{
+  QMutexLocker locker(&m_validationMutex);
+  return m_validationHits;
+}
+
+int
+WidgetModel::validationCacheMisses() const
+{
+  QMutexLocker locker(&m_validationMutex);
+  return m_validationMisses;
+}
+
+WidgetModel::CachedValidation*
+WidgetModel::cacheValidation(const PropertyStatusList& statuses,
+                             int base) const
+{
+  auto cached = new CachedValidation();
+  for (int index = 0; index < statuses.size(); index++) {
+    auto status = &statuses.at(index);
+    CachedStatus entry;
+    entry.state = status->state();
+    entry.length = status->length();
+    entry.offset = status->offset() - base;
+    entry.minCount = status->minCount();
+    entry.maxCount = status->maxCount();
+    for (int i = 0; i < status->sectionCount(); i++) {
+      entry.sections.append({ status->sectionLength(i),
+                              status->sectionOffset(i) - base,
+                              status->sectionState(i) });
+    }
+    cached->append(entry);
+  }
+  return cached;
+}
+
+PropertyStatusList
+WidgetModel::restoreValidation(const CachedValidation& cached, int base) const
+{
+  PropertyStatusList statuses;
+  for (auto& entry : cached) {
+    PropertyStatus status(entry.state,
+                          m_datastore->textPosition(base + entry.offset),
+                          entry.length);
+    status.setMinCount(entry.minCount);
+    status.setMaxCount(entry.maxCount);
+    for (auto& section : entry.sections) {
+      status.addSectionValue(section.state,
+                             m_datastore->textPosition(base + section.offset),
+                             section.length);
+    }
+    statuses.append(status);
+  }
+  return statuses;
+}
+
+//! Forgets the cached checks of the property's values.
+void
+WidgetModel::invalidateValidation(const QString& property)
+{
+  QMutexLocker locker(&m_validationMutex);
+  auto it = m_propertyIds.constFind(property);
+  if (it == m_propertyIds.constEnd()) {
+    return;
+  }
+  for (auto& key : m_validationCache.keys()) {
+    if (key.property == it.value()) {
+      m_validationCache.remove(key);
+    }
+  }
 }
 
 bool
 WidgetModel::containsSubControl(const QString& name)
 {
-  return m_subControls.contains(name.trimmed().toLower());
+  return keywordTypes(name.trimmed()).testFlag(SubControlKeyword);
 }
 
 QStringList
@@ -3718,6 +4042,7 @@ WidgetModel::addPseudoState(const QString& state,
 {
   m_pseudoStates << state;
   m_pseudoStatesExtra << extraState;
+  addKeyword(state, PseudoStateKeyword);
 }
 
 void
@@ -3727,13 +4052,16 @@ WidgetModel::removePseudoState(const QString& state)
   if (m_pseudoStates.contains(state) && m_pseudoStatesExtra.at(i)) {
     m_pseudoStates.removeAt(i);
     m_pseudoStatesExtra.removeAt(i);
+    if (!m_pseudoStates.contains(state)) {
+      removeKeyword(state, PseudoStateKeyword);
+    }
   }
 }
 
 bool
 WidgetModel::containsPseudoState(const QString& name)
 {
-  return m_pseudoStates.contains(name);
+  return keywordTypes(name).testFlag(PseudoStateKeyword);
 }
 
 void
@@ -3741,12 +4069,47 @@ WidgetModel::addProperty(const QString& property, bool extraProperty)
 {
   m_properties << property;
   m_propertiesExtra << extraProperty;
+  addKeyword(property, PropertyKeyword);
 }
 
 bool
 WidgetModel::containsProperty(const QString& name)
 {
-  return m_properties.contains(name);
+  return keywordTypes(name).testFlag(PropertyKeyword);
+}
+
+KeywordTypes
+WidgetModel::keywordTypes(const QString& name) const
+{
+  auto types = m_keywords.value(name);
+
+  // Only widget names are cased, so a cased token needs a second lookup for
+  // everything else.
+  if (!name.isLower()) {
+    types |= (m_keywords.value(name.toLower()) & ~KeywordTypes(WidgetKeyword));
+  }
+
+  return types;
+}
+
+void
+WidgetModel::addKeyword(const QString& name, KeywordType type)
+{
+  auto key = (type == WidgetKeyword ? name : name.toLower());
+  m_keywords[key] |= type;
+}
+
+void
+WidgetModel::removeKeyword(const QString& name, KeywordType type)
+{
+  auto key = (type == WidgetKeyword ? name : name.toLower());
+  auto it = m_keywords.find(key);
+  if (it != m_keywords.end()) {
+    *it &= ~KeywordTypes(type);
+    if (!*it) {
+      m_keywords.erase(it);
+    }
+  }
 }
 
 QStringList
@@ -3911,65 +4274,53 @@ WidgetModel::fuzzySearchColorNames(const QString& name)
 AttributeType
 WidgetModel::propertyValueAttribute(const QString& value)
 {
-  PropertyStatus* status;
+  PropertyStatusList status;
   status = checkColor(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Color;
   }
   status = checkLength(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Length;
   }
   status = checkBorder(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Border;
   }
   status = checkFont(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Font;
   }
   status = checkFontWeight(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::FontWeight;
   }
   status = checkRadius(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Radius;
   }
   status = checkBrush(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Brush;
   }
   status = checkFontStyle(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::FontStyle;
   }
   status = checkFontSize(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::FontSize;
   }
   status = checkAlignment(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Alignment;
   }
   status = checkAttachment(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Attachment;
   }
   status = checkBackground(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Background;
   }
   //  status = checkBool(value);
@@ -3979,95 +4330,76 @@ WidgetModel::propertyValueAttribute(const QString& value)
   //  }
   status = checkBoolean(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Boolean;
   }
   status = checkBorderImage(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::BorderImage;
   }
   status = checkBorderStyle(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::BorderStyle;
   }
   auto pos = -1; // this is nopt used but is needed by checkBoxColors anf
                  // checkBoxLengths.
   status = checkBoxColors(value, pos);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::BoxColors;
   }
   status = checkBoxLengths(value, pos);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::BoxLengths;
   }
   status = checkGradient(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Gradient;
   }
   status = checkIcon(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Icon;
   }
   auto [s, v] = checkNumber(value);
   status = s;
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Number;
   }
   status = checkOutline(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Outline;
   }
   status = checkOrigin(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Origin;
   }
   status = checkOutlineStyle(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::OutlineStyle;
   }
   status = checkOutlineRadius(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::OutlineRadius;
   }
   status = checkPaletteRole(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::PaletteRole;
   }
   status = checkRepeat(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Repeat;
   }
   status = checkUrl(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Url;
   }
   status = checkPosition(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::Position;
   }
   status = checkTextDecoration(value);
   if (status && status->isGoodValue()) {
-    delete status;
     return AttributeType::TextDecoration;
   }
 
-  delete status;
-
   return AttributeType::NoAttributeValue;
 }
 
@@ -4092,6 +4424,7 @@ WidgetModel::addCustomWidget(const QString& name, const QString& parent)
     auto item = new WidgetItem(name, parentItem);
     item->setExtraWidget(true);
     parentItem->addChild(item);
+    addKeyword(name, WidgetKeyword);
     return true;
   }
   return false;
@@ -4105,6 +4438,9 @@ WidgetModel::addCustomWidgetPseudoStates(const QString& widgetName,
     //    auto item = widgetItem(widgetName);
     states = eraseDuplicates(states);
     m_customPseudoStates.insert(widgetName, states);
+    for (auto& state : states) {
+      addKeyword(state, PseudoStateKeyword);
+    }
     return true;
   }
   return false;
@@ -4117,6 +4453,9 @@ WidgetModel::addCustomWidgetSubControls(const QString& widget,
   if (m_customNames.contains(widget)) {
     controls = eraseDuplicates(controls);
     m_customSubControls.insert(widget, controls);
+    for (auto& control : controls) {
+      addKeyword(control, SubControlKeyword);
+    }
     return true;
   }
   return false;
@@ -4129,6 +4468,9 @@ WidgetModel::addCustomWidgetProperties(const QString& widget,
   if (m_customNames.contains(widget)) {
     properties = eraseDuplicates(properties);
     m_customProperties.insert(widget, properties);
+    for (auto& property : properties) {
+      addKeyword(property, PropertyKeyword);
+    }
     return true;
   }
   return false;
@@ -4150,6 +4492,7 @@ WidgetModel::addCustomWidgetPropertyValue(const QString& widget,
     list = eraseDuplicates(list);
     map.insert(property, list);
     m_customValues.insert(widget, map);
+    invalidateValidation(property);
     return true;
   }
   return false;
@@ -4173,6 +4516,7 @@ WidgetModel::addCustomWidgetPropertyValues(const QString& widget,
     list = eraseDuplicates(values);
     map.insert(property, list);
     m_customValues.insert(widget, map);
+    invalidateValidation(property);
     return true;
   }
   return false;
@@ -23,217 +23,78 @@
 #define DATASTORE_H
 
 #include <QAbstractItemModel>
+#include <QCache>
 #include <QFile>
-#include <QIcon>
+#include <QHash>
 #include <QList>
 #include <QMap>
-#include <QMessageBox>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QObject>
+#include <QReadWriteLock>
 #include <QStack>
 #include <QTextCursor>
+#include <QThread>
 #include <QtDebug>
-#include <QtWidgets>
+#include <QtGui>
+
+#include <memory>
 
 #include "common.h"
 
 #define FTS_FUZZY_MATCH_IMPLEMENTATION
 #include "fts_fuzzy_match.h"
 
-class StylesheetEditor;
+class NodeArena;
+class StylesheetView;
 class StylesheetData;
 class Node;
 class WidgetNode;
 class DataStore;
 
-class GradientCheck
+//! A gradient function read in a single pass by WidgetModel::parseGradient().
+struct GradientLiteral
 {
-  bool linear = false;
-  bool radial = false;
-  bool conical = false;
-
-  virtual bool isRepeated() = 0;
-
-public:
-  enum Check
+  enum Kind
   {
-    GoodName,
-    Stop,
-    BadName,
-    Repeat,
+    NoGradient,
+    LinearGradient,
+    RadialGradient,
+    ConicalGradient,
   };
-  enum FuzzyCheck
+  enum ColorCheck
   {
-    Good,
-    Fuzzy,
-    Bad,
+    GoodColor,
+    FuzzyColor,
+    BadColor,
   };
-
-public:
-  GradientCheck() {}
-  virtual ~GradientCheck() {}
-
-  virtual Check set(const QString& name) = 0;
-};
-
-class LinearCheck : public GradientCheck
-{
-  bool x1 = false, x2 = false, y1 = false, y2 = false;
-  bool x1_r = false, x2_r = false, y1_r = false, y2_r = false;
-
-  bool isRepeated() override { return (x1_r || x2_r || y1_r || y2_r); }
-
-public:
-  LinearCheck()
-    : GradientCheck()
-  {}
-  ~LinearCheck() {}
-
-  Check set(const QString& name) override
-  {
-    if (name == "x1") {
-      if (x1) {
-        x1_r = true;
-      } else {
-        x1 = true;
-      }
-    } else if (name == "y1") {
-      if (x2) {
-        x2_r = true;
-      } else {
-        x2 = true;
-      }
-    } else if (name == "x2") {
-      if (y1) {
-        y1_r = true;
-      } else {
-        y1 = true;
-      }
-    } else if (name == "y2") {
-      if (y2) {
-        y2_r = true;
-      } else {
-        y2 = true;
-      }
-    } else if (name == "stop") {
-      return Stop;
-    } else {
-      return BadName;
-    }
-    if (isRepeated()) {
-      return Repeat;
-    } else {
-      return GoodName;
-    }
-  }
-};
-
-class RadialCheck : public GradientCheck
-{
-  bool cx = false, cy = false, cx_r = false, cy_r = false, fx = false,
-       fx_r = false, fy = false, fy_r = false, radius = false, radius_r = false;
-
-  bool isRepeated() override
+  //! An argument, or part of one, that failed its check. The offset is from
+  //! the start of the value.
+  struct Error
   {
-    return (cx_r || cy_r || fx_r || fy_r || radius_r);
-  }
-
-public:
-  RadialCheck()
-    : GradientCheck()
-  {}
-  ~RadialCheck() {}
-
-  Check set(const QString& name) override
+    int offset = 0;
+    int length = 0;
+    PropertyValueState state = BadValue;
+    int maxCount = -1;
+  };
+  struct Stop
   {
-    if (name == "cx") {
-      if (cx) {
-        cx_r = true;
-      } else {
-        cx = true;
-      }
-    } else if (name == "cy") {
-      if (cy) {
-        cy_r = true;
-      } else {
-        cy = true;
-      }
-    } else if (name == "fx") {
-      if (fx) {
-        fx_r = true;
-      } else {
-        fx = true;
-      }
-    } else if (name == "fy") {
-      if (fy) {
-        fy_r = true;
-      } else {
-        fy = true;
-      }
-    } else if (name == "radius") {
-      if (radius) {
-        radius_r = true;
-      } else {
-        radius = true;
-      }
-    } else if (name == "stop") {
-      return Stop;
-    } else {
-      return BadName;
-    }
-    if (isRepeated()) {
-      return Repeat;
-    } else {
-      return GoodName;
-    }
-  }
-};
-
-class ConicalCheck : public GradientCheck
-{
-  bool cx = false, cy = false, cx_r = false, cy_r = false, angle = false,
-       angle_r = false;
-
-  bool isRepeated() override { return (cx_r || cy_r || angle_r); }
-
-public:
-  ConicalCheck()
-    : GradientCheck()
-  {}
-  ~ConicalCheck() {}
+    qreal position = 0.0;
+    QRgb rgb = 0;
+  };
 
-  Check set(const QString& name) override
-  {
-    if (name == "cx") {
-      if (cx) {
-        cx_r = true;
-      } else {
-        cx = true;
-      }
-    } else if (name == "cy") {
-      if (cy) {
-        cy_r = true;
-      } else {
-        cy = true;
-      }
-    } else if (name == "angle") {
-      if (angle) {
-        angle_r = true;
-      } else {
-        angle = true;
-      }
-    } else if (name == "stop") {
-      return Stop;
-    } else {
-      return BadName;
-    }
-    if (isRepeated()) {
-      return Repeat;
-    } else {
-      return GoodName;
-    }
-  }
+  Kind kind = NoGradient;
+  int nameOffset = 0;
+  int nameLength = 0;
+  //! The offset of the opening bracket, -1 if there is none.
+  int argumentsOffset = -1;
+  //! x1, y1, x2, y2 for linear, cx, cy, fx, fy, radius for radial and
+  //! cx, cy, angle for conical gradients.
+  qreal coordinates[5] = {};
+  //! A bit for each coordinate that has been given.
+  quint8 coordinatesSet = 0;
+  QVarLengthArray<Stop, 8> stops;
+  QVarLengthArray<Error, 4> errors;
 };
 
 class Property
@@ -298,9 +159,13 @@ public:
 
   bool isValidSubControlForWidget(const QString& widgetName,
                                   const QString& subcontrol);
-  PropertyStatus* isValidPropertyValueForProperty(const QString& propertyname,
-                                                  int& start,
-                                                  const QString& valuename);
+  PropertyStatusList isValidPropertyValueForProperty(
+    const QString& propertyname,
+    int& start,
+    const QString& valuename);
+  //! The number of value checks answered from, and missing, the cache.
+  int validationCacheHits() const;
+  int validationCacheMisses() const;
 
   QStringList possibleWidgetsForSubControl(const QString& name);
   QStringList possibleSubControlsForWidget(const QString& widget);
@@ -312,6 +177,9 @@ public:
   void addProperty(const QString& property, bool extraProperty = true);
   bool containsProperty(const QString& name);
 
+  //! Returns every vocabulary that name belongs to with a single lookup.
+  KeywordTypes keywordTypes(const QString& name) const;
+
   QStringList borderValues();
 
   QPair<int, int> attributeCounts(const QString& name);
@@ -342,14 +210,17 @@ public:
 
   QList<Theme*> customThemes() const;
 
-  PropertyStatus* checkColorName(int start, const QString& value) const;
-  PropertyStatus* checkColorHashValue(int start, const QString& value) const;
-  PropertyStatus* checkColorRGB(int start, const QString& value) const;
-  PropertyStatus* checkColorHS(int start, const QString& value) const;
+  PropertyStatusList checkColorName(int start, const QString& value) const;
+  PropertyStatusList checkColorHashValue(int start, const QString& value) const;
+  PropertyStatusList checkColorRGB(int start, const QString& value) const;
+  PropertyStatusList checkColorHS(int start, const QString& value) const;
 
   QString findNext(const QString& text,
                    int& pos,
                    bool showLineMarkers = false) const;
+  Token nextToken(const QString& text,
+                  int& pos,
+                  bool showLineMarkers = false) const;
   void skipBlanks(const QString& text,
                   int& pos,
                   bool showLineMarkers = false) const;
@@ -390,7 +261,11 @@ private:
   QMap<QString, QStringList> m_customProperties;
   QMap<QString, QMap<QString, QStringList>> m_customValues;
   QMap<QString, QMap<QString, AttributeTypes>> m_customAttributes;
+  // Widget names are stored as is, everything else in lower case.
+  QHash<QString, KeywordTypes> m_keywords;
   QStringList recurseWidgetsForNames(WidgetItem* item);
+  void addKeyword(const QString& name, KeywordType type);
+  void removeKeyword(const QString& name, KeywordType type);
   QStringList addControls(int count, ...);
 
   void initPseudoStates();
@@ -417,81 +292,222 @@ private:
   void initTextDecoration();
   void initAttributeMap();
 
-  PropertyStatus* checkPropertyValue(const QString& propertyname,
-                                     int& start,
-                                     const QString& valuename);
-  PropertyStatus* checkAlignment(const QString& value, int start = -1) const;
-  PropertyStatus* checkAttachment(const QString& value, int start = -1) const;
-  PropertyStatus* checkBackground(const QString& value, int start = -1) const;
-  //  PropertyStatus* checkBool(const QString& value, int start = -1) const;
-  PropertyStatus* checkBoolean(const QString& value, int start = -1) const;
-  PropertyStatus* checkBorder(const QString& value, int start = -1) const;
-  PropertyStatus* checkBorderImage(const QString& value, int start = -1) const;
-  PropertyStatus* checkBorderStyle(const QString& value, int start = -1) const;
-  PropertyStatus* checkBoxColors(const QString& value, int& pos) const;
-  PropertyStatus* checkBoxLengths(const QString& value, int& start) const;
-  PropertyStatus* checkBrush(const QString& value, int start = -1) const;
-  PropertyStatus* checkColor(const QString& value, int start = -1) const;
-  PropertyStatus* checkFontStyle(const QString& value, int start = -1) const;
-  PropertyStatus* checkFont(const QString& value, int start = -1) const;
-  PropertyStatus* checkFontSize(const QString& value, int start = -1) const;
-  PropertyStatus* checkFontWeight(const QString& value, int start = -1) const;
-  PropertyStatus* checkString(const QString& value, int start = -1) const;
-  PropertyStatus* checkGradient(const QString& value, int start = -1) const;
-  GradientCheck::FuzzyCheck checkGradientColor(const QString& value,
-                                               int start = -1) const;
-  bool checkGradientNumber(const QString& value) const;
-  PropertyStatus* checkIcon(const QString& value, int start = -1) const;
-  PropertyStatus* checkLength(const QString& value, int start = -1) const;
-  QPair<PropertyStatus*, qreal> checkNumber(const QString& value,
-                                            int start = -1) const;
-  PropertyStatus* checkUIntNumber(const QString& value, int start, quint16 max);
-  PropertyStatus* checkOutline(const QString& value, int start = -1) const;
-  PropertyStatus* checkOrigin(const QString& value, int start = -1) const;
-  PropertyStatus* checkOutlineStyle(const QString& value, int start = -1) const;
-  PropertyStatus* checkOutlineColor(const QString& value, int start = -1) const;
-  PropertyStatus* checkOutlineWidth(const QString& value, int start = -1) const;
-  PropertyStatus* checkOutlineOffset(const QString& value,
+  // A property, by interned id, and the text of one of its values.
+  struct ValidationKey
+  {
+    int property;
+    QString value;
+
+    bool operator==(const ValidationKey& other) const
+    {
+      return (property == other.property && value == other.value);
+    }
+    friend uint qHash(const ValidationKey& key, uint seed = 0)
+    {
+      return qHash(key.value, seed) ^ uint(key.property);
+    }
+  };
+  // A value status with its offsets taken from the start of the value.
+  struct CachedSection
+  {
+    int length;
+    int offset;
+    PropertyValueState state;
+  };
+  struct CachedStatus
+  {
+    PropertyValueState state;
+    int length;
+    int offset;
+    int minCount;
+    int maxCount;
+    QVector<CachedSection> sections;
+  };
+  // The linked statuses of one value, empty if the check returned none.
+  using CachedValidation = QVector<CachedStatus>;
+
+  QHash<QString, int> m_propertyIds;
+  QCache<ValidationKey, CachedValidation> m_validationCache;
+  mutable QMutex m_validationMutex;
+  int m_validationHits = 0;
+  int m_validationMisses = 0;
+
+  CachedValidation* cacheValidation(const PropertyStatusList& statuses,
+                                    int base) const;
+  PropertyStatusList restoreValidation(const CachedValidation& cached,
+                                       int base) const;
+  void invalidateValidation(const QString& property);
+
+  PropertyStatusList checkPropertyValue(const QString& propertyname,
+                                        int& start,
+                                        const QString& valuename);
+  PropertyStatusList checkAlignment(const QString& value, int start = -1) const;
+  PropertyStatusList checkAttachment(const QString& value,
                                      int start = -1) const;
-  PropertyStatus* checkOutlineRadius(const QString& value,
+  PropertyStatusList checkBackground(const QString& value,
                                      int start = -1) const;
-  PropertyStatus* checkPaletteRole(const QString& value, int start = -1) const;
-  PropertyStatus* checkRadius(const QString& value, int start = -1) const;
-  PropertyStatus* checkRepeat(const QString& value, int start = -1) const;
-  PropertyStatus* checkUrl(const QString& value, int start = -1) const;
-  PropertyStatus* checkPosition(const QString& value, int start = -1) const;
-  PropertyStatus* checkTextDecoration(const QString& value,
+  //  PropertyStatus* checkBool(const QString& value, int start = -1) const;
+  PropertyStatusList checkBoolean(const QString& value, int start = -1) const;
+  PropertyStatusList checkBorder(const QString& value, int start = -1) const;
+  PropertyStatusList checkBorderImage(const QString& value,
+                                      int start = -1) const;
+  PropertyStatusList checkBorderStyle(const QString& value,
+                                      int start = -1) const;
+  PropertyStatusList checkBoxColors(const QString& value, int& pos) const;
+  PropertyStatusList checkBoxLengths(const QString& value, int& start) const;
+  PropertyStatusList checkBrush(const QString& value, int start = -1) const;
+  PropertyStatusList checkColor(const QString& value, int start = -1) const;
+  PropertyStatusList checkFontStyle(const QString& value, int start = -1) const;
+  PropertyStatusList checkFont(const QString& value, int start = -1) const;
+  PropertyStatusList checkFontSize(const QString& value, int start = -1) const;
+  PropertyStatusList checkFontWeight(const QString& value,
+                                     int start = -1) const;
+  PropertyStatusList checkString(const QString& value, int start = -1) const;
+  PropertyStatusList checkGradient(const QString& value, int start = -1) const;
+  PropertyStatusList colorFunctionStatus(const ColorLiteral& color,
+                                         int start,
+                                         const QString& value) const;
+  GradientLiteral parseGradient(
+    const QString& value,
+    GradientLiteral::Kind kind = GradientLiteral::NoGradient) const;
+  void parseGradientArgument(const QString& value,
+                             int first,
+                             int last,
+                             GradientLiteral& gradient) const;
+  GradientLiteral::ColorCheck checkGradientColor(const QString& value,
+                                                 int start = -1) const;
+  PropertyStatusList checkIcon(const QString& value, int start = -1) const;
+  PropertyStatusList checkLength(const QString& value, int start = -1) const;
+  QPair<PropertyStatusList, qreal> checkNumber(const QString& value,
+                                            int start = -1) const;
+  PropertyStatusList checkUIntNumber(const QString& value,
+                                     int start,
+                                     quint16 max);
+  PropertyStatusList checkOutline(const QString& value, int start = -1) const;
+  PropertyStatusList checkOrigin(const QString& value, int start = -1) const;
+  PropertyStatusList checkOutlineStyle(const QString& value,
+                                       int start = -1) const;
+  PropertyStatusList checkOutlineRadius(const QString& value,
+                                        int start = -1) const;
+  PropertyStatusList checkPaletteRole(const QString& value,
                                       int start = -1) const;
+  PropertyStatusList checkRadius(const QString& value, int start = -1) const;
+  PropertyStatusList checkRepeat(const QString& value, int start = -1) const;
+  PropertyStatusList checkUrl(const QString& value, int start = -1) const;
+  PropertyStatusList checkPosition(const QString& value, int start = -1) const;
+  PropertyStatusList checkTextDecoration(const QString& value,
+                                         int start = -1) const;
 
   QStringList eraseDuplicates(QStringList list);
-  QPair<PropertyStatus*, int> calculateNumericalStatus(
-    const QString& section,
-    const QString& cleanValue,
-    const QString& number,
-    int start,
-    int offset,
-    QStringList parts) const;
-  QPair<PropertyStatus*, int> calculateStopStatus(const QString& section,
-                                                  const QString& cleanValue,
-                                                  const QString& number,
-                                                  const QString& color,
-                                                  int start,
-                                                  int offset,
-                                                  QStringList parts) const;
-  GradientCheck* getCorrectCheck(const QString& name) const;
+
+  //! The terminals of the value grammar, see initValueGrammar().
+  enum ValueTerm
+  {
+    ColorNameTerm,
+    ColorHashTerm,
+    ColorRGBTerm,
+    ColorHSTerm,
+    GradientTerm,
+    PaletteRoleTerm,
+    UrlTerm,
+    RepeatTerm,
+    AlignmentTerm,
+    BorderStyleTerm,
+    LengthTerm,
+    FontSizeNameTerm,
+    FontLengthTerm,
+    FontStyleTerm,
+    FontWeightTerm,
+    StringTerm,
+    InvertTerm,
+    OutlineWidthNameTerm,
+    OutlineStyleTerm,
+  };
+  //! The shape of a value, worked out once before the alternatives are tried.
+  struct ValueToken
+  {
+    QString lower;
+    //! Bit mask of the keyword terminals that contain the value.
+    quint32 keywords = 0;
+    //! Only letters, so could be a fuzzy colour name.
+    bool letters = false;
+    bool numeric = false;
+    bool unit = false;
+  };
+  // Compiled alternatives for each multi-alternative attribute.
+  QMap<AttributeType, QVector<ValueTerm>> m_valueGrammar;
+  // lower case keyword -> mask of the keyword terminals it belongs to.
+  QHash<QString, quint32> m_valueKeywords;
+
+  void initValueGrammar();
+  void addValueKeywords(const QStringList& keywords, ValueTerm term);
+  void compileValueRule(const QString& name,
+                        const QHash<QString, QString>& rules,
+                        QVector<ValueTerm>& terms) const;
+  ValueToken classifyValue(const QString& value) const;
+  bool mayBeGradient(const QString& lower) const;
+  bool mayMatchTerm(ValueTerm term, const ValueToken& token) const;
+  PropertyStatusList checkTerm(ValueTerm term,
+                               const ValueToken& token,
+                               const QString& value,
+                               int start) const;
+  PropertyStatusList matchValueGrammar(AttributeType attribute,
+                                       const QString& value,
+                                       int start) const;
+};
+
+//! A published generation of the parsed nodes. A snapshot is never changed
+//! once it is published, each change to the nodes publishes a new one with
+//! the next generation number.
+//!
+//! A snapshot shares the ownership of the arena that holds its nodes so
+//! they stay valid for as long as it is held. Its keys are resolved when it
+//! is built so they can be read on any thread, the nodes themselves follow
+//! the edits made on the GUI thread and are only read there.
+struct NodeSnapshot
+{
+  QMap<TextPosition, Node*> nodes;
+  int generation = 0;
+  std::shared_ptr<NodeArena> arena;
+};
+using NodeSnapshotPtr = std::shared_ptr<const NodeSnapshot>;
+
+//! A brace of a rule in the brace table. The partner is -1 if the brace is
+//! unmatched.
+struct BraceEntry
+{
+  int position = -1;
+  int partner = -1;
+  Node* rule = nullptr;
+  bool start = true;
+
+  bool operator<(const BraceEntry& other) const
+  {
+    return position < other.position;
+  }
 };
 
 class DataStore : public QObject
 {
   Q_OBJECT
 public:
-  explicit DataStore(QWidget* parent = nullptr);
+  explicit DataStore(QObject* parent = nullptr);
   ~DataStore();
 
-  void setEditor(StylesheetEditor* editor);
+  void setEditor(StylesheetView* editor);
+
+  //! Returns a position that follows later edits to the document. Positions
+  //! created by a background parse are not attached to the edit map until
+  //! they are installed.
+  TextPosition textPosition(int position);
+  const OffsetMap* offsetMap() const;
+  //! Records a document edit, see QTextDocument::contentsChange().
+  void addEdit(int position, int charsRemoved, int charsAdded);
+  void clearEdits();
 
   QTextCursor getCursorForPosition(int position);
-  QRect getRectForText(int start, const QString& text);
+  //! Returns the screen rectangle of the length characters from start.
+  QRect getRectForText(int start, int length);
 
   QPair<int, int> attributeCounts(const QString& name);
 
@@ -504,6 +520,7 @@ public:
   //  bool containsStylesheetProperty(const QString& name);
   bool containsPseudoState(const QString& name);
   bool containsSubControl(const QString& name);
+  KeywordTypes keywordTypes(const QString& name);
   bool isValidSubControlForWidget(const QString& widget,
                                   const QString& subcontrol);
   bool checkSubControlForWidget(const QString& widgetName, const QString& name);
@@ -511,9 +528,12 @@ public:
   //  bool ifValidStylesheetValue(const QString& propertyname,
   //                              const QString& valuename,
   //                              StylesheetData* data);
-  PropertyStatus* isValidPropertyValueForProperty(const QString& propertyname,
-                                                  int& start,
-                                                  const QString& valuename);
+  PropertyStatusList isValidPropertyValueForProperty(
+    const QString& propertyname,
+    int& start,
+    const QString& valuename);
+  int validationCacheHits() const;
+  int validationCacheMisses() const;
   AttributeType propertyValueAttribute(const QString& value);
 
   //! Returns the names of all
@@ -528,11 +548,50 @@ public:
   void addPseudoState(const QString& state);
   void removePseudoState(const QString& state);
 
-  QMap<QTextCursor, Node*> nodes();
-  void insertNode(QTextCursor cursor, Node* node);
+  //! Returns the nodes of the current snapshot.
+  QMap<TextPosition, Node*> nodes();
+  //! Returns the current snapshot of the nodes. Snapshots are swapped
+  //! atomically so this can be called from any thread without locking.
+  //! The snapshot is built once whenever the nodes change.
+  NodeSnapshotPtr nodeSnapshot() const;
+  //! Returns the generation of the current nodes, a holder of an older
+  //! snapshot can compare this to find out that it is stale.
+  int nodeGeneration() const;
+  void insertNode(TextPosition cursor, Node* node);
   bool isNodesEmpty();
   void clearNodes();
-  void setNodes(QMap<QTextCursor, Node*> nodes);
+  //! Replaces all of the nodes by nodes, which are held by arena.
+  void setNodes(QMap<TextPosition, Node*> nodes,
+                std::shared_ptr<NodeArena> arena);
+  //! Replaces all nodes starting within start to end with the supplied nodes
+  //! and returns the nodes that were removed. The nodes that are left must
+  //! all be held by arena.
+  QList<Node*> replaceNodes(int start,
+                            int end,
+                            QMap<TextPosition, Node*> nodes,
+                            std::shared_ptr<NodeArena> arena);
+  //! Fills nodes with the nodes that overlap the text from start to end in
+  //! document order. The caller owns the buffer so that it can be reused.
+  void nodesInRange(int start, int end, QVector<Node*>& nodes);
+  //! Widens start and end to take in every node that starts at or before end
+  //! and whose end() is at or after start - 1. end is left one past the end
+  //! of the last of them.
+  void extendToNodes(int& start, int& end);
+  //! Returns the last node that is not a newline, or nullptr.
+  Node* lastNode();
+  //! Returns the first node whose extent, position() to end() inclusive,
+  //! holds position or nullptr. If previous is set it receives the node
+  //! before the returned node.
+  Node* nodeAt(int position, Node** previous = nullptr);
+
+  //! Returns true if there is a brace at position and sets partner to the
+  //! position of the brace that it is paired with, or -1 if unmatched.
+  bool braceAt(int position, int& partner);
+  //! Returns the start and end positions of every matched pair of braces
+  //! in document order.
+  QList<QPair<int, int>> bracePairs();
+  QList<int> unmatchedStartBraces();
+  QList<int> unmatchedEndBraces();
 
   int braceCount();
   void setBraceCount(int value);
@@ -555,18 +614,6 @@ public:
   QTextCursor currentCursor();
   void setCurrentCursor(const QTextCursor& currentCursor);
 
-  QIcon invalidIcon() const;
-  QIcon validIcon() const;
-  QIcon addDColonIcon() const;
-  QIcon addSemiColonIcon() const;
-  QIcon addColonIcon() const;
-  QIcon badIcon() const;
-  QIcon badSemiColonIcon() const;
-  QIcon badColonIcon() const;
-  QIcon badDColonIcon() const;
-  QIcon noIcon() const;
-  QIcon fuzzyIcon() const;
-
   QMultiMap<int, QString> fuzzySearchWidgets(const QString& name);
   QMultiMap<int, QString> fuzzySearchProperty(const QString& name);
   QMultiMap<int, QString> fuzzySearchPropertyValue(const QString& name,
@@ -606,7 +653,9 @@ public:
   QString qtThemeName() const;
 
   bool loadXmlTheme(const QString&);
-  bool saveXmlScheme(const QString& name);
+  //! Saves the scheme as name.xml in the configuration directory. An
+  //! existing file is only replaced if overwrite is true.
+  bool saveXmlScheme(const QString& name, bool overwrite = false);
   bool loadConfig(const QString& filename = QString());
   bool saveConfig(const QString& filename = QString());
 
@@ -616,6 +665,9 @@ public:
   QString findNext(const QString& text,
                    int& pos,
                    bool showLineMarkers = false) const;
+  Token nextToken(const QString& text,
+                  int& pos,
+                  bool showLineMarkers = false) const;
   void skipBlanks(const QString& text,
                   int& pos,
                   bool showLineMarkers = false) const;
@@ -625,12 +677,11 @@ signals:
   void finished();
 
 private:
-  QWidget* m_parent;
-  StylesheetEditor* m_editor;
-  const QIcon m_invalidIcon, m_validIcon, m_addSemiColonIcon, m_addDColonIcon,
-    m_addColonIcon, m_badIcon, m_badSColonIcon, m_badColonIcon, m_badDColonIcon,
-    m_noIcon, m_fuzzyIcon;
+  StylesheetView* m_editor = nullptr;
   QMutex m_mutex;
+  // the widget model is read by the parse threads and only changed when a
+  // widget or custom value is added or removed.
+  QReadWriteLock m_modelLock;
   QStringList m_attributeNames;
   QStringList m_possibleWidgets;
   //  QStringList m_StylesheetProperties;
@@ -644,16 +695,58 @@ private:
   QString m_currentTheme;
   QString m_currentThemeName;
 
-  QMap<QTextCursor, Node*> m_nodes;
-  int m_braceCount;
-  bool m_manualMove, m_hasSuggestion;
+  // the working copy of the nodes, only changed under m_mutex.
+  QMap<TextPosition, Node*> m_nodes;
+  // the arena that holds the nodes in m_nodes.
+  std::shared_ptr<NodeArena> m_arena;
+  // only accessed through std::atomic_load and std::atomic_store.
+  NodeSnapshotPtr m_snapshot = std::make_shared<const NodeSnapshot>();
+  QAtomicInt m_generation;
+  OffsetMap m_offsetMap;
+  // The extent of a node in the node index. Nodes such as comments and
+  // newlines can lie within a rule so the node ends are not in order, the
+  // reach is the furthest limit up to and including the node and endReach
+  // the same of Node::end().
+  struct NodeExtent
+  {
+    Node* node;
+    int start;
+    int limit;
+    int end;
+    int reach;
+    int endReach;
+  };
+  // the nodes in document order, kept in step with m_nodes. The offsets are
+  // plain ints that are shifted as each edit is made.
+  QVector<NodeExtent> m_nodeIndex;
+  // the index of the last node returned by nodeAt(), cursor moves are
+  // usually close to the last one.
+  int m_lastNodeAt = 0;
+  // both braces of every rule in position order, kept in step with m_nodes.
+  // The offsets are plain ints that are shifted as each edit is made.
+  QVector<BraceEntry> m_braces;
+  // the edit log is compacted once it holds this many edits.
+  static const int MAX_PENDING_EDITS = 256;
+  // the simple flags and counts do not need the mutex.
+  QAtomicInt m_braceCount;
+  QAtomicInt m_manualMove, m_hasSuggestion;
   QTextCursor m_currentCursor;
   Node* m_currentNode;
-  int m_maxSuggestionCount;
+  QAtomicInt m_maxSuggestionCount;
 
   void readStandardThemes();
   void readCustomThemes();
   bool isBraceCountZero();
+  void rebuildNodeIndex();
+  void spliceNodeIndex(int first, int count, const QList<Node*>& nodes);
+  void updateNodeReach(int from, int fixed);
+  void shiftNodeIndex(int position, int charsRemoved, int charsAdded);
+  void publishNodes();
+  void addBraces(Node* node);
+  void removeBraces(Node* node);
+  void shiftBraces(int position, int charsRemoved, int charsAdded);
+  void compactEdits();
+  QList<int> unmatchedBraces(bool start);
 
   WidgetModel* m_widgetModel;
   void initialiseWidgetModel();
@@ -23,15 +23,13 @@
 
 #include <QtDebug>
 
-#include "stylesheetedit/stylesheetedit.h"
-#include "stylesheetedit_p.h"
+#include "stylesheetview.h"
 
 NamedNode::NamedNode(const QString& name,
-                     QTextCursor cursor,
-                     StylesheetEditor* editor,
-                     QObject* parent,
+                     TextPosition cursor,
+                     StylesheetView* editor,
                      enum NodeType type)
-  : Node(cursor, editor, parent, type)
+  : Node(cursor, editor, type)
   , m_name(name)
 {}
 
@@ -50,6 +48,9 @@ NamedNode::end() const
 int
 NamedNode::pointWidth(const QString& text) const
 {
+  if (!m_editor) {
+    return 0;
+  }
   auto fm = m_editor->fontMetrics();
   return fm.horizontalAdvance(text);
 }
@@ -57,16 +58,17 @@ NamedNode::pointWidth(const QString& text) const
 int
 NamedNode::pointHeight() const
 {
+  if (!m_editor) {
+    return 0;
+  }
   auto fm = m_editor->fontMetrics();
   return fm.height();
 }
 
-Node::Node(QTextCursor cursor,
-           StylesheetEditor* editor,
-           QObject* parent,
+Node::Node(TextPosition cursor,
+           StylesheetView* editor,
            NodeType type)
-  : QObject(parent)
-  , m_cursor(cursor)
+  : m_cursor(cursor)
   , m_type(type)
   , m_editor(editor)
 {}
@@ -89,14 +91,16 @@ operator<<(QDebug debug, const NamedNode& node)
 
 Node::Node(const Node& other) {}
 
-QTextCursor
+Node::~Node() {}
+
+TextPosition
 Node::cursor() const
 {
   return m_cursor;
 }
 
 void
-Node::setCursor(QTextCursor cursor)
+Node::setCursor(TextPosition cursor)
 {
   m_cursor = cursor;
 }
@@ -119,6 +123,43 @@ Node::end() const
   return position();
 }
 
+void
+Node::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  m_editor = editor;
+  m_cursor.setOffsetMap(map);
+}
+
+QRect
+Node::cursorRect(int position) const
+{
+  // nodes parsed without an editor have no geometry.
+  if (!m_editor) {
+    return QRect();
+  }
+  QTextCursor cursor(m_editor->document());
+  cursor.setPosition(position);
+  return m_editor->cursorRect(cursor);
+}
+
+QRect
+Node::cursorRect(const TextPosition& position) const
+{
+  return cursorRect(position.anchor());
+}
+
+QString
+Node::text(int position, int length) const
+{
+  if (!m_editor || length <= 0) {
+    return QString();
+  }
+  QTextCursor cursor(m_editor->document());
+  cursor.setPosition(position);
+  cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+  return cursor.selectedText();
+}
+
 enum NodeType
 Node::type() const
 {
@@ -176,6 +217,35 @@ void
 NamedNode::setName(const QString& value)
 {
   m_name = value;
+  m_fuzzySearched = false;
+}
+
+bool
+NamedNode::isFuzzyPending() const
+{
+  return m_state.testFlag(FuzzyPendingState);
+}
+
+QMultiMap<int, QString>
+NamedNode::fuzzyMatches(DataStore* datastore) const
+{
+  if (!m_fuzzySearched && datastore) {
+    m_fuzzyMatches = fuzzySearch(datastore);
+    m_fuzzySearched = true;
+  }
+  return m_fuzzyMatches;
+}
+
+QMultiMap<int, QString>
+NamedNode::fuzzySearch(DataStore* /*datastore*/) const
+{
+  return QMultiMap<int, QString>();
+}
+
+bool
+NamedNode::hasPendingFuzzyMatch(DataStore* datastore) const
+{
+  return (isFuzzyPending() && !fuzzyMatches(datastore).isEmpty());
 }
 
 int
@@ -200,7 +270,7 @@ NamedNode::isIn(QPoint pos)
 {
   auto x = pos.x();
   auto y = pos.y();
-  auto rect = m_editor->cursorRect(QTextCursor(m_cursor));
+  auto rect = cursorRect(m_cursor);
   auto left = rect.x();
   auto width = pointWidth(m_name);
   auto height = pointHeight();
@@ -214,23 +284,22 @@ NamedNode::isIn(QPoint pos)
   return false;
 }
 
-NodeSection*
+NodeSection
 NamedNode::sectionIfIn(QPoint pos)
 {
   if (isIn(pos)) {
-    return new NodeSection(this, SectionType::Name);
+    return NodeSection(SectionType::Name);
   }
 
-  return new NodeSection(this);
+  return NodeSection();
 }
 
 WidgetNode::WidgetNode(const QString& name,
-                       QTextCursor start,
-                       StylesheetEditor* editor,
+                       TextPosition start,
+                       StylesheetView* editor,
                        enum NodeState check,
-                       QObject* parent,
                        enum NodeType type)
-  : NamedNode(name, start, editor, parent, type)
+  : NamedNode(name, start, editor, type)
 {
   setWidgetCheck(check);
 }
@@ -239,11 +308,14 @@ WidgetNode::WidgetNode(const WidgetNode& other)
   : NamedNode(other.name(),
               other.cursor(),
               other.m_editor,
-              other.parent(),
               other.type())
 {}
 
-WidgetNode::~WidgetNode() {}
+WidgetNode::~WidgetNode()
+{
+  delete m_subcontrols;
+  delete m_pseudoStates;
+}
 
 int
 WidgetNode::length() const
@@ -270,9 +342,16 @@ WidgetNode::isNameValid() const
 }
 
 bool
-WidgetNode::isNameFuzzy() const
+WidgetNode::isNameFuzzy(DataStore* datastore) const
+{
+  return (m_state.testFlag(NodeState::FuzzyWidgetState) ||
+          hasPendingFuzzyMatch(datastore));
+}
+
+QMultiMap<int, QString>
+WidgetNode::fuzzySearch(DataStore* datastore) const
 {
-  return (m_state.testFlag(NodeState::FuzzyWidgetState));
+  return datastore->fuzzySearchWidgets(m_name);
 }
 
 void
@@ -282,11 +361,19 @@ WidgetNode::setWidgetCheck(NodeState check)
     case NodeState::WidgetState: {
       m_state.setFlag(NodeState::WidgetState, true);
       m_state.setFlag(NodeState::FuzzyWidgetState, false);
+      m_state.setFlag(NodeState::FuzzyPendingState, false);
       break;
     }
     case NodeState::FuzzyWidgetState: {
       m_state.setFlag(NodeState::FuzzyWidgetState, true);
       m_state.setFlag(NodeState::WidgetState, false);
+      m_state.setFlag(NodeState::FuzzyPendingState, false);
+      break;
+    }
+    case NodeState::FuzzyPendingState: {
+      m_state.setFlag(NodeState::FuzzyPendingState, true);
+      m_state.setFlag(NodeState::WidgetState, false);
+      m_state.setFlag(NodeState::FuzzyWidgetState, false);
       break;
     }
     case NodeState::SubControlState: {
@@ -325,7 +412,7 @@ WidgetNode::isIn(QPoint pos)
 {
   auto x = pos.x();
   auto y = pos.y();
-  auto rect = m_editor->cursorRect(QTextCursor(m_cursor));
+  auto rect = cursorRect(m_cursor);
   auto left = rect.x();
   auto width = pointWidth(m_name);
   auto height = pointHeight();
@@ -339,31 +426,31 @@ WidgetNode::isIn(QPoint pos)
   return false;
 }
 
-NodeSection*
+NodeSection
 WidgetNode::sectionIfIn(QPoint pos)
 {
 
   // this just checks the property name.
   auto section = NamedNode::sectionIfIn(pos);
-  if (section->type == SectionType::Name) {
-    section->type = SectionType::WidgetName;
+  if (section.type == SectionType::Name) {
+    section.type = SectionType::WidgetName;
     return section;
   }
 
   if (hasSubControl()) {
     for (auto subcontrol : *(m_subcontrols)) {
       section = subcontrol->sectionIfIn(pos);
-      if (section->type == SubControlName) {
-        section->type = WidgetSubControlName;
+      if (section.type == SubControlName) {
+        section.type = WidgetSubControlName;
         return section;
-      } else if (section->type == SubControlMarker) {
-        section->type = WidgetSubControlMarker;
+      } else if (section.type == SubControlMarker) {
+        section.type = WidgetSubControlMarker;
         return section;
-      } else if (section->type == SubControlPseudoStateName) {
-        section->type = WidgetSubControlPseudoStateName;
+      } else if (section.type == SubControlPseudoStateName) {
+        section.type = WidgetSubControlPseudoStateName;
         return section;
-      } else if (section->type == SubControlPseudoStateMarker) {
-        section->type = WidgetSubControlPseudoStateMarker;
+      } else if (section.type == SubControlPseudoStateMarker) {
+        section.type = WidgetSubControlPseudoStateMarker;
         return section;
       }
     }
@@ -390,7 +477,7 @@ WidgetNode::subControl(QPoint pos) const
 }
 
 SubControl*
-WidgetNode::subControl(QTextCursor cursor) const
+WidgetNode::subControl(TextPosition cursor) const
 {
   if (hasSubControls()) {
     for (auto control : *(m_subcontrols)) {
@@ -424,6 +511,12 @@ WidgetNode::addSubControl(SubControl* control)
   }
 }
 
+QList<PseudoState*>*
+WidgetNode::pseudoStates() const
+{
+  return m_pseudoStates;
+}
+
 void
 WidgetNode::addPseudoState(PseudoState* state)
 {
@@ -458,7 +551,7 @@ WidgetNode::pseudoState(QPoint pos) const
 }
 
 PseudoState*
-WidgetNode::pseudoState(QTextCursor cursor) const
+WidgetNode::pseudoState(TextPosition cursor) const
 {
   if (m_pseudoStates) {
     for (auto state : *(m_pseudoStates)) {
@@ -471,14 +564,14 @@ WidgetNode::pseudoState(QTextCursor cursor) const
 }
 
 void
-WidgetNode::setSubControlMarkerCursor(QTextCursor cursor)
+WidgetNode::setSubControlMarkerCursor(TextPosition cursor)
 {
   subControl(cursor)->setCursor(cursor);
   m_state.setFlag(NodeState::SubControlMarkerState, true);
 }
 
 void
-WidgetNode::setPseudoStateMarkerCursor(QTextCursor cursor)
+WidgetNode::setPseudoStateMarkerCursor(TextPosition cursor)
 {
   pseudoState(cursor)->setCursor(cursor);
   m_state.setFlag(NodeState::PseudostateMarkerState, true);
@@ -541,22 +634,23 @@ WidgetNode::isSubControlValid(QPoint pos) const
 }
 
 bool
-WidgetNode::isSubControlFuzzy(QTextCursor cursor) const
+WidgetNode::isSubControlFuzzy(TextPosition cursor, DataStore* datastore) const
 {
   auto subcontrol = subControl(cursor);
   if (subcontrol) {
-    return (m_state.testFlag(NodeState::FuzzySubControlState));
+    return (m_state.testFlag(NodeState::FuzzySubControlState) ||
+            subcontrol->isFuzzy(datastore));
   }
   return false;
 }
 
 bool
-WidgetNode::isSubControlFuzzy(QPoint pos) const
+WidgetNode::isSubControlFuzzy(QPoint pos, DataStore* datastore) const
 {
   auto subcontrol = subControl(pos);
   if (subcontrol) {
-
-    return (m_state.testFlag(NodeState::FuzzySubControlState));
+    return (m_state.testFlag(NodeState::FuzzySubControlState) ||
+            subcontrol->isFuzzy(datastore));
   }
   return false;
 }
@@ -601,6 +695,25 @@ WidgetNode::isExtensionMarkerCorrect()
            m_state.testFlag(SubControlMarkerState)));
 }
 
+void
+WidgetNode::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  NamedNode::attach(map, editor);
+  if (m_subcontrols) {
+    for (auto control : *m_subcontrols) {
+      control->attach(map, editor);
+    }
+  }
+  if (m_pseudoStates) {
+    for (auto state : *m_pseudoStates) {
+      state->attach(map, editor);
+    }
+  }
+  if (m_idSelector) {
+    m_idSelector->attach(map, editor);
+  }
+}
+
 bool
 WidgetNodes::hasStartBrace() const
 {
@@ -608,13 +721,13 @@ WidgetNodes::hasStartBrace() const
 }
 
 void
-WidgetNodes::setStartBraceCursor(QTextCursor cursor)
+WidgetNodes::setStartBraceCursor(TextPosition cursor)
 {
   m_state.setFlag(NodeState::StartBraceState, true);
   m_startBracePosition = cursor;
 }
 
-QTextCursor
+TextPosition
 WidgetNodes::startBraceCursor() const
 {
   return m_startBracePosition;
@@ -639,13 +752,13 @@ WidgetNodes::hasEndBrace() const
 }
 
 void
-WidgetNodes::setEndBraceCursor(QTextCursor cursor)
+WidgetNodes::setEndBraceCursor(TextPosition cursor)
 {
   m_state.setFlag(NodeState::EndBraceState, true);
   m_endBracePosition = cursor;
 }
 
-QTextCursor
+TextPosition
 WidgetNodes::endBraceCursor() const
 {
   return m_endBracePosition;
@@ -696,12 +809,12 @@ WidgetNodes::isFinalProperty(PropertyNode* property) const
 }
 
 void
-WidgetNodes::addSeperatorCursor(QTextCursor cursor)
+WidgetNodes::addSeperatorCursor(TextPosition cursor)
 {
   m_widgetSeperators.append(cursor);
 }
 
-QList<QTextCursor>
+QList<TextPosition>
 WidgetNodes::seperators()
 {
   return m_widgetSeperators;
@@ -776,32 +889,32 @@ WidgetNodes::isIn(QPoint pos)
   return false;
 }
 
-NodeSection*
+NodeSection
 WidgetNodes::sectionIfIn(QPoint pos)
 {
-  NodeSection* section = nullptr;
+  NodeSection section;
   for (auto widget : m_widgets) {
     section = widget->sectionIfIn(pos);
-    if (section) {
+    if (section.type != SectionType::None) {
       return section;
     }
   }
 
   for (auto property : m_properties) {
     section = property->sectionIfIn(pos);
-    if (section) {
-      switch (section->type) {
+    if (section.type != SectionType::None) {
+      switch (section.type) {
         case SectionType::PropertyName:
-          section->type = SectionType::WidgetPropertyName;
+          section.type = SectionType::WidgetPropertyName;
           break;
         case SectionType::PropertyMarker:
-          section->type = SectionType::WidgetPropertyMarker;
+          section.type = SectionType::WidgetPropertyMarker;
           break;
         case SectionType::PropertyValue:
-          section->type = SectionType::WidgetPropertyValue;
+          section.type = SectionType::WidgetPropertyValue;
           break;
         case SectionType::PropertyEndMarker:
-          section->type = SectionType::WidgetPropertyEndMarker;
+          section.type = SectionType::WidgetPropertyEndMarker;
           break;
       }
       return section;
@@ -809,18 +922,31 @@ WidgetNodes::sectionIfIn(QPoint pos)
   }
 
   if (isInStartBrace(pos)) {
-    section = new NodeSection(this);
-    section->type = SectionType::WidgetStartBrace;
-    return section;
+    return NodeSection(SectionType::WidgetStartBrace);
   }
 
   if (isInEndBrace(pos)) {
-    section = new NodeSection(this);
-    section->type = SectionType::WidgetEndBrace;
-    return section;
+    return NodeSection(SectionType::WidgetEndBrace);
   }
 
-  return nullptr;
+  return NodeSection();
+}
+
+void
+WidgetNodes::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  Node::attach(map, editor);
+  m_startBracePosition.setOffsetMap(map);
+  m_endBracePosition.setOffsetMap(map);
+  for (auto& seperator : m_widgetSeperators) {
+    seperator.setOffsetMap(map);
+  }
+  for (auto widget : m_widgets) {
+    widget->attach(map, editor);
+  }
+  for (auto property : m_properties) {
+    property->attach(map, editor);
+  }
 }
 
 bool
@@ -832,11 +958,11 @@ WidgetNodes::isInStartBrace(QPoint pos)
   int left, right;
   auto fm = m_editor->fontMetrics();
   int top, bottom;
-  QTextCursor cursor;
+  TextPosition cursor;
 
   if (hasStartBrace()) {
     cursor = startBraceCursor();
-    rect = m_editor->cursorRect(cursor);
+    rect = cursorRect(cursor);
     top = rect.y();
     bottom = top + rect.height();
     left = rect.x();
@@ -857,11 +983,11 @@ WidgetNodes::isInEndBrace(QPoint pos)
   int left, right;
   auto fm = m_editor->fontMetrics();
   int top, bottom;
-  QTextCursor cursor;
+  TextPosition cursor;
 
   if (hasEndBrace()) {
     cursor = endBraceCursor();
-    rect = m_editor->cursorRect(cursor);
+    rect = cursorRect(cursor);
     top = rect.y();
     bottom = top + rect.height();
     left = rect.x();
@@ -874,12 +1000,11 @@ WidgetNodes::isInEndBrace(QPoint pos)
 }
 
 PropertyNode::PropertyNode(const QString& name,
-                           QTextCursor start,
-                           StylesheetEditor* editor,
+                           TextPosition start,
+                           StylesheetView* editor,
                            NodeState check,
-                           QObject* parent,
                            enum NodeType type)
-  : NamedNode(name, start, editor, parent, type)
+  : NamedNode(name, start, editor, type)
 {
   setPropertyNameCheck(check);
 }
@@ -888,14 +1013,10 @@ PropertyNode::PropertyNode(const PropertyNode& other)
   : NamedNode(other.name(),
               other.cursor(),
               other.m_editor,
-              other.parent(),
               other.type())
 {}
 
-PropertyNode::~PropertyNode()
-{
-  qDeleteAll(m_valueStatus);
-}
+PropertyNode::~PropertyNode() {}
 
 void
 PropertyNode::setWidgetNodes(WidgetNodes* widget)
@@ -912,109 +1033,128 @@ PropertyNode::hasWidgetNodes()
 QList<NodeState>
 PropertyNode::state() const
 {
-  return m_checks;
+  QList<NodeState> checks;
+  for (auto& value : m_values) {
+    checks.append(value.check);
+  }
+  return checks;
 }
 
 void
-PropertyNode::setValueOffset(int index, QTextCursor offset)
+PropertyNode::setValueOffset(int index, TextPosition offset)
 {
-  if (index >= 0 && index < m_valueStatus.length()) {
-    auto status = m_valueStatus.at(index);
-    status->setOffset(offset);
-    //    m_valueStatus.replace(index, status);
+  if (index >= 0 && index < m_values.size()) {
+    valueStatus(index)->setOffset(offset);
   }
 }
 
 void
 PropertyNode::setValueState(int index, PropertyValueState state)
 {
-  if (index >= 0 && index < m_valueStatus.length()) {
-    auto status = m_valueStatus.at(index);
-    status->setState(state);
-    //    m_valueStatus.replace(index, status);
+  if (index >= 0 && index < m_values.size()) {
+    valueStatus(index)->setState(state);
   }
 }
 
 void
 PropertyNode::setValueName(int index, const QString& name)
 {
-  if (index >= 0 && index < m_valueStatus.length()) {
-    auto status = m_valueStatus.at(index);
-    status->setName(name);
-    m_valueStatus.replace(index, status);
+  // the name is already in the document, only its length is recorded.
+  if (index >= 0 && index < m_values.size()) {
+    valueStatus(index)->setLength(name.length());
   }
 }
 
+QString
+PropertyNode::statusName(const PropertyStatus* status) const
+{
+  return text(status->offset(), status->length());
+}
+
+QString
+PropertyNode::sectionName(const PropertyStatus* status, int index) const
+{
+  return text(status->sectionOffset(index), status->sectionLength(index));
+}
+
 PropertyStatus*
 PropertyNode::valueStatus(int index) const
 {
-  if (index >= 0 && index < m_valueStatus.size())
-    return m_valueStatus.at(index);
+  if (index >= 0 && index < m_values.size())
+    return &m_statuses[m_values.at(index).first];
   return nullptr;
 }
 
 void
 PropertyNode::setChecks(const QList<NodeState>& checks)
 {
-  m_checks = checks;
+  for (int i = 0; i < checks.size() && i < m_values.size(); i++) {
+    m_values[i].check = checks.at(i);
+  }
 }
 
 void
 PropertyNode::setStateFlag(int index, NodeState check)
 {
-  if (index >= 0 && index < m_checks.length()) {
-    m_checks.replace(index, check);
+  if (index >= 0 && index < m_values.size()) {
+    m_values[index].check = check;
   }
 }
 
 NodeState
 PropertyNode::check(int index)
 {
-  if (index >= 0 && index < m_checks.size())
-    return m_checks.at(index);
+  if (index >= 0 && index < m_values.size())
+    return m_values.at(index).check;
   return BadNodeState;
 }
 
 int
 PropertyNode::valuePosition(int index)
 {
-  if (index >= 0 && index < m_valueStatus.size())
-    return m_valueStatus.at(index)->offset();
+  if (index >= 0 && index < m_values.size())
+    return valueStatus(index)->offset();
   return -1;
 }
 
 int
 PropertyNode::valueCount()
 {
-  return m_valueStatus.size();
+  return m_values.size();
 }
 
 void
-PropertyNode::addValue(NodeState check, PropertyStatus* status)
+PropertyNode::addValue(NodeState check, const PropertyStatusList& statuses)
 {
-  m_checks.append(check);
-  m_valueStatus.append(status);
+  if (statuses.isEmpty()) {
+    return;
+  }
+  // the records are copied in order so a value's statuses stay linked.
+  m_values.append({ check, m_statuses.size() });
+  for (int i = 0; i < statuses.size(); i++) {
+    m_statuses.append(statuses.at(i));
+  }
 }
 
 QString
 PropertyNode::value(int index)
 {
-  if (index >= 0 && index < m_valueStatus.size())
-    return m_valueStatus.at(index)->name();
+  if (index >= 0 && index < m_values.size())
+    return statusName(valueStatus(index));
   return QString();
 }
 
 int
 PropertyNode::count()
 {
-  return m_valueStatus.size();
+  return m_values.size();
 }
 
 bool
 PropertyNode::isValueValid(int index)
 {
   if (index >= 0 && index < count()) {
-    return m_checks.at(index) != BadNodeState;
+    return m_values.at(index).check != BadNodeState;
   }
 
   // default to bad.
@@ -1032,15 +1172,14 @@ PropertyNode::length() const
 {
   if (hasPropertyEndMarker()) {
     return m_endMarkerCursor.anchor() - position();
-  } else if (m_valueStatus.isEmpty()) {
+  } else if (m_values.isEmpty()) {
     if (!hasPropertyMarker()) {
       return m_name.length();
     } else {
       return propertyMarkerCursor().anchor() + 1;
     }
   } else {
-    auto value = m_valueStatus.last()->name();
-    auto status = m_valueStatus.last();
+    auto status = valueStatus(m_values.size() - 1);
     while (status->next()) {
       status = status->next();
     }
@@ -1063,6 +1202,8 @@ PropertyNode::setPropertyNameCheck(NodeState check)
     m_propertyState.setFlag(ValidNameState, false);
     m_propertyState.setFlag(FuzzyPropertyState, false);
   }
+  // the pending flag lives with the rest of the name state.
+  m_state.setFlag(FuzzyPendingState, check == FuzzyPendingState);
 }
 
 bool
@@ -1084,9 +1225,16 @@ PropertyNode::isValidPropertyName() const
 }
 
 bool
-PropertyNode::isFuzzyName() const
+PropertyNode::isFuzzyName(DataStore* datastore) const
+{
+  return (m_propertyState.testFlag(NodeState::FuzzyPropertyState) ||
+          hasPendingFuzzyMatch(datastore));
+}
+
+QMultiMap<int, QString>
+PropertyNode::fuzzySearch(DataStore* datastore) const
 {
-  return (m_propertyState.testFlag(NodeState::FuzzyPropertyState));
+  return datastore->fuzzySearchProperty(m_name);
 }
 
 bool
@@ -1105,7 +1253,7 @@ PropertyNode::isValid(bool finalProperty)
   return m_propertyState.testFlag(ValidNameState);
 }
 
-QTextCursor
+TextPosition
 PropertyNode::propertyMarkerCursor() const
 {
   return m_propertyMarkerCursor;
@@ -1118,7 +1266,7 @@ PropertyNode::propertyMarkerPosition() const
 }
 
 void
-PropertyNode::setPropertyMarkerCursor(QTextCursor position)
+PropertyNode::setPropertyMarkerCursor(TextPosition position)
 {
   m_propertyMarkerCursor = position;
 }
@@ -1135,7 +1283,7 @@ PropertyNode::setPropertyEndMarker(bool exists)
   m_propertyState.setFlag(NodeState::PropertyEndMarkerState, exists);
 }
 
-QTextCursor
+TextPosition
 PropertyNode::propertyEndMarkerCursor() const
 {
   return m_endMarkerCursor;
@@ -1148,18 +1296,18 @@ PropertyNode::propertyEndMarkerPosition() const
 }
 
 void
-PropertyNode::setPropertyEndMarkerCursor(QTextCursor position)
+PropertyNode::setPropertyEndMarkerCursor(TextPosition position)
 {
   m_endMarkerCursor = position;
 }
 
-NodeSection*
+NodeSection
 PropertyNode::sectionIfIn(QPoint pos)
 {
   // this just checks the property name.
   auto isin = NamedNode::sectionIfIn(pos);
-  if (isin->type == SectionType::Name) {
-    isin->type = SectionType::PropertyName;
+  if (isin.type == SectionType::Name) {
+    isin.type = SectionType::PropertyName;
     return isin;
   }
 
@@ -1173,40 +1321,41 @@ PropertyNode::sectionIfIn(QPoint pos)
   // check marker;
   if (hasPropertyMarker()) {
     auto cursor = propertyMarkerCursor();
-    rect = m_editor->cursorRect(cursor);
+    rect = cursorRect(cursor);
     top = rect.y();
     bottom = top + rect.height();
     left = rect.x();
     right = left + fm.horizontalAdvance(":");
     if (x >= left && x <= right && y >= top && y < bottom) {
-      isin->type = SectionType::PropertyMarker;
+      isin.type = SectionType::PropertyMarker;
       return isin;
     }
   }
 
-  for (int i = 0; i < m_valueStatus.count(); i++) {
-    rect = m_valueStatus.at(i)->rect();
+  for (int i = 0; i < m_values.size(); i++) {
+    auto status = valueStatus(i);
+    rect = valueRect(status);
     top = rect.y();
     bottom = top + rect.height();
     left = rect.x();
-    right = left + fm.horizontalAdvance(m_valueStatus.at(i)->name());
+    right = left + rect.width();
 
     if (x >= left && x <= right && y >= top && y < bottom) {
-      isin->type = SectionType::PropertyValue;
-      isin->position = i;
+      isin.type = SectionType::PropertyValue;
+      isin.position = i;
       break;
     }
   }
 
   if (hasPropertyEndMarker()) {
     auto cursor = propertyEndMarkerCursor();
-    rect = m_editor->cursorRect(cursor);
+    rect = cursorRect(cursor);
     top = rect.y();
     bottom = top + rect.height();
     left = rect.x();
     right = left + fm.horizontalAdvance(":");
     if (x >= left && x <= right && y >= top && y < bottom) {
-      isin->type = SectionType::PropertyEndMarker;
+      isin.type = SectionType::PropertyEndMarker;
       return isin;
     }
   }
@@ -1243,13 +1392,12 @@ PropertyNode::sectionIfIn(int start, int end)
     }
   }
 
-  for (int i = 0; i < m_valueStatus.count(); i++) {
-    auto status = m_valueStatus.at(i);
+  for (auto& propertyValue : m_values) {
+    auto status = &m_statuses[propertyValue.first];
     auto offset = status->offset();
     if (end < offset)
       break;
-    auto value = status->name();
-    valueEnd = offset + value.length();
+    valueEnd = offset + status->length();
     PartialType pt;
     if (start <= offset) {
       if (end > offset) {
@@ -1288,9 +1436,8 @@ PropertyNode::sectionIfIn(int start, int end)
 int
 PropertyNode::indexOf(const QString& name) const
 {
-  for (auto i = 0; i < m_valueStatus.length(); i++) {
-    auto status = m_valueStatus.at(i);
-    if (status->name() == name) {
+  for (auto i = 0; i < m_values.size(); i++) {
+    if (statusName(valueStatus(i)) == name) {
       return i;
     }
   }
@@ -1300,8 +1447,8 @@ PropertyNode::indexOf(const QString& name) const
 int
 PropertyNode::statusLinkCount(int index)
 {
-  if (!m_valueStatus.isEmpty() && index >= 0 && index < m_valueStatus.size()) {
-    auto status = m_valueStatus.at(index);
+  if (index >= 0 && index < m_values.size()) {
+    auto status = valueStatus(index);
     int count = 1;
     while (status->next()) {
       count++;
@@ -1336,28 +1483,59 @@ PropertyNode::setMaxCount(int maxCount)
   m_maxCount = maxCount;
 }
 
+void
+PropertyNode::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  NamedNode::attach(map, editor);
+  m_propertyMarkerCursor.setOffsetMap(map);
+  m_endMarkerCursor.setOffsetMap(map);
+
+  for (auto& status : m_statuses) {
+    status.setOffsetMap(map);
+  }
+}
+
+//! The value rectangles are only needed for hit testing so they are worked
+//! out here, when asked for, rather than while the value is validated.
+QRect
+PropertyNode::valueRect(const PropertyStatus* status) const
+{
+  auto datastore = (m_editor ? m_editor->datastore() : nullptr);
+  if (!datastore) {
+    return QRect();
+  }
+  return datastore->getRectForText(status->offset(), status->length());
+}
+
+QRect
+PropertyNode::sectionRect(const PropertyStatus* status, int index) const
+{
+  auto datastore = (m_editor ? m_editor->datastore() : nullptr);
+  if (!datastore) {
+    return QRect();
+  }
+  return datastore->getRectForText(status->sectionOffset(index),
+                                   status->sectionLength(index));
+}
+
 void
 PropertyNode::setValue(int index, const QString& value)
 {
-  if (index >= 0 && index < m_valueStatus.length()) {
-    auto status = m_valueStatus.at(index);
-    status->name() = value;
-    m_valueStatus.replace(index, status);
+  if (index >= 0 && index < m_values.size()) {
+    valueStatus(index)->setLength(value.length());
   }
 }
 
-CommentNode::CommentNode(QTextCursor start,
-                         StylesheetEditor* editor,
-                         QObject* parent,
+CommentNode::CommentNode(TextPosition start,
+                         StylesheetView* editor,
                          enum NodeType type)
-  : Node(start, editor, parent, type)
+  : Node(start, editor, type)
 // TODO set actual comment check value
 {}
 
 CommentNode::CommentNode(const CommentNode& other)
   : Node(other.cursor(),
          other.m_editor, // TODO set actual comment check value
-         other.parent(),
          other.type())
 {}
 
@@ -1393,14 +1571,14 @@ CommentNode::length() const
   }
 }
 
-QTextCursor
+TextPosition
 CommentNode::textCursor() const
 {
   return m_textCursor;
 }
 
 void
-CommentNode::setTextCursor(QTextCursor cursor)
+CommentNode::setTextCursor(TextPosition cursor)
 {
   m_textCursor = cursor;
 }
@@ -1423,19 +1601,27 @@ CommentNode::setEndCommentExists(bool exists)
   m_endCommentExists = exists;
 }
 
-QTextCursor
+TextPosition
 CommentNode::endCommentCursor() const
 {
   return m_endCursor;
 }
 
 void
-CommentNode::setEndCommentCursor(QTextCursor cursor)
+CommentNode::setEndCommentCursor(TextPosition cursor)
 {
   m_endCursor = cursor;
 }
 
-NodeSection*
+void
+CommentNode::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  Node::attach(map, editor);
+  m_textCursor.setOffsetMap(map);
+  m_endCursor.setOffsetMap(map);
+}
+
+NodeSection
 CommentNode::sectionIfIn(QPoint pos)
 {
   QRect rect;
@@ -1444,63 +1630,58 @@ CommentNode::sectionIfIn(QPoint pos)
   int left, right;
   auto fm = m_editor->fontMetrics();
   int top, bottom;
-  NodeSection* isin = new NodeSection(this);
+  NodeSection isin;
 
   // check marker;
-  QTextCursor s(m_editor->document());
-  s.setPosition(position());
-  rect = m_editor->cursorRect(s);
+  rect = cursorRect(position());
   top = rect.y();
   bottom = top + rect.height();
   left = rect.x();
-  s.movePosition(QTextCursor::Right, QTextCursor::MoveAnchor, length());
-  rect = m_editor->cursorRect(s);
+  rect = cursorRect(position() + length());
   right = rect.x();
   if (x >= left && x <= right && y >= top && y < bottom) {
-    isin->type = SectionType::Comment;
+    isin.type = SectionType::Comment;
     return isin;
   }
 
   return isin;
 }
 
-NewlineNode::NewlineNode(QTextCursor start,
-                         StylesheetEditor* editor,
-                         QObject* parent,
+NewlineNode::NewlineNode(TextPosition start,
+                         StylesheetView* editor,
                          enum NodeType type)
-  : NamedNode("\n", start, editor, parent, type)
+  : NamedNode("\n", start, editor, type)
 {}
 
-MarkerBase::MarkerBase(QTextCursor markerCursor,
-                       QTextCursor nameCursor,
+MarkerBase::MarkerBase(TextPosition markerCursor,
+                       TextPosition nameCursor,
                        const QString& name,
-                       StylesheetEditor* editor,
-                       QObject* parent,
+                       StylesheetView* editor,
                        NodeType type)
-  : NamedNode(name, nameCursor, editor, parent, type)
+  : NamedNode(name, nameCursor, editor, type)
   , m_markerCursor(markerCursor)
 {}
 
-QTextCursor
+TextPosition
 MarkerBase::cursor() const
 {
   return m_markerCursor;
 }
 
-QTextCursor
+TextPosition
 MarkerBase::nameCursor() const
 {
   return NamedNode::cursor();
 }
 
 void
-MarkerBase::setCursor(QTextCursor markerCursor)
+MarkerBase::setCursor(TextPosition markerCursor)
 {
   m_markerCursor = markerCursor;
 }
 
 void
-MarkerBase::setNameCursor(QTextCursor cursor)
+MarkerBase::setNameCursor(TextPosition cursor)
 {
   NamedNode::setCursor(cursor);
 }
@@ -1518,24 +1699,30 @@ MarkerBase::position() const
 }
 
 bool
-MarkerBase::isFuzzy() const
+MarkerBase::isFuzzy(DataStore* /*datastore*/) const
 {
   return false;
 }
 
+void
+MarkerBase::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  NamedNode::attach(map, editor);
+  m_markerCursor.setOffsetMap(map);
+}
+
 int
 MarkerBase::length() const
 {
   return (m_markerCursor.position() - NamedNode::position() + name().length());
 }
 
-ControlBase::ControlBase(QTextCursor markerCursor,
-                         QTextCursor nameCursor,
+ControlBase::ControlBase(TextPosition markerCursor,
+                         TextPosition nameCursor,
                          const QString& name,
-                         StylesheetEditor* editor,
-                         QObject* parent,
+                         StylesheetView* editor,
                          enum NodeType type)
-  : MarkerBase(markerCursor, nameCursor, name, editor, parent, type)
+  : MarkerBase(markerCursor, nameCursor, name, editor, type)
 {
   m_marker = "::";
   if (!markerCursor.isNull()) {
@@ -1543,6 +1730,11 @@ ControlBase::ControlBase(QTextCursor markerCursor,
   }
 }
 
+ControlBase::~ControlBase()
+{
+  delete m_pseudoStates;
+}
+
 QList<PseudoState*>*
 ControlBase::pseudoStates() const
 {
@@ -1559,7 +1751,7 @@ ControlBase::hasPseudoStates()
 }
 
 PseudoState*
-ControlBase::pseudoState(QTextCursor cursor)
+ControlBase::pseudoState(TextPosition cursor)
 {
   if (m_pseudoStates) {
     for (auto state : *(m_pseudoStates)) {
@@ -1586,6 +1778,17 @@ ControlBase::addPseudoState(PseudoState* state)
   }
 }
 
+void
+ControlBase::attach(const OffsetMap* map, StylesheetView* editor)
+{
+  MarkerBase::attach(map, editor);
+  if (m_pseudoStates) {
+    for (auto state : *m_pseudoStates) {
+      state->attach(map, editor);
+    }
+  }
+}
+
 bool
 ControlBase::hasMarker()
 {
@@ -1604,15 +1807,23 @@ ControlBase::length() const
 }
 
 bool
-ControlBase::isFuzzy() const
+ControlBase::isFuzzy(DataStore* datastore) const
+{
+  return (state().testFlag(FuzzySubControlState) ||
+          hasPendingFuzzyMatch(datastore));
+}
+
+QMultiMap<int, QString>
+ControlBase::fuzzySearch(DataStore* datastore) const
 {
-  return (state().testFlag(FuzzySubControlState));
+  return datastore->fuzzySearchSubControl(m_name);
 }
 
 bool
 ControlBase::isValid() const
 {
   if (m_state.testFlag(FuzzySubControlState) ||
+      m_state.testFlag(FuzzyPendingState) ||
       !m_state.testFlag(SubControlMarkerState) ||
       m_state.testFlag(BadSubControlForWidgetState)) {
     return false;
@@ -1620,12 +1831,12 @@ ControlBase::isValid() const
   return true;
 }
 
-NodeSection*
+NodeSection
 ControlBase::sectionIfIn(QPoint pos)
 {
   auto section = NamedNode::sectionIfIn(pos);
-  if (section->type == Name) {
-    section->type = SubControlName;
+  if (section.type == Name) {
+    section.type = SubControlName;
     return section;
   }
 
@@ -1635,25 +1846,27 @@ ControlBase::sectionIfIn(QPoint pos)
   int left, right;
   auto fm = m_editor->fontMetrics();
   int top, bottom;
-  QTextCursor c = cursor();
-  rect = m_editor->cursorRect(c);
+  TextPosition c = cursor();
+  rect = cursorRect(c);
   top = rect.y();
   bottom = top + rect.height();
   left = rect.x();
   right = left + fm.horizontalAdvance("::");
   if (x >= left && x <= right && y >= top && y < bottom) {
-    section->type = SubControlMarker;
+    section.type = SubControlMarker;
     return section;
   }
 
-  for (auto state : *(m_pseudoStates)) {
-    section = state->sectionIfIn(pos);
-    if (section->type == PseudoStateName) {
-      section->type = SubControlPseudoStateName;
-      return section;
-    } else if (section->type == PseudoStateMarker) {
-      section->type = SubControlPseudoStateMarker;
-      return section;
+  if (hasPseudoStates()) {
+    for (auto state : *(m_pseudoStates)) {
+      section = state->sectionIfIn(pos);
+      if (section.type == PseudoStateName) {
+        section.type = SubControlPseudoStateName;
+        return section;
+      } else if (section.type == PseudoStateMarker) {
+        section.type = SubControlPseudoStateMarker;
+        return section;
+      }
     }
   }
   return section;
@@ -1678,13 +1891,12 @@ ControlBase::pointWidth(const QString& text) const
   return fm.horizontalAdvance(s);
 }
 
-PseudoState::PseudoState(QTextCursor markerCursor,
-                         QTextCursor nameCursor,
+PseudoState::PseudoState(TextPosition markerCursor,
+                         TextPosition nameCursor,
                          const QString& name,
-                         StylesheetEditor* editor,
-                         QObject* parent,
+                         StylesheetView* editor,
                          NodeType type)
-  : MarkerBase(markerCursor, nameCursor, name, editor, parent, type)
+  : MarkerBase(markerCursor, nameCursor, name, editor, type)
 {
   m_marker = ":";
   if (!markerCursor.isNull()) {
@@ -1699,9 +1911,16 @@ PseudoState::hasMarker()
 }
 
 bool
-PseudoState::isFuzzy() const
+PseudoState::isFuzzy(DataStore* datastore) const
+{
+  return (state().testFlag(FuzzyPseudostateState) ||
+          hasPendingFuzzyMatch(datastore));
+}
+
+QMultiMap<int, QString>
+PseudoState::fuzzySearch(DataStore* datastore) const
 {
-  return (state().testFlag(FuzzyPseudostateState));
+  return datastore->fuzzySearchPseudoStates(m_name);
 }
 
 bool
@@ -1719,7 +1938,7 @@ PseudoState::isIn(QPoint pos)
 {
   auto x = pos.x();
   auto y = pos.y();
-  auto rect = m_editor->cursorRect(QTextCursor(m_cursor));
+  auto rect = cursorRect(m_cursor);
   auto left = rect.x();
   auto width = pointWidth(m_name);
   auto height = pointHeight();
@@ -1733,12 +1952,12 @@ PseudoState::isIn(QPoint pos)
   return false;
 }
 
-NodeSection*
+NodeSection
 PseudoState::sectionIfIn(QPoint pos)
 {
   auto section = NamedNode::sectionIfIn(pos);
-  if (section->type == SectionType::Name) {
-    section->type = SectionType::PseudoStateName;
+  if (section.type == SectionType::Name) {
+    section.type = SectionType::PseudoStateName;
     return section;
   }
 
@@ -1748,14 +1967,14 @@ PseudoState::sectionIfIn(QPoint pos)
   int left, right;
   auto fm = m_editor->fontMetrics();
   int top, bottom;
-  QTextCursor c = cursor();
-  rect = m_editor->cursorRect(c);
+  TextPosition c = cursor();
+  rect = cursorRect(c);
   top = rect.y();
   bottom = top + rect.height();
   left = rect.x();
   right = left + fm.horizontalAdvance(":");
   if (x >= left && x <= right && y >= top && y < bottom) {
-    section->type = PseudoStateMarker;
+    section.type = PseudoStateMarker;
     return section;
   }
   return section;
@@ -1776,13 +1995,12 @@ PseudoState::pointWidth(const QString& text) const
   return fm.horizontalAdvance(s);
 }
 
-SubControl::SubControl(QTextCursor markerCursor,
-                       QTextCursor nameCursor,
+SubControl::SubControl(TextPosition markerCursor,
+                       TextPosition nameCursor,
                        const QString& name,
-                       StylesheetEditor* editor,
-                       QObject* parent,
+                       StylesheetView* editor,
                        enum NodeType type)
-  : ControlBase(markerCursor, nameCursor, name, editor, parent, type)
+  : ControlBase(markerCursor, nameCursor, name, editor, type)
 {
   m_marker = "::";
   if (!markerCursor.isNull()) {
@@ -1790,13 +2008,12 @@ SubControl::SubControl(QTextCursor markerCursor,
   }
 }
 
-IDSelector::IDSelector(QTextCursor markerCursor,
-                       QTextCursor nameCursor,
+IDSelector::IDSelector(TextPosition markerCursor,
+                       TextPosition nameCursor,
                        const QString& name,
-                       StylesheetEditor* editor,
-                       QObject* parent,
+                       StylesheetView* editor,
                        enum NodeType type)
-  : ControlBase(markerCursor, nameCursor, name, editor, parent, type)
+  : ControlBase(markerCursor, nameCursor, name, editor, type)
 {
   m_marker = "#";
   if (!markerCursor.isNull()) {
@@ -1818,3 +2035,101 @@ PropertyNode::isFinalProperty()
 {
   return m_isFinalProperty;
 }
+
+void
+PropertyNode::setFinalProperty(bool finalProperty)
+{
+  m_isFinalProperty = finalProperty;
+}
+
+NodeArena::~NodeArena()
+{
+  for (auto node : m_nodes) {
+    node->~Node();
+  }
+  for (auto block : m_blocks) {
+    ::operator delete(block);
+  }
+}
+
+void
+NodeArena::release(Node* node)
+{
+  if (!node || m_released.contains(node)) {
+    return;
+  }
+  m_released.insert(node);
+
+  if (auto widgetnodes = node_cast<WidgetNodes>(node)) {
+    for (auto widget : widgetnodes->widgets()) {
+      release(widget);
+    }
+    for (int i = 0; i < widgetnodes->propertyCount(); i++) {
+      release(widgetnodes->property(i));
+    }
+  } else if (auto widget = node_cast<WidgetNode>(node)) {
+    if (widget->subControls()) {
+      for (auto subcontrol : *widget->subControls()) {
+        release(subcontrol);
+      }
+    }
+    if (widget->pseudoStates()) {
+      for (auto pseudostate : *widget->pseudoStates()) {
+        release(pseudostate);
+      }
+    }
+    release(widget->idSelector());
+  } else if (auto control = node_cast<ControlBase>(node)) {
+    // both sub controls and id selectors hold pseudo states.
+    if (control->pseudoStates()) {
+      for (auto pseudostate : *control->pseudoStates()) {
+        release(pseudostate);
+      }
+    }
+  }
+}
+
+void
+NodeArena::adopt(NodeArena* other)
+{
+  m_blocks.append(other->m_blocks);
+  m_nodes.append(other->m_nodes);
+  m_released.unite(other->m_released);
+
+  other->m_blocks.clear();
+  other->m_nodes.clear();
+  other->m_released.clear();
+  other->m_next = nullptr;
+  other->m_remaining = 0;
+}
+
+int
+NodeArena::liveCount() const
+{
+  return m_nodes.size() - m_released.size();
+}
+
+int
+NodeArena::releasedCount() const
+{
+  return m_released.size();
+}
+
+void*
+NodeArena::allocate(size_t size, size_t align)
+{
+  auto padding = (align - reinterpret_cast<quintptr>(m_next) % align) % align;
+
+  if (!m_next || padding + size > m_remaining) {
+    auto blockSize = qMax(BLOCK_SIZE, size + align);
+    m_next = static_cast<char*>(::operator new(blockSize));
+    m_remaining = blockSize;
+    m_blocks.append(m_next);
+    padding = (align - reinterpret_cast<quintptr>(m_next) % align) % align;
+  }
+
+  auto memory = m_next + padding;
+  m_next = memory + size;
+  m_remaining -= padding + size;
+  return memory;
+}
@@ -24,41 +24,52 @@
 
 #include <QList>
 #include <QMap>
-#include <QObject>
-#include <QTextCursor>
-#include <QWidget>
+#include <QSet>
+#include <QRect>
+#include <QVector>
+
+#include <new>
+#include <utility>
 
 #include "common.h"
 #include "datastore.h"
 #include "parserstate.h"
 
-class Node : public QObject
+class Node
 {
-  Q_OBJECT
 public:
-  Node(QTextCursor cursor,
-       StylesheetEditor* editor,
-       QObject* parent,
+  Node(TextPosition cursor,
+       StylesheetView* editor,
        enum NodeType type = NoType);
 
   Node(const Node& other);
+  virtual ~Node();
 
-  virtual QTextCursor cursor() const;
-  virtual void setCursor(QTextCursor podition);
+  virtual TextPosition cursor() const;
+  virtual void setCursor(TextPosition podition);
   virtual int position() const;
   virtual int length() const;
   virtual int end() const;
   virtual bool isIn(int pos) = 0;
   virtual bool isIn(QPoint pos) = 0;
-  virtual NodeSection* sectionIfIn(QPoint pos) = 0;
+  virtual NodeSection sectionIfIn(QPoint pos) = 0;
+  //! Attaches the node, and the nodes that it holds, to editor and all of
+  //! their positions to map so that they follow the edits recorded in it.
+  //! Positions that already follow map are brought up to date.
+  virtual void attach(const OffsetMap* map, StylesheetView* editor);
 
   enum NodeType type() const;
 
 protected:
-  QTextCursor m_cursor;
+  TextPosition m_cursor;
   enum NodeType m_type = NoType;
-  StylesheetEditor* m_editor = nullptr;
+  StylesheetView* m_editor = nullptr;
   NodeStates m_state = BadNodeState;
+
+  QRect cursorRect(int position) const;
+  QRect cursorRect(const TextPosition& position) const;
+  //! Returns length characters of the document text from position.
+  QString text(int position, int length) const;
 };
 
 QDebug
@@ -66,12 +77,10 @@ operator<<(QDebug debug, const Node& node);
 
 class NamedNode : public Node
 {
-  Q_OBJECT
 public:
   NamedNode(const QString& name,
-            QTextCursor cursor,
-            StylesheetEditor* editor,
-            QObject* parent,
+            TextPosition cursor,
+            StylesheetView* editor,
             enum NodeType type = NoType);
   NamedNode(const NamedNode& other);
   ~NamedNode();
@@ -80,7 +89,7 @@ public:
   int end() const;
   bool isIn(int pos);
   bool isIn(QPoint pos);
-  NodeSection* sectionIfIn(QPoint pos);
+  NodeSection sectionIfIn(QPoint pos);
 
   QString name() const;
   void setName(const QString& value);
@@ -91,11 +100,25 @@ public:
   void setStateFlag(NodeState flag);
   void clearStateFlag(NodeState check);
 
+  //! Returns true if the name is not a keyword and the fuzzy search was
+  //! deferred by the parser.
+  bool isFuzzyPending() const;
+  //! Returns the fuzzy matches for the name from datastore, the search is
+  //! only run the first time that they are needed.
+  QMultiMap<int, QString> fuzzyMatches(DataStore* datastore) const;
+
 protected:
   QString m_name;
 
   virtual int pointWidth(const QString& text) const;
   virtual int pointHeight() const;
+  //! Searches the names of the same kind as this node.
+  virtual QMultiMap<int, QString> fuzzySearch(DataStore* datastore) const;
+  bool hasPendingFuzzyMatch(DataStore* datastore) const;
+
+private:
+  mutable QMultiMap<int, QString> m_fuzzyMatches;
+  mutable bool m_fuzzySearched = false;
 };
 
 QDebug
@@ -103,78 +126,83 @@ operator<<(QDebug debug, const NamedNode& node);
 
 class MarkerBase : public NamedNode
 {
-  Q_OBJECT
 public:
-  MarkerBase(QTextCursor markerCursor,
-             QTextCursor nameCursor,
+  MarkerBase(TextPosition markerCursor,
+             TextPosition nameCursor,
              const QString& name,
-             StylesheetEditor* editor,
-             QObject* parent,
+             StylesheetView* editor,
              enum NodeType type = NoType);
 
-  QTextCursor cursor() const;
-  QTextCursor nameCursor() const;
-  void setCursor(QTextCursor markerCursor);
-  void setNameCursor(QTextCursor cursor);
+  TextPosition cursor() const;
+  TextPosition nameCursor() const;
+  void setCursor(TextPosition markerCursor);
+  void setNameCursor(TextPosition cursor);
 
   QString marker() const;
   int position() const;
   int namePosition() const { return NamedNode::position(); }
 
-  virtual bool isFuzzy() const;
+  virtual bool isFuzzy(DataStore* datastore) const;
 
   int length() const override;
+  void attach(const OffsetMap* map, StylesheetView* editor) override;
 
 protected:
-  QTextCursor m_markerCursor;
+  TextPosition m_markerCursor;
   QString m_marker;
 };
 
 class PseudoState : public MarkerBase
 {
-  Q_OBJECT
 public:
-  PseudoState(QTextCursor markerCursor,
-              QTextCursor nameCursor,
+  PseudoState(TextPosition markerCursor,
+              TextPosition nameCursor,
               const QString& name,
-              StylesheetEditor* editor,
-              QObject* parent,
+              StylesheetView* editor,
               enum NodeType type = PseudoStateType);
 
   bool hasMarker();
-  bool isFuzzy() const override;
+  bool isFuzzy(DataStore* datastore) const override;
   bool isValid() const;
 
   bool isIn(QPoint pos) override;
-  NodeSection* sectionIfIn(QPoint pos) override;
+  NodeSection sectionIfIn(QPoint pos) override;
 
 protected:
   int pointWidth(const QString& text) const override;
+  QMultiMap<int, QString> fuzzySearch(DataStore* datastore) const override;
 };
 
 class ControlBase : public MarkerBase
 {
-  Q_OBJECT
 public:
-  ControlBase(QTextCursor markerCursor,
-              QTextCursor nameCursor,
+  ControlBase(TextPosition markerCursor,
+              TextPosition nameCursor,
               const QString& name,
-              StylesheetEditor* editor,
-              QObject* parent,
+              StylesheetView* editor,
               enum NodeType type = SubControlType);
+  ~ControlBase();
+
+  //! Sub controls and id selectors are both controls.
+  static bool isNodeType(NodeType type)
+  {
+    return type == SubControlType || type == IdSelectorType;
+  }
 
   QList<PseudoState*>* pseudoStates() const;
   bool hasPseudoStates();
-  PseudoState* pseudoState(QTextCursor cursor);
+  PseudoState* pseudoState(TextPosition cursor);
   void addPseudoState(PseudoState* pseudoStates);
   bool hasMarker();
   int length() const;
-  bool isFuzzy() const override;
+  bool isFuzzy(DataStore* datastore) const override;
   virtual bool isValid() const;
-  virtual NodeSection* sectionIfIn(QPoint pos);
+  virtual NodeSection sectionIfIn(QPoint pos);
+  void attach(const OffsetMap* map, StylesheetView* editor) override;
 
 protected:
   int pointWidth(const QString& text) const override;
+  QMultiMap<int, QString> fuzzySearch(DataStore* datastore) const override;
 
 private:
   QList<PseudoState*>* m_pseudoStates = nullptr;
@@ -182,25 +210,21 @@ private:
 
 class SubControl : public ControlBase
 {
-  Q_OBJECT
 public:
-  SubControl(QTextCursor markerCursor,
-             QTextCursor nameCursor,
+  SubControl(TextPosition markerCursor,
+             TextPosition nameCursor,
              const QString& name,
-             StylesheetEditor* editor,
-             QObject* parent,
+             StylesheetView* editor,
              enum NodeType type = IdSelectorType);
 };
 
 class IDSelector : public ControlBase
 {
-  Q_OBJECT
 public:
-  IDSelector(QTextCursor markerCursor,
-             QTextCursor nameCursor,
+  IDSelector(TextPosition markerCursor,
+             TextPosition nameCursor,
              const QString& name,
-             StylesheetEditor* editor,
-             QObject* parent,
+             StylesheetView* editor,
              enum NodeType type = IdSelectorType);
 
   bool isValid() const override;
@@ -210,19 +234,17 @@ class WidgetNodes;
 
 class PropertyNode : public NamedNode
 {
-  Q_FLAGS(PropertyChecks)
-  Q_OBJECT
-
 public:
   explicit PropertyNode(const QString& name,
-                        QTextCursor start,
-                        StylesheetEditor* editor,
+                        TextPosition start,
+                        StylesheetView* editor,
                         enum NodeState check,
-                        QObject* parent,
                         enum NodeType type = PropertyType);
   PropertyNode(const PropertyNode& other);
   ~PropertyNode();
 
+  static bool isNodeType(NodeType type) { return type == PropertyType; }
+
   void setWidgetNodes(WidgetNodes* widget);
   bool hasWidgetNodes();
 
@@ -233,7 +255,7 @@ public:
   //! Sets the value at index if index is valid.
   void setValue(int index, const QString& value);
   //! Adds a complete value/check/offset to the values.
-  void addValue(NodeState check, PropertyStatus* status);
+  void addValue(NodeState check, const PropertyStatusList& statuses);
   QString value(int index);
 
   //! Returns the checks as a list.
@@ -246,14 +268,19 @@ public:
 
   int valuePosition(int index);
   //! Sets the position at index if index is valid.
-  void setValueOffset(int index, QTextCursor offset);
+  void setValueOffset(int index, TextPosition offset);
   void setValueState(int index, PropertyValueState state);
   void setValueName(int index, const QString& name);
+  //! Returns the text of status, or of its section index, from the document.
+  QString statusName(const PropertyStatus* status) const;
+  QString sectionName(const PropertyStatus* status, int index) const;
 
   int valueCount();
 
   //! Returns the attribute types as a list.
   PropertyStatus* valueStatus(int index) const;
+  QRect valueRect(const PropertyStatus* status) const;
+  QRect sectionRect(const PropertyStatus* status, int index) const;
 
   //! Sets the check at index as bad.
   //!
@@ -272,23 +299,26 @@ public:
 
   void setPropertyNameCheck(enum NodeState check);
   bool isValidPropertyName() const;
-  bool isFuzzyName() const;
+  bool isFuzzyName(DataStore* datastore) const;
+  //! Returns true if nothing but whitespace follows the property, which is
+  //! set by the parser.
   bool isFinalProperty();
+  void setFinalProperty(bool finalProperty);
   bool isValid(bool finalProperty = false);
 
   bool hasPropertyMarker() const;
   void setPropertyMarker(bool exists);
-  QTextCursor propertyMarkerCursor() const;
+  TextPosition propertyMarkerCursor() const;
   int propertyMarkerPosition() const;
-  void setPropertyMarkerCursor(QTextCursor position);
+  void setPropertyMarkerCursor(TextPosition position);
 
   bool hasPropertyEndMarker() const;
   void setPropertyEndMarker(bool exists);
-  QTextCursor propertyEndMarkerCursor() const;
+  TextPosition propertyEndMarkerCursor() const;
   int propertyEndMarkerPosition() const;
-  void setPropertyEndMarkerCursor(QTextCursor position);
+  void setPropertyEndMarkerCursor(TextPosition position);
 
-  NodeSection* sectionIfIn(QPoint pos) override;
+  NodeSection sectionIfIn(QPoint pos) override;
   QList<PartialType> sectionIfIn(int start, int end);
 
   int indexOf(const QString& name) const;
@@ -300,36 +330,46 @@ public:
   int maxCount() const;
   void setMaxCount(int maxCount);
 
+  void attach(const OffsetMap* map, StylesheetView* editor) override;
+
 protected:
-  QList<NodeState> m_checks;
-  QList<PropertyStatus*> m_valueStatus;
+  //! A value of the property with its check, its statuses are held from
+  //! first in m_statuses.
+  struct Value
+  {
+    NodeState check;
+    int first;
+  };
+  QVarLengthArray<Value, 4> m_values;
+  // the status records of all of the values one after the other, held
+  // inline for the usual one or two and freed with the property. Mutable as
+  // valueStatus() hands them out from const methods.
+  mutable QVarLengthArray<PropertyStatus, 2> m_statuses;
 
   NodeStates m_propertyState = NodeState::BadNodeState;
-  QTextCursor m_propertyMarkerCursor;
-  QTextCursor m_endMarkerCursor;
+  TextPosition m_propertyMarkerCursor;
+  TextPosition m_endMarkerCursor;
   WidgetNodes* m_widgetnodes = nullptr;
   bool m_isFinalProperty = false;
   int m_minCount = 1;
   int m_maxCount = 1;
+
+  QMultiMap<int, QString> fuzzySearch(DataStore* datastore) const override;
 };
 
 class NewlineNode : public NamedNode
 {
-  Q_OBJECT
 public:
-  explicit NewlineNode(QTextCursor start,
-                       StylesheetEditor* editor,
-                       QObject* parent = nullptr,
+  explicit NewlineNode(TextPosition start,
+                       StylesheetView* editor,
                        enum NodeType type = NewlineType);
 };
 
 class CommentNode : public Node
 {
-  Q_OBJECT
 public:
-  explicit CommentNode(QTextCursor start,
-                       StylesheetEditor* editor,
-                       QObject* parent = nullptr,
+  explicit CommentNode(TextPosition start,
+                       StylesheetView* editor,
                        enum NodeType type = CommentType);
   CommentNode(const CommentNode& other);
   ~CommentNode();
@@ -338,72 +378,76 @@ public:
   void append(QString text);
   int end() const override;
   int length() const override;
-  QTextCursor textCursor() const;
-  void setTextCursor(QTextCursor cursor);
+  TextPosition textCursor() const;
+  void setTextCursor(TextPosition cursor);
   int textPosition() const;
 
   bool hasEndComment() const;
   void setEndCommentExists(bool exists);
-  QTextCursor endCommentCursor() const;
-  void setEndCommentCursor(QTextCursor cursor);
+  TextPosition endCommentCursor() const;
+  void setEndCommentCursor(TextPosition cursor);
 
-  NodeSection* sectionIfIn(QPoint pos) override;
+  NodeSection sectionIfIn(QPoint pos) override;
   bool isIn(int pos) override { return false; }
   bool isIn(QPoint pos) override { return false; }
+  void attach(const OffsetMap* map, StylesheetView* editor) override;
+
+  static bool isNodeType(NodeType type) { return type == CommentType; }
 
 private:
   bool m_validComment = true;
-  QTextCursor m_textCursor;
+  TextPosition m_textCursor;
   bool m_endCommentExists = false;
-  QTextCursor m_endCursor;
+  TextPosition m_endCursor;
   QString m_text;
 };
 
 class WidgetNode : public NamedNode
 {
-  Q_OBJECT
 public:
   explicit WidgetNode(const QString& name,
-                      QTextCursor start,
-                      StylesheetEditor* editor,
+                      TextPosition start,
+                      StylesheetView* editor,
                       NodeState check,
-                      QObject* parent,
                       enum NodeType type = WidgetType);
   WidgetNode(const WidgetNode& other);
   ~WidgetNode();
 
+  static bool isNodeType(NodeType type) { return type == WidgetType; }
+
   int length() const override;
 
   bool isValid() const;
   bool isNameValid() const;
-  bool isNameFuzzy() const;
+  bool isNameFuzzy(DataStore* datastore) const;
   //! \note Only changes widgetcheck or fuzzywidgetcheck.
   void setWidgetCheck(NodeState type);
 
   bool isIn(QPoint pos) override;
-  NodeSection* sectionIfIn(QPoint pos) override;
+  NodeSection sectionIfIn(QPoint pos) override;
 
   QList<SubControl*>* subControls();
   SubControl* subControl(QPoint pos) const;
-  SubControl* subControl(QTextCursor cursor) const;
+  SubControl* subControl(TextPosition cursor) const;
   bool hasSubControls() const;
   void addSubControl(SubControl* control);
 
+  QList<PseudoState*>* pseudoStates() const;
   void addPseudoState(PseudoState* state);
   bool hasPseudoStates();
 
   PseudoState* pseudoState(QPoint pos) const;
-  PseudoState* pseudoState(QTextCursor cursor) const;
-  void setSubControlMarkerCursor(QTextCursor cursor);
-  void setPseudoStateMarkerCursor(QTextCursor cursor);
+  PseudoState* pseudoState(TextPosition cursor) const;
+  void setSubControlMarkerCursor(TextPosition cursor);
+  void setPseudoStateMarkerCursor(TextPosition cursor);
 
   IDSelector* idSelector();
   void setIdSelector(IDSelector* selector);
   bool hasIdSelector();
 
   bool isSubControlValid(QPoint pos) const;
-  bool isSubControlFuzzy(QTextCursor cursor) const;
-  bool isSubControlFuzzy(QPoint pos) const;
+  bool isSubControlFuzzy(TextPosition cursor, DataStore* datastore) const;
+  bool isSubControlFuzzy(QPoint pos, DataStore* datastore) const;
   bool isSubControlBad(QPoint pos) const;
   bool isSubControl() const;
   bool isPseudoState() const;
@@ -413,33 +457,36 @@ public:
   bool doMarkersMatch() const;
   bool isExtensionMarkerCorrect();
 
+  void attach(const OffsetMap* map, StylesheetView* editor) override;
+
 protected:
   QList<SubControl*>* m_subcontrols = nullptr;
   QList<PseudoState*>* m_pseudoStates = nullptr;
   IDSelector* m_idSelector = nullptr;
+
+  QMultiMap<int, QString> fuzzySearch(DataStore* datastore) const override;
 };
 
 class WidgetNodes : public Node
 {
-  Q_OBJECT
 public:
-  explicit WidgetNodes(QTextCursor cursor,
-                       StylesheetEditor* editor,
-                       QObject* parent)
-    : Node(cursor, editor, parent, WidgetsType)
+  explicit WidgetNodes(TextPosition cursor, StylesheetView* editor)
+    : Node(cursor, editor, WidgetsType)
   {}
 
+  static bool isNodeType(NodeType type) { return type == WidgetsType; }
+
   void addWidget(WidgetNode* widget) { m_widgets.append(widget); }
   QList<WidgetNode*> widgets() { return m_widgets; }
 
   bool hasStartBrace() const;
-  void setStartBraceCursor(QTextCursor cursor);
-  QTextCursor startBraceCursor() const;
+  void setStartBraceCursor(TextPosition cursor);
+  TextPosition startBraceCursor() const;
   int startBracePosition() const;
   void removeStartBrace();
   bool hasEndBrace() const;
-  void setEndBraceCursor(QTextCursor cursor);
-  QTextCursor endBraceCursor() const;
+  void setEndBraceCursor(TextPosition cursor);
+  TextPosition endBraceCursor() const;
   int endBracePosition() const;
   void removeEndBrace();
   bool hasMatchingBraces() const;
@@ -450,24 +497,80 @@ public:
   bool arePropertiesValid() const;
   bool isFinalProperty(PropertyNode* property) const;
 
-  void addSeperatorCursor(QTextCursor cursor);
-  QList<QTextCursor> seperators();
+  void addSeperatorCursor(TextPosition cursor);
+  QList<TextPosition> seperators();
 
   int length() const;
   int end() const;
   bool isIn(int pos);
   bool isIn(QPoint pos);
-  NodeSection* sectionIfIn(QPoint pos);
+  NodeSection sectionIfIn(QPoint pos);
+  void attach(const OffsetMap* map, StylesheetView* editor) override;
 
 protected:
   QList<WidgetNode*> m_widgets;
-  QTextCursor m_startBracePosition;
-  QTextCursor m_endBracePosition;
+  TextPosition m_startBracePosition;
+  TextPosition m_endBracePosition;
   QList<PropertyNode*> m_properties;
-  QList<QTextCursor> m_widgetSeperators;
+  QList<TextPosition> m_widgetSeperators;
 
   bool isInStartBrace(QPoint pos);
   bool isInEndBrace(QPoint pos);
 };
 
+//! Returns node as a T if its NodeType tag matches T, otherwise nullptr.
+template<class T>
+T*
+node_cast(Node* node)
+{
+  if (node && T::isNodeType(node->type())) {
+    return static_cast<T*>(node);
+  }
+  return nullptr;
+}
+
+//! Owns all of the nodes created by one parse generation.
+//!
+//! Nodes are constructed in place in large memory blocks and are all
+//! destroyed together when the arena is deleted. Nodes replaced by an
+//! incremental reparse are only marked as released, their memory is reclaimed
+//! with the rest of the generation.
+class NodeArena
+{
+public:
+  NodeArena() = default;
+  NodeArena(const NodeArena&) = delete;
+  NodeArena& operator=(const NodeArena&) = delete;
+  ~NodeArena();
+
+  template<class T, class... Args>
+  T* create(Args&&... args)
+  {
+    auto node =
+      new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    m_nodes.append(node);
+    return node;
+  }
+
+  //! Marks the node, and every node that it holds, as no longer used by the
+  //! node map. A node is only counted once however often it is released.
+  void release(Node* node);
+  //! Takes over the nodes and memory of other, leaving it empty.
+  void adopt(NodeArena* other);
+
+  int liveCount() const;
+  int releasedCount() const;
+
+private:
+  static const size_t BLOCK_SIZE = 32768;
+
+  QList<char*> m_blocks;
+  char* m_next = nullptr;
+  size_t m_remaining = 0;
+  QVector<Node*> m_nodes;
+  QSet<const Node*> m_released;
+
+  void* allocate(size_t size, size_t align);
+};
+
 #endif // NODE_H
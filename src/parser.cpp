@@ -23,29 +23,14 @@
 
 #include "datastore.h"
 #include "node.h"
-#include "stylesheetedit_p.h"
+#include "scanner.h"
+#include "stylesheetview.h"
 
-#include <QGridLayout>
-#include <QLabel>
-#include <QWidgetAction>
+#include <QTextDocument>
+#include <QtConcurrent>
 #include <QtDebug>
 
-IconLabel::IconLabel(const QIcon& icon, const QString& text, QWidget* parent)
-  : QWidget(parent)
-{
-  auto layout = new QGridLayout;
-  //  setContentsMargins(0, 0, 0, 0);
-  //  layout->setContentsMargins(0, 0, 0, 0);
-  setLayout(layout);
-  auto iconLbl = new QLabel(this);
-  auto pix = icon.pixmap(QSize(16, 16));
-  iconLbl->setPixmap(pix);
-  layout->addWidget(iconLbl, 0, 0);
-  auto textLbl = new QLabel(text, this);
-  layout->addWidget(textLbl, 0, 1);
-}
-
-Parser::Parser(DataStore* datastore, StylesheetEditor* editor, QObject* parent)
+Parser::Parser(DataStore* datastore, StylesheetView* editor, QObject* parent)
   : QObject(parent)
   , m_editor(editor)
   , m_datastore(datastore)
@@ -62,6 +47,11 @@ Parser::Parser(const Parser& /*other*/)
 Parser::~Parser()
 {
   //  delete d_ptr;
+  if (m_parseThread) {
+    m_parseRevision.storeRelease(-1);
+    m_parseThread->quit();
+    m_parseThread->wait();
+  }
   emit finished();
 }
 
@@ -84,12 +74,14 @@ Parser::checkType(int start,
                   enum NodeState lastState,
                   PropertyNode* property) const
 {
+  auto keywords = m_datastore->keywordTypes(block);
+
   if (lastState == IdSelectorMarkerState) {
     return qMakePair<NodeType, NodeState>(NodeType::IdSelectorType,
                                           NodeState::IdSelectorState);
   } else if (lastState == SubControlState) {
-    if (m_datastore->containsProperty(block) &&
-        m_datastore->containsSubControl(block)) {
+    if (keywords.testFlag(PropertyKeyword) &&
+        keywords.testFlag(SubControlKeyword)) {
       // this is a special case, the only case I know is icon which can be
       // both a property value AND a SubControl.
       return qMakePair<NodeType, NodeState>(NodeType::SubControlType,
@@ -115,16 +107,16 @@ Parser::checkType(int start,
     }
   }
 
-  if (m_datastore->containsWidget(block)) {
+  if (keywords.testFlag(WidgetKeyword)) {
     return qMakePair<NodeType, NodeState>(NodeType::WidgetType,
                                           NodeState::WidgetState);
-  } else if (m_datastore->containsProperty(block)) {
+  } else if (keywords.testFlag(PropertyKeyword)) {
     return qMakePair<NodeType, NodeState>(NodeType::PropertyType,
                                           NodeState::ValidNameState);
-  } else if (m_datastore->containsPseudoState(block)) {
+  } else if (keywords.testFlag(PseudoStateKeyword)) {
     return qMakePair<NodeType, NodeState>(NodeType::PseudoStateType,
                                           NodeState::PseudostateState);
-  } else if (m_datastore->containsSubControl(block)) {
+  } else if (keywords.testFlag(SubControlKeyword)) {
     return qMakePair<NodeType, NodeState>(NodeType::SubControlType,
                                           NodeState::SubControlState);
   } else if (block == ",") {
@@ -151,6 +143,12 @@ Parser::checkType(int start,
   } else if (block == "\n") {
     return qMakePair<NodeType, NodeState>(NodeType::NewlineType,
                                           NodeState::NewLineState);
+  } else if (m_lazyFuzzySearch) {
+    // the caller decides the type, the fuzzy search is left to the node.
+    if (block.at(0).isLetter() || block.at(0) == '-' || block.at(0) == '_') {
+      return qMakePair<NodeType, NodeState>(NodeType::NoType,
+                                            NodeState::FuzzyPendingState);
+    }
   } else {
     QMultiMap<int, QString> possibilities;
     if (property) {
@@ -181,15 +179,182 @@ Parser::checkType(int start,
                                         NodeState::BadNodeState);
 }
 
-QMap<QTextCursor, Node*>
+//! Chooses the node type for a name that is not a keyword from where it
+//! sits, without a fuzzy search.
+NodeType
+Parser::pendingType(const QString& text, int start, bool inRule) const
+{
+  int previous = start - 1;
+  while (previous >= 0 && text.at(previous).isSpace()) {
+    previous--;
+  }
+
+  if (previous >= 0 && text.at(previous) == ':') {
+    if (previous > 0 && text.at(previous - 1) == ':') {
+      return NodeType::SubControlType;
+    }
+    // within a rule this is a value of a property that was not recognised.
+    return (inRule ? NodeType::NoType : NodeType::PseudoStateType);
+  }
+
+  if (inRule) {
+    return NodeType::PropertyType;
+  }
+
+  // outside of a rule a name followed by a value is a property.
+  int pos = start;
+  m_datastore->nextToken(text, pos, m_showLineMarkers);
+  auto token = m_datastore->nextToken(text, pos, m_showLineMarkers);
+  if (token.view(text) == QLatin1String(":")) {
+    token = m_datastore->nextToken(text, pos, m_showLineMarkers);
+    if (!m_datastore->containsPseudoState(token.toString(text))) {
+      return NodeType::PropertyType;
+    }
+  }
+
+  return NodeType::WidgetType;
+}
+
+QMap<TextPosition, Node*>
 Parser::parseText(const QString& text)
+{
+  if (m_parallelParse && text.length() >= 2 * MIN_PARALLEL_CHUNK) {
+    return parallelParseText(text);
+  }
+
+  int pos = 0;
+  return parseText(text, pos, -1);
+}
+
+//! Finds the end of each top level rule, ie the position after the '}' that
+//! closes it. Comments are skipped, quoted and bracketed values are single
+//! tokens so any braces within them are not counted.
+QList<int>
+Parser::ruleBoundaries(const QString& text) const
+{
+  QList<int> boundaries;
+  int depth = 0;
+  int pos = 0;
+
+  while (true) {
+    auto token = m_datastore->nextToken(text, pos);
+    if (token.isEmpty()) {
+      break;
+    }
+
+    auto view = token.view(text);
+    if (token.kind == Token::CommentStart) {
+      auto end = Scanner::findCommentEnd(text, pos);
+      pos = (end < 0 ? text.length() : end + 2);
+    } else if (view == QLatin1String("{")) {
+      depth++;
+    } else if (view == QLatin1String("}") && depth > 0) {
+      if (--depth == 0) {
+        boundaries.append(pos);
+      }
+    }
+  }
+  return boundaries;
+}
+
+//! Splits the text into chunks of whole top level rules which are parsed on
+//! the global thread pool, each by its own worker parser and arena. The
+//! chunks are merged in document order.
+//!
+//! The workers only share the datastore, whose widget model is read under
+//! its read lock. They have no editor and their positions are not attached
+//! to the edit map, both are attached once the nodes are back on the thread
+//! that owns them, see attachNodes().
+//!
+//! A chunk must stop exactly at the boundary where the next one starts,
+//! otherwise the sequential parser would not have split the text there and
+//! the text is parsed sequentially instead.
+QMap<TextPosition, Node*>
+Parser::parallelParseText(const QString& text)
+{
+  struct Chunk
+  {
+    int start;
+    int end;
+    int pos;
+    Parser* parser;
+    QMap<TextPosition, Node*> nodes;
+  };
+
+  auto chunkSize = qMax(MIN_PARALLEL_CHUNK,
+                        text.length() / (QThread::idealThreadCount() * 4));
+  QVector<Chunk> chunks;
+  int start = 0;
+  for (auto boundary : ruleBoundaries(text)) {
+    if (boundary - start >= chunkSize && boundary < text.length()) {
+      chunks.append({ start, boundary, start, nullptr, {} });
+      start = boundary;
+    }
+  }
+
+  if (chunks.isEmpty()) {
+    int pos = 0;
+    return parseText(text, pos, -1);
+  }
+  chunks.append({ start, -1, start, nullptr, {} });
+
+  for (auto& chunk : chunks) {
+    auto parser = new Parser(m_datastore, nullptr);
+    parser->m_showLineMarkers = m_showLineMarkers;
+    parser->m_lazyFuzzySearch = m_lazyFuzzySearch;
+    parser->m_owner = m_owner;
+    parser->m_revision = m_revision;
+    parser->m_followsNodes = (chunk.start > 0);
+    parser->m_arena = std::make_shared<NodeArena>();
+    chunk.parser = parser;
+  }
+
+  QtConcurrent::blockingMap(chunks, [&text](Chunk& chunk) {
+    chunk.nodes = chunk.parser->parseText(text, chunk.pos, chunk.end);
+  });
+
+  auto split = std::all_of(chunks.cbegin(), chunks.cend(), [](auto& chunk) {
+    return (chunk.end < 0 || chunk.pos == chunk.end);
+  });
+
+  QMap<TextPosition, Node*> nodes;
+  for (auto& chunk : chunks) {
+    if (split) {
+      m_arena->adopt(chunk.parser->m_arena.get());
+      for (auto [key, node] : asKeyValueRange(chunk.nodes)) {
+        nodes.insert(key, node);
+      }
+    }
+    // the worker deletes its arena, which is empty if it was adopted.
+    delete chunk.parser;
+  }
+
+  if (!split && !isParseCancelled()) {
+    int pos = 0;
+    return parseText(text, pos, -1);
+  }
+
+  // a background parse attaches the nodes when they are installed.
+  if (QThread::currentThread() == m_datastore->thread()) {
+    attachNodes(nodes);
+  }
+  return nodes;
+}
+
+//! Parses the text from pos, stopping at the first top level node that
+//! starts at or after end. If end is -1 then the text is parsed to the end.
+QMap<TextPosition, Node*>
+Parser::parseText(const QString& text, int& pos, int end)
 {
   QString block;
   int start;
-  int pos = 0;
-  QMap<QTextCursor, Node*> nodes;
+  QMap<TextPosition, Node*> nodes;
 
   while (true) {
+    if ((end >= 0 && pos >= end) || isParseCancelled()) {
+      break;
+    }
+
     if ((block = m_datastore->findNext(text, pos, m_showLineMarkers))
           .isEmpty()) {
       break;
@@ -198,22 +363,29 @@ Parser::parseText(const QString& text)
     //    qDebug() << block;
 
     start = pos - block.length();
-    QTextCursor cursor;
+    TextPosition cursor;
 
     NodeState lastState = BadNodeState;
     auto [type, state] = checkType(start, block, lastState);
     WidgetNodes* widgetnodes = nullptr;
+    // the widget list is created with the first widget that it holds.
+    auto addWidget = [&](WidgetNode* widget, TextPosition position) {
+      if (!widgetnodes) {
+        widgetnodes = m_arena->create<WidgetNodes>(position, m_editor);
+        nodes.insert(position, widgetnodes);
+      }
+      widgetnodes->addWidget(widget);
+    };
+    if (state == FuzzyPendingState) {
+      type = pendingType(text, start, false);
+    }
 
     switch (type) {
       case NodeType::WidgetType: {
-        cursor = m_datastore->getCursorForPosition(start);
-        if (!widgetnodes) {
-          widgetnodes = new WidgetNodes(cursor, m_editor, this);
-          nodes.insert(cursor, widgetnodes);
-        }
-
-        auto widget = new WidgetNode(block, cursor, m_editor, state, this);
-        widgetnodes->addWidget(widget);
+        cursor = m_datastore->textPosition(start);
+        auto widget =
+          m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+        addWidget(widget, cursor);
         SubControl* subcontrol = nullptr;
         PseudoState* pseudostate = nullptr;
         IDSelector* idselector = nullptr;
@@ -221,9 +393,12 @@ Parser::parseText(const QString& text)
         while (!(block = m_datastore->findNext(text, pos, m_showLineMarkers))
                   .isEmpty()) {
           start = pos - block.length();
-          cursor = m_datastore->getCursorForPosition(start);
+          cursor = m_datastore->textPosition(start);
 
           auto [type, state] = checkType(start, block, lastState);
+          if (state == FuzzyPendingState) {
+            type = pendingType(text, start, widgetnodes->hasStartBrace());
+          }
           if (type == NodeType::ColonType) {
             // a single colon could be either a pseudo state marker or a
             // property marker. if a property is detected then it should be
@@ -235,8 +410,9 @@ Parser::parseText(const QString& text)
             case NodeType::WidgetType: {
               // if we find another widget than accept that the previous one is
               // incomplete.
-              widget = new WidgetNode(block, cursor, m_editor, state, this);
-              widgetnodes->addWidget(widget);
+              widget =
+                m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+              addWidget(widget, cursor);
               subcontrol = nullptr;
               pseudostate = nullptr;
               idselector = nullptr;
@@ -245,7 +421,7 @@ Parser::parseText(const QString& text)
             }
             case NodeType::PropertyType: {
               PropertyNode* property =
-                new PropertyNode(block, cursor, m_editor, state, this);
+                m_arena->create<PropertyNode>(block, cursor, m_editor, state);
               property->setWidgetNodes(widgetnodes);
               widgetnodes->addProperty(property);
               parsePropertyWithValues(
@@ -255,8 +431,8 @@ Parser::parseText(const QString& text)
             }
             case NodeType::SubControlMarkerType:
               if (!widget->hasSubControl()) {
-                subcontrol = new SubControl(
-                  cursor, QTextCursor(), QString(), m_editor, this);
+                subcontrol = m_arena->create<SubControl>(
+                  cursor, TextPosition(), QString(), m_editor);
               } else {
                 subcontrol = widget->subControl(cursor);
                 subcontrol->setCursor(cursor);
@@ -293,8 +469,8 @@ Parser::parseText(const QString& text)
                     }
                   } else {
                     qWarning();
-                    subcontrol = new SubControl(
-                      QTextCursor(), cursor, QString(), m_editor, this);
+                    subcontrol = m_arena->create<SubControl>(
+                      TextPosition(), cursor, QString(), m_editor);
                   }
                 } else {
                   // TODO
@@ -307,13 +483,13 @@ Parser::parseText(const QString& text)
               if (lastState == IdSelectorState) {
                 idselector = widget->idSelector();
                 if (!idselector) {
-                  idselector = new IDSelector(
-                    cursor, QTextCursor(), QString(), m_editor, this);
+                  idselector = m_arena->create<IDSelector>(
+                    cursor, TextPosition(), QString(), m_editor);
                 }
                 pseudostate = idselector->pseudoState(cursor);
                 if (!pseudostate) {
-                  pseudostate = new PseudoState(
-                    cursor, QTextCursor(), QString(), m_editor, this);
+                  pseudostate = m_arena->create<PseudoState>(
+                    cursor, TextPosition(), QString(), m_editor);
                 }
                 idselector->addPseudoState(pseudostate);
               } else if (lastState == SubControlState) {
@@ -324,16 +500,16 @@ Parser::parseText(const QString& text)
                 }
                 pseudostate = subcontrol->pseudoState(cursor);
                 if (!pseudostate) {
-                  pseudostate = new PseudoState(
-                    cursor, QTextCursor(), QString(), m_editor, this);
+                  pseudostate = m_arena->create<PseudoState>(
+                    cursor, TextPosition(), QString(), m_editor);
                 }
                 subcontrol->addPseudoState(pseudostate);
               }
               break;
             case NodeType::PseudoStateType:
               if (!pseudostate) {
-                pseudostate =
-                  new PseudoState(cursor, QTextCursor(), block, m_editor, this);
+                pseudostate = m_arena->create<PseudoState>(
+                  cursor, TextPosition(), block, m_editor);
               }
               pseudostate->setNameCursor(cursor);
               pseudostate->setName(block);
@@ -345,6 +521,8 @@ Parser::parseText(const QString& text)
               } else {
                 // TODO pseudostate not on subcontrol.
                 qWarning();
+                // nothing holds it so it is not in use by the node map.
+                m_arena->release(pseudostate);
               }
               pseudostate = nullptr; // finished with pseudostate.
               lastState = state;
@@ -352,16 +530,16 @@ Parser::parseText(const QString& text)
             case NodeType::IdSelectorMarkerType:
               idselector = widget->idSelector();
               if (!idselector) {
-                idselector = new IDSelector(
-                  cursor, QTextCursor(), QString(), m_editor, this);
+                idselector = m_arena->create<IDSelector>(
+                  cursor, TextPosition(), QString(), m_editor);
               }
               widget->setIdSelector(idselector);
               lastState = state;
               continue;
             case NodeType::IdSelectorType:
               if (!idselector) {
-                idselector = new IDSelector(
-                  cursor, QTextCursor(), QString(), m_editor, this);
+                idselector = m_arena->create<IDSelector>(
+                  cursor, TextPosition(), QString(), m_editor);
               }
               idselector->setNameCursor(cursor);
               idselector->setName(block);
@@ -405,9 +583,9 @@ Parser::parseText(const QString& text)
         continue;
       }
       case NodeType::PropertyType: {
-        cursor = m_datastore->getCursorForPosition(start);
+        cursor = m_datastore->textPosition(start);
         PropertyNode* property =
-          new PropertyNode(block, cursor, m_editor, state, this);
+          m_arena->create<PropertyNode>(block, cursor, m_editor, state);
         auto counts = m_datastore->attributeCounts(block);
         if (counts.first != -1) {
           property->setMinCount(counts.first);
@@ -426,7 +604,7 @@ Parser::parseText(const QString& text)
       default:
         QString nextBlock;
 
-        if (nodes.isEmpty()) {
+        if (nodes.isEmpty() && !m_followsNodes) {
           auto oldPos = pos;
           nextBlock = m_datastore->findNext(text, pos, m_showLineMarkers);
 
@@ -435,20 +613,20 @@ Parser::parseText(const QString& text)
             nextBlock = m_datastore->findNext(text, pos, m_showLineMarkers);
 
             if (m_datastore->containsPseudoState(nextBlock)) {
-              cursor = m_datastore->getCursorForPosition(start);
+              cursor = m_datastore->textPosition(start);
               auto widget =
-                new WidgetNode(block, cursor, m_editor, state, this);
-              widgetnodes->addWidget(widget);
+                m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+              addWidget(widget, cursor);
               continue;
 
             } else if (m_datastore->propertyValueAttribute(nextBlock) !=
                        NoAttributeValue) {
-              cursor = m_datastore->getCursorForPosition(start);
+              cursor = m_datastore->textPosition(start);
               PropertyNode* property =
-                new PropertyNode(block, cursor, m_editor, state, this);
+                m_arena->create<PropertyNode>(block, cursor, m_editor, state);
               property->setPropertyMarker(true);
               property->setPropertyMarkerCursor(
-                m_datastore->getCursorForPosition(colonPos));
+                m_datastore->textPosition(colonPos));
               nodes.insert(cursor, property);
               pos -= block.length(); // step back
               parsePropertyWithValues(
@@ -460,11 +638,11 @@ Parser::parseText(const QString& text)
             nextBlock = m_datastore->findNext(text, pos, m_showLineMarkers);
 
             if (m_datastore->containsSubControl(nextBlock)) {
-              cursor = m_datastore->getCursorForPosition(start);
+              cursor = m_datastore->textPosition(start);
               auto widget =
-                new WidgetNode(block, cursor, m_editor, state, this);
-              widgetnodes->addWidget(widget);
-              if (!widget->isSubControlFuzzy(cursor)) {
+                m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+              addWidget(widget, cursor);
+              if (!widget->isSubControlFuzzy(cursor, m_datastore)) {
                 if (!m_datastore->isValidSubControlForWidget(nextBlock,
                                                              widget->name())) {
                   widget->setWidgetCheck(
@@ -476,9 +654,10 @@ Parser::parseText(const QString& text)
           }
           // step back
           pos = oldPos;
-          cursor = m_datastore->getCursorForPosition(start);
-          auto widget = new WidgetNode(block, cursor, m_editor, state, this);
-          widgetnodes->addWidget(widget);
+          cursor = m_datastore->textPosition(start);
+          auto widget =
+            m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+          addWidget(widget, cursor);
         } else { // anomalous type - see what comes next.
           int oldPos = pos;
           nextBlock = m_datastore->findNext(text, pos, m_showLineMarkers);
@@ -487,20 +666,20 @@ Parser::parseText(const QString& text)
             nextBlock = m_datastore->findNext(text, pos, m_showLineMarkers);
 
             if (m_datastore->containsPseudoState(nextBlock)) {
-              cursor = m_datastore->getCursorForPosition(start);
+              cursor = m_datastore->textPosition(start);
               auto widget =
-                new WidgetNode(block, cursor, m_editor, state, this);
-              widgetnodes->addWidget(widget);
+                m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+              addWidget(widget, cursor);
               continue;
 
             } else if (m_datastore->propertyValueAttribute(nextBlock) !=
                        NoAttributeValue) {
-              cursor = m_datastore->getCursorForPosition(start);
+              cursor = m_datastore->textPosition(start);
               PropertyNode* property =
-                new PropertyNode(block, cursor, m_editor, state, this);
+                m_arena->create<PropertyNode>(block, cursor, m_editor, state);
               property->setPropertyMarker(true);
               property->setPropertyMarkerCursor(
-                m_datastore->getCursorForPosition(oldPos));
+                m_datastore->textPosition(oldPos));
               nodes.insert(cursor, property);
               pos -= block.length(); // step back
               parsePropertyWithValues(
@@ -512,10 +691,10 @@ Parser::parseText(const QString& text)
             nextBlock = m_datastore->findNext(text, pos, m_showLineMarkers);
 
             if (m_datastore->containsSubControl(nextBlock)) {
-              cursor = m_datastore->getCursorForPosition(start);
+              cursor = m_datastore->textPosition(start);
               auto widget =
-                new WidgetNode(block, cursor, m_editor, state, this);
-              widgetnodes->addWidget(widget);
+                m_arena->create<WidgetNode>(block, cursor, m_editor, state);
+              addWidget(widget, cursor);
               continue;
             }
           }
@@ -526,61 +705,94 @@ Parser::parseText(const QString& text)
   return nodes;
 }
 
+//! Every node is new so the caller is responsible for highlighting the
+//! whole document. A background parse only rehighlights the blocks that
+//! hold nodes once it is installed.
 void
 Parser::parseInitialText(const QString& text)
 {
+  // the edits that follow are applied to this by updateText().
+  m_text = text;
+
+  // the background parse tracks the revision of the editor document.
+  if (m_backgroundParse && m_editor) {
+    // the old nodes do not belong to the new text.
+    m_datastore->clearNodes();
+    startBackgroundParse(text);
+    return;
+  }
+
   m_datastore->setBraceCount(0);
   m_datastore->clearNodes();
+  m_datastore->clearEdits();
 
-  QMap<QTextCursor, Node*> nodes = parseText(text);
-  m_datastore->setNodes(nodes);
+  retireArena(m_arena);
+  m_arena = std::make_shared<NodeArena>();
+  QMap<TextPosition, Node*> nodes = parseText(text);
+  m_datastore->setNodes(nodes, m_arena);
 
   emit parseComplete();
 }
 
+const QString&
+Parser::text() const
+{
+  return m_text;
+}
+
 void
-Parser::parsePropertyWithValues(QMap<QTextCursor, Node*>* nodes,
+Parser::parsePropertyWithValues(QMap<TextPosition, Node*>* nodes,
                                 PropertyNode* property,
                                 const QString& text,
                                 int start,
                                 int& pos)
 {
-  QString block;
+  Token token;
   bool hash = false;
   if (property->isValidPropertyName()) {
     QString propertyName = property->name();
-    while (!(block = m_datastore->findNext(text, pos, m_showLineMarkers))
+    while (!(token = m_datastore->nextToken(text, pos, m_showLineMarkers))
               .isEmpty()) {
+      // punctuation is checked in place, only values need their own string.
+      auto view = token.view(text);
+      QString block;
+      PropertyStatusList valueStatus;
       if (hash) {
-        block.prepend("#");
+        block = "#" + token.toString(text);
         hash = false;
-      }
-      PropertyStatus* valueStatus = nullptr;
-      if (block == ":") {
+      } else if (view == QLatin1String(":")) {
         if (!property->hasPropertyMarker()) {
           property->setPropertyMarker(true);
           property->setPropertyMarkerCursor(
-            m_datastore->getCursorForPosition(pos - 1));
+            m_datastore->textPosition(pos - 1));
         } else {
           /*TODO error too many :*/
         }
-      } else if (block == "#") {
+        continue;
+      } else if (view == QLatin1String("#")) {
         // if in valid property this is probably a color #
         hash = true;
-      } else if (block == "/*") {
+        continue;
+      } else if (token.kind == Token::CommentStart) {
         parseComment(nodes, text, start, pos);
-      } else if (block == "\n") {
+        continue;
+      } else if (token.kind == Token::Newline) {
         stashNewline(nodes, pos++);
-      } else if (block == ";") {
+        continue;
+      } else if (view == QLatin1String(";")) {
         property->setPropertyEndMarker(true);
         property->setPropertyEndMarkerCursor(
-          m_datastore->getCursorForPosition(pos - 1));
+          m_datastore->textPosition(pos - 1));
         break;
-      } else if (block == "}") {
-        m_datastore->stepBack(pos, block);
+      } else if (view == QLatin1String("}")) {
+        pos = token.offset; // step back
         break;
-      } else if ((valueStatus = m_datastore->isValidPropertyValueForProperty(
-                    propertyName, pos, block))) {
+      } else {
+        block = token.toString(text);
+      }
+
+      if ((valueStatus = m_datastore->isValidPropertyValueForProperty(
+             propertyName, pos, block))) {
         // some properties (ie bottom) can be BOTH a property and a value
         // so check if it is a possible value FIRST before assuming
         // that it is a following property.
@@ -597,70 +809,122 @@ Parser::parsePropertyWithValues(QMap<QTextCursor, Node*>* nodes,
        }*/
     }
   }
+
+  property->setFinalProperty(isBlankAfter(text, property->end()));
+}
+
+//! Returns true if there is only whitespace after position.
+bool
+Parser::isBlankAfter(const QString& text, int position) const
+{
+  m_datastore->skipBlanks(text, position);
+  return (position >= text.length());
+}
+
+//! Text added after the last property of the stylesheet changes whether it
+//! is final without the property being reparsed. Only the last node can be
+//! a final property so this is called for the last node before and after
+//! an edit.
+//! Returns the property if its final state has changed, otherwise nullptr.
+PropertyNode*
+Parser::updateFinalProperty(const QString& text, Node* node)
+{
+  auto property = node_cast<PropertyNode>(node);
+  if (!property) {
+    return nullptr;
+  }
+  auto isFinal = isBlankAfter(text, property->end());
+  if (isFinal == property->isFinalProperty()) {
+    return nullptr;
+  }
+  property->setFinalProperty(isFinal);
+  return property;
+}
+
+//! Applies an edit to m_text. Only the added characters are read back from
+//! the document, the whole text is only fetched if m_text is out of step.
+void
+Parser::updateText(int offset, int charsRemoved, int charsAdded)
+{
+  auto document = m_editor->document();
+  if (offset + charsRemoved > m_text.length() ||
+      m_text.length() - charsRemoved + charsAdded !=
+        document->characterCount() - 1) {
+    m_text = document->toPlainText();
+    return;
+  }
+
+  QTextCursor cursor(document);
+  cursor.setPosition(offset);
+  cursor.setPosition(offset + charsAdded, QTextCursor::KeepAnchor);
+  // the same conversions as QTextDocument::toPlainText().
+  auto added = cursor.selectedText();
+  for (auto& c : added) {
+    if (c == QChar::ParagraphSeparator || c == QChar::LineSeparator) {
+      c = QLatin1Char('\n');
+    } else if (c == QChar::Nbsp) {
+      c = QLatin1Char(' ');
+    }
+  }
+  m_text.replace(offset, charsRemoved, added);
 }
 
 void
-Parser::parseComment(QMap<QTextCursor, Node*>* nodes,
+Parser::parseComment(QMap<TextPosition, Node*>* nodes,
                      const QString& text,
                      int start,
                      int& pos)
 {
-  QTextCursor cursor = m_datastore->getCursorForPosition(start);
+  TextPosition cursor = m_datastore->textPosition(start);
 
-  QChar c;
-  CommentNode* comment = new CommentNode(cursor, m_editor);
+  CommentNode* comment = m_arena->create<CommentNode>(cursor, m_editor);
   //  m_datastore->insertNode(cursor, comment);
   nodes->insert(cursor, comment);
 
-  while (true) {
-    c = text.at(pos);
-    if (c.isSpace()) {
-      pos++;
-    } else {
-      comment->setTextCursor(m_datastore->getCursorForPosition(pos));
-      pos++;
-      break;
-    }
+  while (pos < text.length() && text.at(pos).isSpace()) {
+    pos++;
   }
-
-  while (pos < text.length()) {
-
-    if (c != '*') {
-      comment->append(c);
-
-    } else {
-      if (pos < text.length()) {
-        c = text.at(pos++);
-
-        if (c == '/') {
-          comment->setEndCommentExists(true);
-          comment->setEndCommentCursor(
-            m_datastore->getCursorForPosition(pos - 2));
-          break;
-
-        } else {
-          comment->append(c);
-        }
-      }
-    }
-    c = text.at(pos++);
+  comment->setTextCursor(m_datastore->textPosition(pos));
+
+  // the comment text is appended as a single slice.
+  auto end = Scanner::findCommentEnd(text, pos);
+  if (end >= 0) {
+    comment->append(text.mid(pos, end - pos));
+    comment->setEndCommentExists(true);
+    comment->setEndCommentCursor(m_datastore->textPosition(end));
+    pos = end + 2;
+  } else {
+    comment->append(text.mid(pos));
+    pos = text.length();
   }
 }
 
-void
-Parser::nodeForPoint(const QPoint& pos, NodeSection** nodeSection)
+//! Only the nodes on the line under pos can contain it. The line is found
+//! through the document layout so just those nodes compute their section
+//! rectangles.
+NodeSection
+Parser::nodeForPoint(const QPoint& pos)
 {
-  auto values = m_datastore->nodes().values();
+  if (!m_editor) {
+    return NodeSection();
+  }
 
-  for (auto& n : values) {
-    auto section = n->sectionIfIn(pos);
+  auto block = m_editor->cursorForPosition(pos).block();
+  if (!block.isValid()) {
+    return NodeSection();
+  }
 
-    if (section->type != SectionType::None) {
-      section->node = n;
-      *nodeSection = section;
-      return;
+  auto start = block.position();
+  QVector<Node*> nodes;
+  m_datastore->nodesInRange(start, start + block.length(), nodes);
+  for (auto node : nodes) {
+    auto section = node->sectionIfIn(pos);
+    if (section.type != SectionType::None) {
+      section.node = node;
+      return section;
     }
   }
+  return NodeSection();
 }
 
 bool
@@ -675,550 +939,222 @@ Parser::setShowLineMarkers(bool showLineMarkers)
   m_showLineMarkers = showLineMarkers;
 }
 
-CursorData
-Parser::getNodeAtCursor(QTextCursor cursor)
+bool
+Parser::isBackgroundParse() const
 {
-  CursorData data;
-  data.cursor = cursor;
-
-  nodeAtCursorPosition(&data, cursor.anchor());
-
-  return data;
+  return m_backgroundParse;
 }
 
-CursorData
-Parser::getNodeAtCursor(int position)
+void
+Parser::setBackgroundParse(bool backgroundParse)
 {
-  CursorData data;
-  data.cursor = QTextCursor(m_editor->document());
-
-  nodeAtCursorPosition(&data, position);
+  m_backgroundParse = backgroundParse;
+}
 
-  return data;
+bool
+Parser::isLazyFuzzySearch() const
+{
+  return m_lazyFuzzySearch;
 }
 
 void
-Parser::nodeAtCursorPosition(CursorData* data, int position)
+Parser::setLazyFuzzySearch(bool lazyFuzzySearch)
 {
-  Node* previous = nullptr;
-  QMap<QTextCursor, Node*> nodes = m_datastore->nodes();
-
-  for (auto [key, node] : asKeyValueRange(nodes)) {
-    if (!node) {
-      return;
-    }
-
-    if (position > node->end()) {
-      previous = node;
-      continue;
-
-    } else if (position >= node->position() && position <= node->end()) {
-      data->node = node;
-      data->cursor = node->cursor();
-      data->prevNode = previous;
-      break;
-    }
-  }
+  m_lazyFuzzySearch = lazyFuzzySearch;
 }
 
-// WidgetNode*
-// Parser::stashWidget(QMap<QTextCursor, Node*>* nodes,
-//                    QTextCursor cursor,
-//                    const QString& block,
-//                    enum NodeCheck check)
-//{
-//  auto widgetnode = new WidgetNode(block, cursor, m_editor, check, this);
-//  (*nodes).insert(cursor, widgetnode);
-//  return widgetnode;
-//}
-
-// void
-// Parser::stashBadNode(QMap<QTextCursor, Node*>* nodes,
-//                     int position,
-//                     const QString& block,
-//                     ParserState::Error error)
-//{
-//  auto cursor = getCursorForPosition(position);
-//  auto badblock = new BadBlockNode(block, cursor, error, m_editor, this);
-//  //  m_datastore->insertNode(cursor, badblock);
-//  (*nodes).insert(cursor, badblock);
-//}
+bool
+Parser::isParallelParse() const
+{
+  return m_parallelParse;
+}
 
 void
-Parser::stashNewline(QMap<QTextCursor, Node*>* nodes, int position)
+Parser::setParallelParse(bool parallelParse)
 {
-  auto cursor = m_datastore->getCursorForPosition(position);
-  auto newline = new NewlineNode(cursor, m_editor);
-  //  m_datastore->insertNode(cursor, newline);
-  (*nodes).insert(cursor, newline);
+  m_parallelParse = parallelParse;
 }
 
 void
-Parser::updateContextMenu(QMap<int, QString> matches,
-                          WidgetNode* node,
-                          const QPoint& pos,
-                          QMenu** suggestionsMenu)
+Parser::startBackgroundParse(const QString& text)
 {
-  QString typeName;
-  (*suggestionsMenu)->clear();
-
-  switch (node->type()) {
-    case NodeType::WidgetType:
-      typeName = "widget";
-      break;
+  if (!m_parseThread) {
+    m_parseThread = new QThread(this);
+    // the worker never touches the editor, the nodes are attached to it
+    // when they are installed.
+    m_parseWorker = new Parser(m_datastore, nullptr);
+    m_parseWorker->m_owner = this;
+    m_parseWorker->moveToThread(m_parseThread);
+    connect(m_parseThread,
+            &QThread::finished,
+            m_parseWorker,
+            &QObject::deleteLater);
+    m_parseThread->start();
   }
 
-  QAction* act =
-    (*suggestionsMenu)
-      ->addSection(m_datastore->invalidIcon(),
-                   tr("%1 is not a valid %2 name").arg(node->name(), typeName));
-  act->setData(pos);
-  (*suggestionsMenu)->addSeparator();
-
-  updateMenu(matches, node, pos, suggestionsMenu, SectionType::WidgetName);
+  // Storing the new revision cancels any parse that is already running.
+  int revision = m_editor->document()->revision();
+  m_parseRevision.storeRelease(revision);
+  m_parseInFlight = true;
+
+  auto worker = m_parseWorker;
+  bool showLineMarkers = m_showLineMarkers;
+  bool lazyFuzzySearch = m_lazyFuzzySearch;
+  bool parallelParse = m_parallelParse;
+  QMetaObject::invokeMethod(
+    worker,
+    [worker,
+     text,
+     revision,
+     showLineMarkers,
+     lazyFuzzySearch,
+     parallelParse]() {
+      worker->m_showLineMarkers = showLineMarkers;
+      worker->m_lazyFuzzySearch = lazyFuzzySearch;
+      worker->m_parallelParse = parallelParse;
+      worker->backgroundParse(text, revision);
+    },
+    Qt::QueuedConnection);
 }
 
 void
-Parser::updatePropertyContextMenu(
-  PropertyNode* property,
-  const QPoint& pos,
-  QMenu** suggestionsMenu,
-  QMap<int, QString> matches = QMap<int, QString>())
+Parser::backgroundParse(const QString& text, int revision)
 {
-  QAction* act;
-  (*suggestionsMenu)->clear();
-
-  if (!property->isValidPropertyName()) {
-    act = (*suggestionsMenu)
-            ->addSection(
-              m_datastore->invalidIcon(),
-              tr("%1 is not a valid property name").arg(property->name()));
-    act->setData(pos);
-    (*suggestionsMenu)->addAction(act);
-    (*suggestionsMenu)->addSeparator();
-    updateMenu(
-      matches, property, pos, suggestionsMenu, SectionType::PropertyName);
-  } else if (!property->hasPropertyMarker()) {
-    act = new QAction(
-      m_datastore->invalidIcon(),
-      tr("%1 is missing a property marker (:)").arg(property->name()));
-    (*suggestionsMenu)->addAction(act);
-    (*suggestionsMenu)->addSeparator();
-    act =
-      new QAction(m_datastore->addColonIcon(), tr("Add property marker (:)"));
-    act->setData(pos);
-    (*suggestionsMenu)->addAction(act);
-    setMenuData(act, property, SectionType::PropertyMarker);
-    m_editor->connect(
-      act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-  } else if (!property->hasPropertyEndMarker()) {
-    act =
-      new QAction(m_datastore->badSemiColonIcon(),
-                  tr("%1 is missing an end marker (;)").arg(property->name()));
-    (*suggestionsMenu)->addAction(act);
-    (*suggestionsMenu)->addSeparator();
-    act = new QAction(m_datastore->addSemiColonIcon(),
-                      tr("Add property end marker (;)"));
-    act->setData(pos);
-    (*suggestionsMenu)->addAction(act);
-    setMenuData(act, property, SectionType::PropertyEndMarker);
-    m_editor->connect(
-      act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-  } else {
-    act =
-      new QAction(m_datastore->validIcon(),
-                  tr("Property %1 appears to be valid!").arg(property->name()));
-    act->setData(pos);
-    (*suggestionsMenu)->addAction(act);
-    (*suggestionsMenu)->addSeparator();
+  m_revision = revision;
+  if (isParseCancelled()) {
+    return;
   }
-}
 
-QWidgetAction*
-Parser::getWidgetAction(const QIcon& icon, const QString& text, QMenu* menu)
-{
-  auto lbl = new IconLabel(icon, text, m_editor);
-  auto act = new QWidgetAction(menu);
-  act->setDefaultWidget(lbl);
-  return act;
-}
+  // Each parse builds a new generation which is handed over to the owner.
+  m_arena = std::make_shared<NodeArena>();
+  auto nodes = parseText(text);
+  auto arena = std::move(m_arena);
 
-void
-Parser::updateSubControlMenu(WidgetNode* widget,
-                             const QString& name,
-                             QPoint pos,
-                             QMenu** suggestionsMenu)
-{
-  if (!widget->isSubControlValid(pos)) {
-    if (widget->isSubControlFuzzy(pos)) {
-      auto matches = m_datastore->fuzzySearchSubControl(name);
-      (*suggestionsMenu)->clear();
-      auto widgetact = getWidgetAction(
-        m_datastore->fuzzyIcon(),
-        tr("Fuzzy sub control %1.<br>Possible values showing below.").arg(name),
-        *suggestionsMenu);
-      (*suggestionsMenu)->addAction(widgetact);
-      (*suggestionsMenu)->addSeparator();
-      updateMenu(matches,
-                 widget,
-                 pos,
-                 suggestionsMenu,
-                 SectionType::FuzzyWidgetSubControl);
-    } else if (widget->isSubControlBad(pos)) {
-      if (widget->isSubControl()) {
-        auto matches = m_datastore->fuzzySearchSubControl(name);
-        (*suggestionsMenu)->clear();
-        auto widgetact = getWidgetAction(m_datastore->fuzzyIcon(),
-                                         tr("Sub control %1 does not match <br>"
-                                            "supplied widget %2.<br>"
-                                            "Possible sub controls are.")
-                                           .arg(name, widget->name()),
-                                         *suggestionsMenu);
-        (*suggestionsMenu)->addAction(widgetact);
-        (*suggestionsMenu)->addSeparator();
-        auto act = new QAction(m_datastore->addDColonIcon(),
-                               tr("Change to sub control marker (::)"));
-        (*suggestionsMenu)->addAction(act);
-        setMenuData(act, widget, SectionType::WidgetSubControlMarker);
-        m_editor->connect(act,
-                          &QAction::triggered,
-                          m_editor,
-                          &StylesheetEditor::suggestionMade);
-        (*suggestionsMenu)->addSeparator();
-        updateMenu(matches,
-                   widget,
-                   pos,
-                   suggestionsMenu,
-                   SectionType::FuzzyWidgetSubControl);
-      } else if (widget->isPseudoState()) {
-        auto matches = m_datastore->fuzzySearchSubControl(name);
-        (*suggestionsMenu)->clear();
-        auto widgetact =
-          getWidgetAction(m_datastore->fuzzyIcon(),
-                          tr("Pseudo state %1 does not match <br>"
-                             "supplied widget %2.<br>"
-                             "Possible states are.")
-                            .arg(name, widget->name()),
-                          *suggestionsMenu);
-        (*suggestionsMenu)->addAction(widgetact);
-        (*suggestionsMenu)->addSeparator();
-        updateMenu(matches,
-                   widget,
-                   pos,
-                   suggestionsMenu,
-                   SectionType::FuzzyWidgetSubControl);
-      }
-    } else if (!widget->doesMarkerMatch(SubControlState)) {
-      (*suggestionsMenu)->clear();
-      auto widgetact = getWidgetAction(
-        m_datastore->badColonIcon(),
-        tr("Sub control %1 does not match<br>pseudo state marker (::)")
-          .arg(name),
-        *suggestionsMenu);
-      (*suggestionsMenu)->addAction(widgetact);
-      (*suggestionsMenu)->addSeparator();
-      auto act = new QAction(m_datastore->addDColonIcon(),
-                             tr("Change to sub control marker (::)"));
-      (*suggestionsMenu)->addAction(act);
-      setMenuData(act, widget, SectionType::WidgetSubControlMarker);
-      m_editor->connect(
-        act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-    }
-  } else if (widget->isSubControlBad(pos)) {
-    auto subcontrols =
-      m_datastore->possibleSubControlsForWidget(widget->name());
-    (*suggestionsMenu)->clear();
-    auto widgetact =
-      getWidgetAction(m_datastore->invalidIcon(),
-                      tr("Sub control %1 does not match widget %2<br>"
-                         "possible sub controls are:")
-                        .arg(name)
-                        .arg(widget->name()),
-                      *suggestionsMenu);
-    (*suggestionsMenu)->addAction(widgetact);
-    (*suggestionsMenu)->addSeparator();
-    updateMenu(subcontrols,
-               widget,
-               pos,
-               suggestionsMenu,
-               SectionType::BadWidgetSubControl);
+  if (isParseCancelled()) {
+    return;
   }
+
+  auto owner = m_owner;
+  QMetaObject::invokeMethod(
+    owner,
+    [owner, nodes, arena, revision]() {
+      owner->installBackgroundParse(nodes, arena, revision);
+    },
+    Qt::QueuedConnection);
 }
 
 void
-Parser::updatePseudoStateMenu(WidgetNode* widget,
-                              QPoint pos,
-                              QMenu** suggestionsMenu)
+Parser::installBackgroundParse(QMap<TextPosition, Node*> nodes,
+                               std::shared_ptr<NodeArena> arena,
+                               int revision)
 {
-  auto pseudoState = widget->pseudoState(pos);
-  if (pseudoState) {
-    auto name = pseudoState->name();
-    if (widget->isSubControlFuzzy(pos)) {
-      auto matches = m_datastore->fuzzySearchPseudoStates(name);
-      (*suggestionsMenu)->clear();
-      auto widgetact = getWidgetAction(
-        m_datastore->fuzzyIcon(),
-        tr("Fuzzy pseudo state name.<br>Possible values showing below.")
-          .arg(name),
-        *suggestionsMenu);
-      (*suggestionsMenu)->addAction(widgetact);
-      (*suggestionsMenu)->addSeparator();
-      updateMenu(matches,
-                 widget,
-                 pos,
-                 suggestionsMenu,
-                 SectionType::FuzzyWidgetPseudoState);
-    } else if (!widget->doesMarkerMatch(PseudostateState)) {
-      (*suggestionsMenu)->clear();
-      auto widgetact = getWidgetAction(
-        m_datastore->badDColonIcon(),
-        tr("Pseudo state %1 does not match<br>sub control marker (:)")
-          .arg(name),
-        *suggestionsMenu);
-      (*suggestionsMenu)->addAction(widgetact);
-      (*suggestionsMenu)->addSeparator();
-      auto act = new QAction(m_datastore->addColonIcon(),
-                             tr("Change to pseudo state marker (:)"));
-      (*suggestionsMenu)->addAction(act);
-      setMenuData(act, widget, SectionType::WidgetPseudoStateMarker);
-      m_editor->connect(
-        act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-    }
+  // drop results that are out of date, a newer parse is on its way.
+  if (revision != m_parseRevision.loadAcquire() ||
+      revision != m_editor->document()->revision()) {
+    return;
   }
-}
 
-void
-Parser::updateValidPropertyValueContextMenu(QMultiMap<int, QString> matches,
-                                            QPoint pos,
-                                            PropertyNode* property,
-                                            const QString& valueName,
-                                            QMenu** suggestionsMenu)
-{
-  (*suggestionsMenu)->clear();
+  m_parseInFlight = false;
 
-  auto keys = matches.keys(valueName);
-  for (auto& key : keys) {
-    matches.remove(key, valueName);
-  }
+  // The nodes were parsed from the current text so no edit applies to them.
+  m_datastore->clearEdits();
+  attachNodes(nodes);
 
-  auto act = getWidgetAction(
-    m_datastore->validIcon(),
-    tr("%1 is a valid value for %2.<br>Other suggestions are : ")
-      .arg(valueName, property->name()),
-    *suggestionsMenu);
-  (*suggestionsMenu)->addAction(act);
-  (*suggestionsMenu)->addSeparator();
+  auto previous = nodeSpans(m_datastore->nodes().values());
+  m_datastore->setBraceCount(0);
+  m_datastore->setNodes(nodes, arena);
+  rehighlightSpans(changedSpans(previous, nodeSpans(nodes.values())));
+  retireArena(m_arena);
+  m_arena = arena;
 
-  updateMenu(matches, property, pos, suggestionsMenu, SectionType::None);
+  emit parseComplete();
 }
 
+//! Nodes parsed on another thread have no editor and positions that are not
+//! attached to the edit map. Attaches them, and rekeys nodes with positions
+//! that are, which must be done on the thread that owns the datastore.
 void
-Parser::setMenuData(QAction* act,
-                    Node* node,
-                    SectionType type,
-                    const QString& oldName,
-                    int offset,
-                    int index)
+Parser::attachNodes(QMap<TextPosition, Node*>& nodes)
 {
-  MenuData data;
-  data.node = node;
-  data.type = type;
-  data.oldName = oldName;
-  data.offset = offset;
-  data.index = index;
-  QVariant v;
-  v.setValue<MenuData>(data);
-  act->setData(v);
+  auto map = m_datastore->offsetMap();
+  QMap<TextPosition, Node*> attached;
+  for (auto [key, node] : asKeyValueRange(nodes)) {
+    node->attach(map, m_editor);
+    attached.insert(m_datastore->textPosition(key.position()), node);
+  }
+  nodes = attached;
 }
 
-void
-Parser::updateInvalidPropertyValueContextMenu(QMultiMap<int, QString> matches,
-                                              QPoint pos,
-                                              PropertyNode* property,
-                                              const QString& valueName,
-                                              QMenu** suggestionsMenu)
+bool
+Parser::isParseCancelled() const
 {
-  (*suggestionsMenu)->clear();
-
-  auto keys = matches.keys(valueName);
-  for (auto& key : keys) {
-    matches.remove(key, valueName);
-  }
-
-  auto act = getWidgetAction(
-    m_datastore->invalidIcon(),
-    tr("%1 is an invalid value for %2.<br>Possible suggestions are : ")
-      .arg(valueName, property->name()),
-    *suggestionsMenu);
-  (*suggestionsMenu)->addAction(act);
-  (*suggestionsMenu)->addSeparator();
-
-  updateMenu(matches,
-             property,
-             pos,
-             suggestionsMenu,
-             SectionType::PropertyValue,
-             valueName);
+  return (m_owner && m_owner->m_parseRevision.loadAcquire() != m_revision);
 }
 
-void
-Parser::updateInvalidNameAndPropertyValueContextMenu(
-  QMultiMap<int, QPair<QString, QString>> matches,
-  PropertyNode* nNode,
-  const QString& valueName,
-  const QPoint& pos,
-  QMenu** suggestionsMenu)
+CursorData
+Parser::getNodeAtCursor(QTextCursor cursor)
 {
-  (*suggestionsMenu)->clear();
-
-  (*suggestionsMenu)
-    ->addSection(m_datastore->invalidIcon(),
-                 tr("%1 is not a valid property value for %2")
-                   .arg(valueName, nNode->name()));
-  if (matches.isEmpty()) {
-    (*suggestionsMenu)
-      ->addSection(m_datastore->noIcon(), tr("No suggestions are available!"));
-    return;
-  }
+  CursorData data;
+  data.cursor = m_datastore->textPosition(cursor.anchor());
 
-  auto reversed = sortLastNValues(matches);
-
-  QString s("%1 : %2");
-  for (auto& pair : reversed) {
-    auto act = new QAction(s.arg(pair.first, pair.second));
-    (*suggestionsMenu)->addAction(act);
-    QVariant v;
-    v.setValue(qMakePair<NamedNode*, QPoint>(nNode, pos));
-    act->setData(v);
-    m_editor->connect(
-      act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-  }
+  nodeAtCursorPosition(&data, cursor.anchor());
 
-  if (reversed.size() > 0) {
-    (*suggestionsMenu)->setEnabled(true);
-  }
+  return data;
 }
 
-void
-Parser::updateMenu(QStringList matches,
-                   Node* nNode,
-                   QPoint pos,
-                   QMenu** suggestionsMenu,
-                   SectionType type,
-                   const QString& oldName)
+CursorData
+Parser::getNodeAtCursor(int position)
 {
-  QAction* act;
-
-  if (matches.isEmpty()) {
-    (*suggestionsMenu)
-      ->addSection(m_datastore->noIcon(), tr("No suggestions are available!"));
-    return;
-  }
-
-  auto reversed = reverseList(matches, m_datastore->maxSuggestionCount());
+  CursorData data;
+  data.cursor = m_datastore->textPosition(position);
 
-  for (auto& match : reversed) {
-    act = new QAction(match);
-    act->setData(pos);
-    (*suggestionsMenu)->addAction(act);
-    setMenuData(act, nNode, type, oldName);
-    m_editor->connect(
-      act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-  }
+  nodeAtCursorPosition(&data, position);
 
-  if (reversed.size() > 0) {
-    (*suggestionsMenu)->setEnabled(true);
-  }
+  return data;
 }
 
 void
-Parser::updateMenu(QMap<int, QString> matches,
-                   Node* nNode,
-                   QPoint pos,
-                   QMenu** suggestionsMenu,
-                   SectionType type,
-                   const QString& oldName,
-                   int offset,
-                   int index)
+Parser::nodeAtCursorPosition(CursorData* data, int position)
 {
-  QAction* act;
-
-  if (matches.isEmpty()) {
-    (*suggestionsMenu)
-      ->addSection(m_datastore->noIcon(), tr("No suggestions are available!"));
-    return;
-  }
-
-  auto reversed = reverseLastNValues(matches);
-
-  for (auto& key : reversed) {
-    act = new QAction(matches.value(key));
-    (*suggestionsMenu)->addAction(act);
-    setMenuData(act, nNode, type, oldName, offset, index);
-    m_editor->connect(
-      act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-  }
-
-  if (reversed.size() > 0) {
-    (*suggestionsMenu)->setEnabled(true);
+  Node* previous = nullptr;
+  auto node = m_datastore->nodeAt(position, &previous);
+  if (node) {
+    data->node = node;
+    data->cursor = node->cursor();
+    data->prevNode = previous;
   }
 }
 
-QList<int>
-Parser::reverseLastNValues(QMultiMap<int, QString> matches)
-{
-  //  QMultiMap<int, QString> rMatches;
-  auto keys = matches.keys();
-  QList<int> reversed;
-  QList<int>::reverse_iterator i;
-
-  for (i = keys.rbegin(); i != keys.rend(); ++i) {
-    if (reversed.size() > m_datastore->maxSuggestionCount()) {
-      break;
-    }
-
-    reversed << *i;
-  }
-
-  return reversed;
-}
+// WidgetNode*
+// Parser::stashWidget(QMap<TextPosition, Node*>* nodes,
+//                    QTextCursor cursor,
+//                    const QString& block,
+//                    enum NodeCheck check)
+//{
+//  auto widgetnode = new WidgetNode(block, cursor, m_editor, check, this);
+//  (*nodes).insert(cursor, widgetnode);
+//  return widgetnode;
+//}
 
-QStringList
-Parser::reverseList(QStringList list, int count)
-{
-  std::reverse(list.begin(), list.end());
-  return list.mid(0, count - 1);
-}
+// void
+// Parser::stashBadNode(QMap<TextPosition, Node*>* nodes,
+//                     int position,
+//                     const QString& block,
+//                     ParserState::Error error)
+//{
+//  auto cursor = getCursorForPosition(position);
+//  auto badblock = new BadBlockNode(block, cursor, error, m_editor, this);
+//  //  m_datastore->insertNode(cursor, badblock);
+//  (*nodes).insert(cursor, badblock);
+//}
 
-QList<QPair<QString, QString>>
-Parser::sortLastNValues(QMultiMap<int, QPair<QString, QString>> matches)
+void
+Parser::stashNewline(QMap<TextPosition, Node*>* nodes, int position)
 {
-  //  QMultiMap<int, QPair<QString, QString>> rMatches;
-  QList<QPair<QString, QString>> sorted;
-  auto values = matches.values();
-  for (auto& v : values) {
-    auto lf = v.first.length();
-    if (sorted.size() == 0) {
-      sorted.append(v);
-      continue;
-    } else {
-      bool success = false;
-      for (int i = 0; i < sorted.length(); i++) {
-        if (i == m_datastore->maxSuggestionCount())
-          return sorted;
-        auto spair = sorted.at(i);
-        if (spair.first.length() > lf) {
-          sorted.insert(i, v);
-          success = true;
-        }
-      } // end for
-      if (!success) {
-        sorted.append(v);
-      }
-      continue;
-    }
-  } // end for
-  return sorted;
+  auto cursor = m_datastore->textPosition(position);
+  auto newline = m_arena->create<NewlineNode>(cursor, m_editor);
+  //  m_datastore->insertNode(cursor, newline);
+  (*nodes).insert(cursor, newline);
 }
 
 // StylesheetData*
@@ -1258,756 +1194,412 @@ Parser::sortLastNValues(QMultiMap<int, QPair<QString, QString>> matches)
 //  return data;
 //}
 
-void
-Parser::handleDocumentChanged(int offset, int charsRemoved, int charsAdded)
+//! Mixes a value into the signature of a span.
+static void
+mixSignature(uint& signature, uint value)
 {
-  // If there is no text then nothing to be done.
-  if (m_editor->toPlainText().trimmed().isEmpty()) {
-    return;
+  signature ^= value + 0x9e3779b9 + (signature << 6) + (signature >> 2);
+}
+
+//! Adds a formatted part of a node to a span, extending the span to cover it.
+static void
+extendSpan(NodeSpan& span, int position, int length, uint value)
+{
+  span.start = qMin(span.start, position);
+  span.end = qMax(span.end, position + length);
+  mixSignature(span.signature, uint(position));
+  mixSignature(span.signature, uint(length));
+  mixSignature(span.signature, value);
+}
+
+static void
+extendSpan(NodeSpan& span, PseudoState* state)
+{
+  extendSpan(span, state->position(), 1, uint(state->hasMarker()));
+  extendSpan(span,
+             state->namePosition(),
+             state->name().length(),
+             qHash(state->name()) ^ uint(state->isValid()));
+}
+
+static void
+extendSpan(NodeSpan& span, ControlBase* control)
+{
+  extendSpan(span, control->position(), 1, uint(control->hasMarker()));
+  extendSpan(span,
+             control->namePosition(),
+             control->name().length(),
+             qHash(control->name()) ^ uint(control->isValid()));
+  if (control->hasPseudoStates()) {
+    for (auto state : *(control->pseudoStates())) {
+      extendSpan(span, state);
+    }
   }
+}
 
-  /*
-     Initially I handled this by rebuilding the nodes as I modified the
-     text, However the code was getting lerger than I liked, and was taking
-     too long to write so I decided to reparse the entire code. I suspect
-     that no stylesheet would be large enough to be worth the cost of
-     keeping the code clean. I might revisit this later.
-  */
-  //  parseInitialText(m_editor->toPlainText());
-  return;
-
-  //  // If the text is changed due to a suggestion then ignore
-  //  // it as is is handled elsewhere.
-  //  if (m_datastore->hasSuggestion()) {
-  //    m_datastore->setHasSuggestion(false);
-  //    return;
-  //  }
-
-  //  QString text;
-  //  if ((text = m_editor->toPlainText()).isEmpty()) {
-  //    return;
-  //  }
-  //  auto count = charsAdded - charsRemoved;
-  //  auto textChanged = text.mid(offset, count);
-
-  //  CursorData data = getNodeAtCursor(offset);
-  //  Node* node = data.node;
-
-  //  if (node) {
-  //    switch (node->type()) {
-  //      case NodeType::PropertyType: {
-  //        auto property = qobject_cast<PropertyNode*>(node);
-
-  //        if (property) {
-  //          auto status = property->sectionAtOffset(offset, textChanged);
-  //          switch (status.status()) {
-  //            case SectionType::PropertyName: {
-  //              int length = property->name().length() + count;
-  //              auto newName = text.mid(property->start(), length);
-  //              property->setName(newName);
-  //              if (m_datastore->containsProperty(newName)) {
-  //                property->setValidPropertyName(true);
-  //              } else {
-  //                property->setValidPropertyName(false);
-  //              }
-  //              emit rehighlightBlock(data.cursor.block());
-  //              break;
-  //            }
-  //            case SectionType::PropertyValue: {
-  //              int index = property->values().indexOf(status.name());
-  //              int length = status.name().length() + count;
-  //              auto newName = text.mid(property->valuePosition(index),
-  //              length); property->setValue(index, newName); if
-  //              (m_datastore->isValidPropertyValueForProperty(property->name(),
-  //                                                               newName))
-  //                                                               {
-  //                property->setCheck(index,
-  //                PropertyValueCheck::GoodValue);
-  //              } else {
-  //                property->setCheck(index, PropertyValueCheck::BadValue);
-  //              }
-  //              emit rehighlightBlock(data.cursor.block());
-  //              break;
-  //            }
-  //            case SectionType::PropertyMarker: {
-  //              if (!property->hasPropertyMarker()) {
-  //                int length = property->name().length();
-  //                QTextCursor cursor = property->cursor();
-  //                cursor.movePosition(
-  //                  QTextCursor::Right, QTextCursor::MoveAnchor, length);
-  //                property->setPropertyMarkerCursor(cursor);
-  //                property->setPropertyMarker(true);
-  //              }
-  //              emit rehighlightBlock(data.cursor.block());
-  //              break;
-  //            }
-  //            case SectionType::PropertyEndMarker: {
-  //              if (!property->hasPropertyEndMarker()) {
-  //                int length = property->length();
-  //                QTextCursor cursor = property->cursor();
-  //                cursor.movePosition(
-  //                  QTextCursor::Right, QTextCursor::MoveAnchor, length);
-  //                property->setPropertyEndMarkerCursor(cursor);
-  //                property->setPropertyEndMarker(true);
-  //              }
-  //              emit rehighlightBlock(data.cursor.block());
-  //              break;
-  //            }
-  //          }
-  //        }
-  //      }
-  //    }
-  //  } else {
-  //    // code has been added outside an existing node.
-  //      // NOTE may be worth the cost of reparsing the entire text
-  //      // as it shouldn't be really huge in real terms.
-  //      auto nodes = parseText(textChanged);
-  //  }
+static NodeSpan
+propertySpan(PropertyNode* property)
+{
+  NodeSpan span;
+  span.start = property->position();
+  span.end = span.start;
+  extendSpan(span,
+             property->position(),
+             property->name().length(),
+             qHash(property->name()));
+  mixSignature(span.signature, uint(property->isValidPropertyName()));
+  mixSignature(span.signature, uint(property->isFinalProperty()));
+  if (property->hasPropertyMarker()) {
+    extendSpan(span, property->propertyMarkerPosition(), 1, ':');
+  }
+  for (int i = 0; i < property->count(); i++) {
+    for (auto status = property->valueStatus(i); status;
+         status = status->next()) {
+      extendSpan(span,
+                 status->offset(),
+                 status->length(),
+                 uint(status->state()));
+      for (int j = 0; j < status->sectionCount(); j++) {
+        extendSpan(span,
+                   status->sectionOffset(j),
+                   status->sectionLength(j),
+                   uint(status->sectionState(j)));
+      }
+    }
+  }
+  if (property->hasPropertyEndMarker()) {
+    extendSpan(span, property->propertyEndMarkerPosition(), 1, ';');
+  }
+  return span;
 }
 
 void
-Parser::handleCursorPositionChanged(QTextCursor textCursor)
+Parser::handleDocumentChanged(int offset, int charsRemoved, int charsAdded)
 {
-  if (m_datastore->isManualMove()) {
+  // Every edit has to be recorded so that the existing node positions
+  // can follow it.
+  m_datastore->addEdit(offset, charsRemoved, charsAdded);
+  updateText(offset, charsRemoved, charsAdded);
+
+  // If the text is changed due to a suggestion then ignore
+  // it as it is handled elsewhere.
+  if (m_datastore->hasSuggestion()) {
+    m_datastore->setHasSuggestion(false);
     return;
   }
 
-  setCurrentCursor(textCursor);
+  const auto& text = m_text;
 
-  Node* node;
-  CursorData data;
-  data.cursor = textCursor;
-  nodeAtCursorPosition(&data, textCursor.anchor());
-  node = data.node;
-  if (!node) {
+  // There are no nodes to update until the background parse is installed
+  // so start again with the new text.
+  if (m_parseInFlight) {
+    startBackgroundParse(text);
     return;
   }
 
-  // TODO move this capability into node/datastore.
-  //  for (auto startbrace : m_datastore->startBraces()) {
-  //    if (startbrace->isBraceAtCursor()) {
-  //      startbrace->setBraceAtCursor(false);
-  //    }
-  //  }
-
-  //  for (auto endbrace : d_ptr->endbraces) {
-  //    if (endbrace->isBraceAtCursor()) {
-  //      endbrace->setBraceAtCursor(false);
-  //    }
-  //  }
-
-  //  if (node) {
-  //    auto type = node->type();
-
-  //    if (type == NodeType::StartBraceType) {
-  //      StartBraceNode* startbrace = qobject_cast<StartBraceNode*>(node);
-  //      startbrace->setBraceAtCursor(true);
-  //      if (startbrace->hasEndBrace()) {
-  //        EndBraceNode* endbrace = startbrace->endBrace();
-  //        endbrace->setBraceAtCursor(true);
-  //      }
-  //    } else if (type == NodeType::EndBraceType) {
-  //      EndBraceNode* endbrace = qobject_cast<EndBraceNode*>(node);
-  //      endbrace->setBraceAtCursor(true);
-  //      if (endbrace->hasStartBrace()) {
-  //        StartBraceNode* startbrace = endbrace->startBrace();
-  //        startbrace->setBraceAtCursor(true);
-  //      }
-  //    } // end end brace type
-  //  }   // end if node
-
-  emit rehighlight();
-}
+  // If there is no text then nothing to be done.
+  if (isBlankAfter(text, 0)) {
+    m_datastore->clearNodes();
+    retireArena(m_arena);
+    m_arena.reset();
+    return;
+  }
 
-void
-Parser::updateColorDialogMenu(QAction* act,
-                              PropertyNode* property,
-                              const QString& name,
-                              int offset,
-                              int index,
-                              QMenu** suggestionsMenu)
-{
-  MenuData data;
-  data.node = property;
-  data.type = SectionType::ColorDialog;
-  data.oldName = name;
-  data.offset = offset;
-  data.index = index;
-  QVariant v;
-  v.setValue<MenuData>(data);
-  act->setData(v);
-  (*suggestionsMenu)->addAction(act);
-  m_editor->connect(
-    act, &QAction::triggered, m_editor, &StylesheetEditor::suggestionMade);
-}
+  if (!m_arena) {
+    m_arena = std::make_shared<NodeArena>();
+  }
 
-QMenu*
-Parser::handleMouseClicked(const QPoint& pos)
-{
-  NodeSection* section = nullptr;
-  nodeForPoint(pos, &section);
+  // The node positions follow the edit recorded above so the
+  // damaged range is simply offset to offset + charsAdded. Widen this to
+  // cover every top level node that it touches, ie the whole rule.
+  int changeEnd = offset + charsAdded;
+  int start = offset;
+  int end = changeEnd;
+  m_datastore->extendToNodes(start, end);
+  auto last = m_datastore->lastNode();
+
+  // Reparse the slice. If the new nodes overrun the end of the slice, for
+  // instance when a closing brace was removed, then keep going until the
+  // reparse ends on an old node boundary.
+  QMap<TextPosition, Node*> parsed;
+  int pos = start;
+
+  // a slice that does not start the document follows the nodes before it,
+  // so a stray token at its start is not taken for the first selector.
+  m_followsNodes = (start > 0);
+  while (true) {
+    auto slice = parseText(text, pos, end);
+    for (auto [cursor, node] : asKeyValueRange(slice)) {
+      parsed.insert(cursor, node);
+    }
 
-  QMenu* suggestionsMenu = new QMenu(tr("&Suggestions"));
+    int from = start;
+    int overrun = pos - 1;
+    m_datastore->extendToNodes(from, overrun);
 
-  if (section && section->node && section->node != m_datastore->currentNode()) {
-    switch (section->node->type()) {
+    if (overrun <= pos || pos >= text.length()) {
+      break;
+    }
+    end = overrun;
+  }
+  end = qMax(end, pos);
+  m_followsNodes = false;
 
-      case NodeType::WidgetType: {
-        auto widget = qobject_cast<WidgetNode*>(section->node);
-        switch (section->type) {
-          case WidgetName: {
-            if (widget->isNameFuzzy()) {
-              auto matches = m_datastore->fuzzySearchWidgets(widget->name());
-              suggestionsMenu->clear();
-              auto widgetact = getWidgetAction(
-                m_datastore->fuzzyIcon(),
-                tr("Fuzzy widget name.<br>Possible values showing below.")
-                  .arg(widget->subControl(pos)->name()),
-                suggestionsMenu);
-              suggestionsMenu->addAction(widgetact);
-              suggestionsMenu->addSeparator();
-              updateMenu(matches,
-                         widget,
-                         pos,
-                         &suggestionsMenu,
-                         SectionType::FuzzyWidgetName);
-            } else {
-              qWarning();
-            }
-            break;
-          }
-          case WidgetSubControlName: {
-            auto name = widget->subControl(pos)->name();
-            updateSubControlMenu(widget, name, pos, &suggestionsMenu);
-            break;
-          }
-          case SectionType::WidgetSubControlMarker: {
-            auto name = widget->subControl(pos)->name();
-            updateSubControlMenu(widget, name, pos, &suggestionsMenu);
-            break;
-          }
-          case WidgetPseudoState: {
-            updatePseudoStateMenu(widget, pos, &suggestionsMenu);
-            break;
-          }
-          case SectionType::WidgetPseudoStateMarker: {
-            updatePseudoStateMenu(widget, pos, &suggestionsMenu);
-            break;
-          }
-          case WidgetPropertyName: {
-            qWarning();
-            break;
-          }
-          case SectionType::WidgetPropertyMarker: {
-            qWarning();
-            break;
-          }
-          case WidgetPropertyValue: {
-            qWarning();
-            break;
-          }
-          case WidgetPropertyEndMarker: {
-            qWarning();
-            break;
-          }
-        }
-      } // end WidgetType
+  auto removed = m_datastore->replaceNodes(start, end, parsed, m_arena);
+  auto dirty = changedSpans(nodeSpans(removed), nodeSpans(parsed.values()));
+  discardNodes(removed);
 
-      case NodeType::PropertyType: {
-        auto property = qobject_cast<PropertyNode*>(section->node);
-        switch (section->type) {
-          case SectionType::PropertyName: {
-            auto minCount = property->minCount();
-            auto maxCount = property->maxCount();
-            auto count = property->valueCount();
-
-            if (count > maxCount) {
-              suggestionsMenu->clear();
-              auto widgetact =
-                getWidgetAction(m_datastore->badIcon(),
-                                tr("Too many values %1, maximum is %2")
-                                  .arg(count)
-                                  .arg(maxCount),
-                                suggestionsMenu);
-              suggestionsMenu->addAction(widgetact);
-            } else if (count < minCount) {
-              suggestionsMenu->clear();
-              auto widgetact = getWidgetAction(
-                m_datastore->badIcon(),
-                tr("Not enough values, should be %1").arg(minCount),
-                suggestionsMenu);
-              suggestionsMenu->addAction(widgetact);
-            } else if (!property->hasPropertyEndMarker() &&
-                       !property->isFinalProperty()) {
-              suggestionsMenu->clear();
-              auto widgetact =
-                getWidgetAction(m_datastore->badDColonIcon(),
-                                tr("Property has no end marker (;)"),
-                                suggestionsMenu);
-              suggestionsMenu->addAction(widgetact);
-              suggestionsMenu->addSeparator();
-              auto act =
-                new QAction(m_datastore->addColonIcon(), tr("Add end marker"));
-              suggestionsMenu->addAction(act);
-              setMenuData(act, property, SectionType::PropertyEndMarker);
-              m_editor->connect(act,
-                                &QAction::triggered,
-                                m_editor,
-                                &StylesheetEditor::suggestionMade);
-            } else {
-              if (property->isValidPropertyName()) {
-                updatePropertyContextMenu(property, pos, &suggestionsMenu);
-              } else {
-                auto matches =
-                  m_datastore->fuzzySearchProperty(property->name());
-                updatePropertyContextMenu(
-                  property, pos, &suggestionsMenu, matches);
-              }
-            }
-            break;
+  // the old last node may have been followed by the new text.
+  if (!removed.contains(last)) {
+    if (auto property = updateFinalProperty(text, last)) {
+      dirty.append(propertySpan(property));
+    }
+  }
+  if (auto property = updateFinalProperty(text, m_datastore->lastNode())) {
+    dirty.append(propertySpan(property));
+  }
+
+  // The highlighter formatted the edited blocks before the nodes were
+  // updated so they are always redone.
+  NodeSpan edited;
+  edited.start = offset;
+  edited.end = changeEnd;
+  dirty.append(edited);
+
+  // Once most of the generation has been replaced start a new one so that
+  // the memory held by the released nodes is returned.
+  if (m_arena->releasedCount() > MIN_RELEASED_NODES &&
+      m_arena->releasedCount() > m_arena->liveCount()) {
+    rebuildNodes(text);
+  }
+
+  rehighlightSpans(dirty);
+}
+
+//! Breaks the nodes down into the spans that the highlighter formats. A rule
+//! is split into its selectors and its properties so that an edit inside a
+//! rule only dirties the lines that it changes.
+QVector<NodeSpan>
+Parser::nodeSpans(const QList<Node*>& nodes) const
+{
+  QVector<NodeSpan> spans;
+  spans.reserve(nodes.size());
+
+  for (auto node : nodes) {
+    switch (node->type()) {
+      case WidgetsType: {
+        auto widgets = node_cast<WidgetNodes>(node);
+        NodeSpan selectors;
+        selectors.start = widgets->position();
+        selectors.end = selectors.start;
+        for (auto widget : widgets->widgets()) {
+          extendSpan(selectors,
+                     widget->position(),
+                     widget->name().length(),
+                     qHash(widget->name()) ^ uint(widget->isNameValid()));
+          if (widget->hasIdSelector()) {
+            extendSpan(selectors, widget->idSelector());
           }
-          case SectionType::PropertyValue: {
-            auto valName = property->value(section->position);
-            auto status = property->valueStatus(section->position);
-            QString message;
-            while (status) {
-              switch (status->state()) {
-                case GoodValue: {
-                  if (QColor::isValidColor(status->name())) {
-                    message = tr("Color value is good: %1").arg(status->name());
-                    suggestionsMenu->clear();
-                    auto widgetact = getWidgetAction(
-                      m_datastore->invalidIcon(), message, suggestionsMenu);
-                    suggestionsMenu->addAction(widgetact);
-                    suggestionsMenu->addSeparator();
-                    auto act = new QAction(m_datastore->addColonIcon(),
-                                           tr("Call ColorDialog."));
-                    updateColorDialogMenu(act,
-                                          property,
-                                          status->name(),
-                                          status->offset(),
-                                          section->position,
-                                          &suggestionsMenu);                  }
-                  break;
-                }
-                case BadValue: {
-                  if (status->isInRect(pos)) {
-                    for (auto i = 0; i < status->sectionCount(); i++) {
-                      if (status->isInSectionRect(i, pos)) {
-                        auto state = status->sectionState(i);
-                        switch (state) {
-                          case BadValueName:
-                            message = tr("Bad value name %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case FuzzyValueName:
-                            message = tr("Value name is fuzzy %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case FuzzyColorValue:
-                            message = tr("Color name is fuzzy %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case BadColorValue:
-                            message = tr("Color name is bad %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case BadUrlValue:
-                            message = tr("URL value is bad %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case BadValueCount:
-                            message = tr("Wrong number of parameters %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case RepeatValueName:
-                            message = tr("Value name was repeated %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case BadNumericalValue:
-                            message = tr("Numerical parameter is bad %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                          case BadNumericalValue_31:
-                            message =
-                              tr("Numerical parameter should be 0-31 : %1")
-                                .arg(status->sectionName(i));
-                            break;
-                          case BadNumericalValue_100:
-                            message =
-                              tr("Numerical parameter should be 0-100 : %1")
-                                .arg(status->sectionName(i));
-                            break;
-                          case BadNumericalValue_255:
-                            message =
-                              tr("Numerical parameter should be 0-255 : %1")
-                                .arg(status->sectionName(i));
-                            break;
-                          case BadNumericalValue_359:
-                            message =
-                              tr("Numerical parameter should be 0-359 : %1")
-                                .arg(status->sectionName(i));
-                            break;
-                          case BadLengthUnit:
-                            message =
-                              tr("Should have a unit (px, pt, em, ex) : %1")
-                                .arg(status->sectionName(i));
-                            break;
-                          case BadFontUnit:
-                            message = tr("Should have a unit (px, pt) : %1")
-                                        .arg(status->sectionName(i));
-                            break;
-                        }
-                        suggestionsMenu->clear();
-                        auto widgetact = getWidgetAction(
-                          m_datastore->invalidIcon(), message, suggestionsMenu);
-                        suggestionsMenu->addAction(widgetact);
-                      }
-                    }
-                  }
-                  break;
-                }
-                case BadHashColorValue: {
-                  message = tr("Color value is bad: %1").arg(status->name());
-                  suggestionsMenu->clear();
-                  auto widgetact = getWidgetAction(
-                    m_datastore->invalidIcon(), message, suggestionsMenu);
-                  suggestionsMenu->addAction(widgetact);
-                  suggestionsMenu->addSeparator();
-                  auto act = new QAction(m_datastore->addColonIcon(),
-                                         tr("Call ColorDialog."));
-                  updateColorDialogMenu(act,
-                                        property,
-                                        status->name(),
-                                        status->offset(),
-                                        section->position,
-                                        &suggestionsMenu);
-                  break;
-                }
-                case BadColorValue: {
-                  message = tr("Color value is bad: %1").arg(status->name());
-                  suggestionsMenu->clear();
-                  auto widgetact = getWidgetAction(
-                    m_datastore->invalidIcon(), message, suggestionsMenu);
-                  suggestionsMenu->addAction(widgetact);
-                  suggestionsMenu->addSeparator();
-                  auto act = new QAction(m_datastore->addColonIcon(),
-                                         tr("Call ColorDialog."));
-                  updateColorDialogMenu(act,
-                                        property,
-                                        status->name(),
-                                        status->offset(),
-                                        section->position,
-                                        &suggestionsMenu);
-                  break;
-                }
-                case FuzzyColorValue: {
-                  auto matches =
-                    m_datastore->fuzzySearchColorNames(status->name());
-                  message = tr("Color name is fuzzy: %1").arg(status->name());
-                  suggestionsMenu->clear();
-                  auto widgetact = getWidgetAction(
-                    m_datastore->invalidIcon(), message, suggestionsMenu);
-                  suggestionsMenu->addAction(widgetact);
-                  suggestionsMenu->addSeparator();
-                  auto act = new QAction(
-                    m_datastore->addColonIcon(),
-                    tr("Fuzzy color %1.<br>Possible values showing below."));
-                  act->setData(pos);
-                  updateMenu(matches,
-                             property,
-                             pos,
-                             &suggestionsMenu,
-                             SectionType::FuzzyPropertyValue,
-                             status->name(),
-                             status->offset());
-                  break;
-                }
-              }
-              status = status->next();
+          if (widget->hasSubControl()) {
+            for (auto subcontrol : *(widget->subControls())) {
+              extendSpan(selectors, subcontrol);
             }
-            break;
           }
-          case SectionType::Comment: {
-            qWarning();
-            break;
-          }
-          case SectionType::PropertyMarker: {
-            qWarning();
-            // TODO marker errors? maybe :: or ;
-            break;
+        }
+        for (auto& seperator : widgets->seperators()) {
+          extendSpan(selectors, seperator.anchor(), 1, ',');
+        }
+        spans.append(selectors);
+
+        // the brace formats depend on whether the other brace exists.
+        uint braces = (widgets->hasStartBrace() ? 1 : 0) |
+                      (widgets->hasEndBrace() ? 2 : 0);
+        if (widgets->hasStartBrace()) {
+          NodeSpan brace;
+          brace.start = widgets->startBracePosition();
+          extendSpan(brace, brace.start, 1, braces);
+          spans.append(brace);
+        }
+        if (widgets->hasEndBrace()) {
+          NodeSpan brace;
+          brace.start = widgets->endBracePosition();
+          extendSpan(brace, brace.start, 1, braces);
+          spans.append(brace);
+        }
+
+        for (int i = 0; i < widgets->propertyCount(); i++) {
+          auto property = widgets->property(i);
+          if (property) {
+            spans.append(propertySpan(property));
           }
         }
+        break;
+      }
+      case PropertyType:
+        spans.append(propertySpan(node_cast<PropertyNode>(node)));
+        break;
+      case CommentType: {
+        NodeSpan comment;
+        comment.start = node->position();
+        extendSpan(comment,
+                   node->position(),
+                   node->length(),
+                   uint(node_cast<CommentNode>(node)->hasEndComment()));
+        spans.append(comment);
+        break;
       }
+      default:
+        // newlines are not formatted.
+        break;
     }
   }
 
-  return suggestionsMenu;
+  return spans;
 }
 
-QTextCursor
-Parser::currentCursor() const
+//! Returns the spans that are in only one of the two generations, ie the
+//! text whose formatting has changed.
+QVector<NodeSpan>
+Parser::changedSpans(QVector<NodeSpan> previous,
+                     QVector<NodeSpan> current) const
 {
-  return m_datastore->currentCursor();
+  std::sort(previous.begin(), previous.end());
+  std::sort(current.begin(), current.end());
+
+  QVector<NodeSpan> changed;
+  std::set_symmetric_difference(previous.constBegin(),
+                                previous.constEnd(),
+                                current.constBegin(),
+                                current.constEnd(),
+                                std::back_inserter(changed));
+  return changed;
 }
 
+//! Rehighlights each block that a span touches once.
 void
-Parser::setCurrentCursor(const QTextCursor& currentCursor)
+Parser::rehighlightSpans(QVector<NodeSpan> spans)
 {
-  m_datastore->setCurrentCursor(currentCursor);
+  if (!m_editor || spans.isEmpty()) {
+    return;
+  }
+
+  std::sort(spans.begin(), spans.end());
+  auto document = m_editor->document();
+  int last = -1;
+
+  for (auto& span : spans) {
+    auto block = document->findBlock(qMax(span.start, 0));
+    if (!block.isValid()) {
+      continue;
+    }
+    if (block.blockNumber() <= last) {
+      block = document->findBlockByNumber(last + 1);
+    }
+    while (block.isValid() && block.position() <= span.end) {
+      emit rehighlightBlock(block);
+      last = block.blockNumber();
+      block = block.next();
+    }
+  }
 }
 
 void
-Parser::setMaxSuggestionCount(int maxSuggestionCount)
+Parser::discardNodes(QList<Node*> nodes)
 {
-  m_datastore->setMaxSuggestionCount(maxSuggestionCount);
+  // the arena releases the widgets, properties, sub controls, pseudo states
+  // and id selectors that each node holds.
+  for (auto node : nodes) {
+    m_arena->release(node);
+  }
 }
 
 void
-Parser::updateTextChange(QTextCursor& cursor,
-                         const QString& oldName,
-                         const QString& newName)
+Parser::retireArena(std::shared_ptr<NodeArena> arena)
 {
-  cursor.movePosition(QTextCursor::Right,
-                      QTextCursor::KeepAnchor,
-                      oldName.length()); // selection
-  cursor.insertText(newName);
-  cursor.movePosition(
-    QTextCursor::Left, QTextCursor::MoveAnchor, newName.length());
+  // A parse without an editor is not called back from the event loop and
+  // there may not be one, see StylesheetParser. The arena is freed once
+  // the last snapshot that holds it is let go of.
+  if (!arena || !m_editor) {
+    return;
+  }
+
+  // The old nodes may still be in use further up the call stack so they
+  // are only let go of once control returns to the event loop.
+  m_retiredArenas.append(std::move(arena));
+  if (m_retiredArenas.size() == 1) {
+    QMetaObject::invokeMethod(
+      this,
+      [this]() { m_retiredArenas.clear(); },
+      Qt::QueuedConnection);
+  }
 }
 
 void
-Parser::actionPropertyNameChange(PropertyNode* property, const QString& newName)
+Parser::rebuildNodes(const QString& text)
 {
-  auto cursor = property->cursor();
-  auto oldName = property->name();
-
-  updateTextChange(cursor, oldName, newName);
-
-  if (m_datastore->containsProperty(newName))
-    property->setPropertyNameCheck(NodeState::ValidNameState);
-  else if (!m_datastore->fuzzySearchProperty(newName).isEmpty()) {
-    property->setPropertyNameCheck(NodeState::FuzzyPropertyState);
-  } else {
-    property->setPropertyNameCheck(NodeState::BadNodeState);
-  }
-  property->setName(newName);
-  property->setCursor(cursor);
-  emit rehighlightBlock(cursor.block());
+  auto previous = nodeSpans(m_datastore->nodes().values());
+  retireArena(m_arena);
+  m_arena = std::make_shared<NodeArena>();
+  m_datastore->clearEdits();
+  auto nodes = parseText(text);
+  m_datastore->setNodes(nodes, m_arena);
+  rehighlightSpans(changedSpans(previous, nodeSpans(nodes.values())));
 }
 
 void
-Parser::actionPropertyValueChange(PropertyNode* property,
-                                  const QString& oldName,
-                                  const QString& newName)
+Parser::handleCursorPositionChanged(QTextCursor textCursor)
 {
-  auto index = property->indexOf(oldName);
-  auto position = property->valuePosition(index);
-  auto cursor = m_datastore->getCursorForPosition(position);
+  if (m_datastore->isManualMove()) {
+    return;
+  }
 
-  updateTextChange(cursor, oldName, newName);
+  setCurrentCursor(textCursor);
 
-  property->setValue(index, newName);
-  property->setStateFlag(index, ValidPropertyValueState);
-  property->setValueOffset(index, m_datastore->getCursorForPosition(position));
-  emit rehighlightBlock(property->cursor().block());
+  // The brace match is drawn as an extra selection so moving the cursor
+  // never invalidates the block formats.
+  updateBraceMatch(textCursor.anchor());
 }
 
+//! Looks up the brace that the cursor is on, or just after, in the brace
+//! table and tells the editor if the match differs from the last one.
 void
-Parser::actionPropertyMarker(PropertyNode* property)
+Parser::updateBraceMatch(int position)
 {
-  QTextCursor cursor = property->cursor();
-  cursor.movePosition(QTextCursor::Right,
-                      QTextCursor::MoveAnchor,
-                      property->name().length()); // selection
-  cursor.insertText(":");
-  property->setPropertyMarkerCursor(cursor);
-  property->setPropertyMarker(true);
-  emit rehighlightBlock(cursor.block());
+  QList<int> braces;
+  bool matched = false;
+  int partner;
+
+  if (m_datastore->braceAt(position, partner) ||
+      m_datastore->braceAt(--position, partner)) {
+    braces.append(position);
+    if (partner >= 0) {
+      braces.append(partner);
+      matched = true;
+    }
+  }
+
+  if (braces != m_matchedBraces) {
+    m_matchedBraces = braces;
+    emit braceMatchChanged(braces, matched);
+  }
 }
 
-void
-Parser::actionPropertyEndMarker(PropertyNode* property)
+QTextCursor
+Parser::currentCursor() const
 {
-  QTextCursor cursor = property->cursor();
-  cursor.movePosition(QTextCursor::Right,
-                      QTextCursor::MoveAnchor,
-                      property->length()); // selection
-  cursor.insertText(";");
-  property->setPropertyEndMarkerCursor(cursor);
-  property->setPropertyEndMarker(true);
-  emit rehighlightBlock(cursor.block());
+  return m_datastore->currentCursor();
 }
 
 void
-Parser::handleSuggestions(QAction* act)
+Parser::setCurrentCursor(const QTextCursor& currentCursor)
 {
-  QVariant v = act->data();
-  auto menuData = v.value<MenuData>();
-  auto node = menuData.node;
-  auto type = menuData.type;
-  auto oldName = menuData.oldName;
-  auto offset = menuData.offset;
-  auto index = menuData.index;
-  QPoint pos = act->data().toPoint();
-
-  if (node) {
-    auto newName = act->text();
-
-    switch (type) {
-      case ColorDialog: {
-        auto property = qobject_cast<PropertyNode*>(node);
-        auto colorDlg = new ExtendedColorDialog(m_editor);
-        if (QColor::isValidColor(oldName)) {
-          colorDlg->setColor(ColorType::Primary, QColor(oldName), oldName);
-        }
-        if (colorDlg->exec() == QDialog::Accepted) {
-          auto color = colorDlg->color(ColorType::Primary);
-          if (color.isValid()) {
-            QString value;
-            if (color.alpha() == 255)
-              value = color.name(QColor::HexRgb);
-            else
-              value = color.name(QColor::HexArgb);
-            // copy start offset
-            auto cursor = m_datastore->getCursorForPosition(offset);
-            // this moves offset to end on new text.
-            updateTextChange(cursor, oldName, value);
-            cursor.setPosition(offset, QTextCursor::MoveAnchor);
-            property->setValueName(index, value);
-            property->setValueState(index, PropertyValueState::GoodValue);
-            // reset offset.
-            property->setValueOffset(index, cursor);
-          }
-        }
-        break;
-      }
-      case FuzzyPropertyValue: {
-        auto property = qobject_cast<PropertyNode*>(node);
-        auto cursor = m_datastore->getCursorForPosition(offset);
-        updateTextChange(cursor, oldName, newName);
-        property->setValueName(index, newName);
-        property->setValueState(index, PropertyValueState::GoodValue);
-        property->setValueOffset(index, cursor);
-        break;
-      }
-      case FuzzyWidgetName: {
-        auto widget = qobject_cast<WidgetNode*>(node);
-        auto cursor = widget->cursor();
-        updateTextChange(cursor, widget->name(), newName);
-        widget->setName(newName);
-        widget->setWidgetCheck(NodeState::WidgetState);
-        if (widget->hasSubControl()) {
-          auto subcontrol = widget->subControl(pos);
-          auto [type, state] =
-            checkType(subcontrol->position(), subcontrol->name(), BadNodeState);
-          switch (state) {
-            case NodeState::SubControlState:
-            case NodeState::FuzzySubControlState:
-              widget->setSubControlMarkerCursor(subcontrol->cursor());
-              widget->setWidgetCheck(state);
-              break;
-            case NodeState::PseudostateState:
-            case NodeState::FuzzyPseudostateState:
-              //              widget->setPseudoStateMarkerCursor(widget->extensionCursor());
-              //              widget->setWidgetCheck(check);
-              break;
-            default:
-              qWarning();
-              break;
-          }
-        }
-        break;
-      }
-      case BadWidgetSubControl:
-      case FuzzyWidgetPseudoState:
-      case FuzzyWidgetSubControl: {
-        auto widget = qobject_cast<WidgetNode*>(node);
-        auto subcontrol = widget->subControl(pos);
-        if (subcontrol) {
-          oldName = subcontrol->name();
-          auto cursor = subcontrol->cursor();
-          updateTextChange(cursor, oldName, newName);
-          subcontrol->setName(newName);
-        }
-        break;
-      }
-      case WidgetPseudoStateMarker: {
-        auto widget = qobject_cast<WidgetNode*>(node);
-        if (widget->hasPseudoStates()) {
-          auto pseudostate = widget->pseudoState(pos);
-          if (pseudostate) {
-            auto cursor = pseudostate->cursor();
-            updateTextChange(cursor, "::", ":");
-          }
-        }
-        break;
-      }
-      case WidgetSubControlPseudoStateMarker: {
-        auto widget = qobject_cast<WidgetNode*>(node);
-        if (widget->hasSubControls()) {
-          auto subcontrol = widget->subControl(pos);
-          if (subcontrol) {
-            if (subcontrol->hasPseudoStates()) {
-              auto pseudostate = widget->pseudoState(pos);
-              if (pseudostate) {
-                auto cursor = pseudostate->cursor();
-                updateTextChange(cursor, "::", ":");
-              }
-            }
-          }
-        }
-        break;
-      }
-      case WidgetSubControlMarker: {
-        auto widget = qobject_cast<WidgetNode*>(node);
-        if (widget->hasSubControls()) {
-          auto subcontrol = widget->subControl(pos);
-          if (subcontrol) {
-            auto cursor = subcontrol->cursor();
-            updateTextChange(cursor, ":", "::");
-          }
-        }
-        break;
-      }
-      case WidgetName:
-      case WidgetPropertyName:
-      case WidgetPropertyValue:
-      case WidgetPropertyMarker:
-      case WidgetPropertyEndMarker:
-      case WidgetStartBrace:
-      case WidgetEndBrace:
-        qWarning();
-        break;
-
-      case Comment:
-        break;
-
-      case SectionType::PropertyName: {
-        m_datastore->setHasSuggestion(true);
-        actionPropertyNameChange(qobject_cast<PropertyNode*>(node), newName);
-        break;
-      }
-      case SectionType::PropertyValue: {
-        m_datastore->setHasSuggestion(true);
-        actionPropertyValueChange(
-          qobject_cast<PropertyNode*>(node), oldName, newName);
-        break;
-      }
-      case SectionType::PropertyMarker: {
-        m_datastore->setHasSuggestion(true);
-        actionPropertyMarker(qobject_cast<PropertyNode*>(node));
-        break;
-      }
-      case SectionType::PropertyEndMarker: {
-        m_datastore->setHasSuggestion(true);
-        actionPropertyEndMarker(qobject_cast<PropertyNode*>(node));
-        break;
-      }
-    }
+  m_datastore->setCurrentCursor(currentCursor);
+}
 
-    emit rehighlight();
-  }
+void
+Parser::setMaxSuggestionCount(int maxSuggestionCount)
+{
+  m_datastore->setMaxSuggestionCount(maxSuggestionCount);
 }
 
 int
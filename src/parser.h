@@ -21,21 +21,21 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <QColorDialog>
-#include <QMenu>
 #include <QObject>
 #include <QPoint>
+#include <QAtomicInt>
 #include <QStack>
+#include <QTextBlock>
 #include <QTextCursor>
-#include <QWidgetAction>
+#include <QThread>
 
 #include <algorithm>
+#include <memory>
 
 #include "common.h"
 #include "parserstate.h"
-#include "stylesheetedit/extendedcolordialog.h"
 
-class StylesheetEditor;
+class StylesheetView;
 class DataStore;
 class WidgetNode;
 class PropertyNode;
@@ -44,12 +44,11 @@ class EndBraceNode;
 class WidgetNode;
 class NewlineNode;
 class Node;
-
-class IconLabel : public QWidget
-{
-public:
-  IconLabel(const QIcon& icon, const QString& text, QWidget* parent);
-};
+class NodeArena;
+class QAction;
+class QIcon;
+class QMenu;
+class QWidgetAction;
 
 struct ParserData
 {
@@ -72,12 +71,36 @@ struct ParserData
   {}
 };
 
+//! A formatted range of the text and a hash of everything that decides how
+//! the highlighter formats it. Two node generations are compared span by
+//! span so that only the text that changed is rehighlighted.
+struct NodeSpan
+{
+  int start = 0;
+  int end = 0;
+  uint signature = 0;
+
+  bool operator==(const NodeSpan& other) const
+  {
+    return (start == other.start && end == other.end &&
+            signature == other.signature);
+  }
+  bool operator<(const NodeSpan& other) const
+  {
+    if (start != other.start)
+      return start < other.start;
+    if (end != other.end)
+      return end < other.end;
+    return signature < other.signature;
+  }
+};
+
 class Parser : public QObject
 {
   Q_OBJECT
 public:
   explicit Parser(DataStore* datastore,
-                  StylesheetEditor* editor,
+                  StylesheetView* editor,
                   QObject* parent = nullptr);
   Parser(const Parser&);
 
@@ -86,6 +109,8 @@ public:
   Parser& operator=(const Parser&);
 
   void parseInitialText(const QString& text);
+  //! Returns the text of the document as it is after the last edit.
+  const QString& text() const;
 
   //  StylesheetData* getStylesheetProperty(const QString& sheet, int& pos);
   void handleDocumentChanged(int offset, int charsRemoved, int charsAdded);
@@ -98,33 +123,90 @@ public:
   void setMaxSuggestionCount(int maxSuggestionCount);
 
   void handleSuggestions(QAction* act);
+  void suggestionMade(bool);
 
-  void nodeForPoint(const QPoint& pos, NodeSection** nodeSection);
+  NodeSection nodeForPoint(const QPoint& pos);
 
   bool showLineMarkers() const;
   void setShowLineMarkers(bool showLineMarkers);
 
+  //! Returns true if parseInitialText() parses on a background thread.
+  bool isBackgroundParse() const;
+  //! If set then parseInitialText() will parse a snapshot of the text on a
+  //! background thread. The nodes are only installed if the document has
+  //! not changed since the snapshot was taken, a newer edit cancels any
+  //! parse that is still running.
+  void setBackgroundParse(bool backgroundParse);
+
+  //! Returns true if unknown names are not fuzzy searched while parsing.
+  bool isLazyFuzzySearch() const;
+  //! If set then a name that is not a keyword is given a node type from its
+  //! position in the rule and marked as FuzzyPendingState. The fuzzy search
+  //! is only run when the node is asked for its matches.
+  void setLazyFuzzySearch(bool lazyFuzzySearch);
+
+  //! Returns true if large stylesheets are parsed in parallel.
+  bool isParallelParse() const;
+  //! If set then the top level rules of a large stylesheet are parsed
+  //! concurrently on the global thread pool and merged in document order.
+  void setParallelParse(bool parallelParse);
+
 signals:
   void finished();
   void parseComplete(bool initialsed = false);
   void rehighlight();
   void rehighlightBlock(const QTextBlock& block);
+  //! Sent when the braces matched at the cursor change. An empty list
+  //! means that the cursor is not at a brace.
+  void braceMatchChanged(QList<int> positions, bool matched);
 
   void setBraceCount(int);
 
 private:
-  StylesheetEditor* m_editor;
+  StylesheetView* m_editor;
   DataStore* m_datastore;
   //  QAction *m_addPropertyMarkerAct,
   //    *m_addPropertyEndMarkerAct;
   bool m_showLineMarkers;
+  bool m_backgroundParse = false;
+  bool m_lazyFuzzySearch = false;
+  bool m_parallelParse = false;
+  bool m_followsNodes = false;
+  bool m_parseInFlight = false;
+  // The plain text of the document, set by parseInitialText() and kept in
+  // step with each edit by updateText().
+  QString m_text;
+  QList<int> m_matchedBraces;
+  QThread* m_parseThread = nullptr;
+  Parser* m_parseWorker = nullptr;
+  // The revision of the latest requested background parse.
+  QAtomicInt m_parseRevision = -1;
+  // Only set on the background worker.
+  Parser* m_owner = nullptr;
+  int m_revision = -1;
+  // Owns the nodes currently held by the datastore, shared with the
+  // datastore and the snapshots that it has handed out.
+  std::shared_ptr<NodeArena> m_arena;
+  // Replaced generations, let go of once control is back in the event loop.
+  QList<std::shared_ptr<NodeArena>> m_retiredArenas;
+  // Below this many released nodes a generation is never rebuilt.
+  static const int MIN_RELEASED_NODES = 512;
+  static const int MIN_PARALLEL_CHUNK = 16384;
+
+  void startBackgroundParse(const QString& text);
+  void backgroundParse(const QString& text, int revision);
+  void installBackgroundParse(QMap<TextPosition, Node*> nodes,
+                              std::shared_ptr<NodeArena> arena,
+                              int revision);
+  void attachNodes(QMap<TextPosition, Node*>& nodes);
+  bool isParseCancelled() const;
 
-  void parsePropertyWithValues(QMap<QTextCursor, Node*>* nodes,
+  void parsePropertyWithValues(QMap<TextPosition, Node*>* nodes,
                                PropertyNode* property,
                                const QString& text,
                                int start,
                                int& pos);
-  void parseComment(QMap<QTextCursor, Node*>* nodes,
+  void parseComment(QMap<TextPosition, Node*>* nodes,
                     const QString& text,
                     int start,
                     int& pos);
@@ -141,13 +223,17 @@ private:
   //                          QTextCursor cursor,
   //                          const QString& block,
   //                          NodeCheck check = NodeCheck::WidgetCheck);
-  //  void stashBadNode(QMap<QTextCursor, Node*>* nodes,
+  //  void stashBadNode(QMap<TextPosition, Node*>* nodes,
   //                    int position,
   //                    const QString& block,
   //                    ParserState::Error error);
-  void stashNewline(QMap<QTextCursor, Node*>* nodes, int position);
-  //  void stashEndBrace(QMap<QTextCursor, Node*>* nodes, int position);
-  //  void stashStartBrace(QMap<QTextCursor, Node*>* nodes, int position);
+  void stashNewline(QMap<TextPosition, Node*>* nodes, int position);
+  void updateBraceMatch(int position);
+  bool isBlankAfter(const QString& text, int position) const;
+  PropertyNode* updateFinalProperty(const QString& text, Node* node);
+  void updateText(int offset, int charsRemoved, int charsAdded);
+  //  void stashEndBrace(QMap<TextPosition, Node*>* nodes, int position);
+  //  void stashStartBrace(QMap<TextPosition, Node*>* nodes, int position);
 
   void updateContextMenu(QMap<int, QString> matches,
                          WidgetNode* node,
@@ -215,20 +301,31 @@ private:
                                        const QString& block,
                                        NodeState lastState,
                                        PropertyNode* property = nullptr) const;
+  NodeType pendingType(const QString& text, int start, bool inRule) const;
   QWidgetAction* getWidgetAction(const QIcon& icon,
                                  const QString& text,
                                  QMenu* suggestionsMenu);
 
-  void updateTextChange(QTextCursor& cursor,
-                        const QString& oldName,
-                        const QString& newName);
+  TextPosition updateTextChange(int position,
+                                const QString& oldName,
+                                const QString& newName);
   void setMenuData(QAction* act,
                    Node* property,
                    SectionType type,
                    const QString& oldName = QString(),
                    int offset = -1,
                    int index = -1);
-  QMap<QTextCursor, Node*> parseText(const QString& text);
+  QMap<TextPosition, Node*> parseText(const QString& text);
+  QMap<TextPosition, Node*> parseText(const QString& text, int& pos, int end);
+  QMap<TextPosition, Node*> parallelParseText(const QString& text);
+  QList<int> ruleBoundaries(const QString& text) const;
+  void discardNodes(QList<Node*> nodes);
+  void retireArena(std::shared_ptr<NodeArena> arena);
+  void rebuildNodes(const QString& text);
+  QVector<NodeSpan> nodeSpans(const QList<Node*>& nodes) const;
+  QVector<NodeSpan> changedSpans(QVector<NodeSpan> previous,
+                                 QVector<NodeSpan> current) const;
+  void rehighlightSpans(QVector<NodeSpan> spans);
 };
 
 #endif // PARSER_H
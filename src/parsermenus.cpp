@@ -0,0 +1,1116 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+#include "parser.h"
+
+#include "datastore.h"
+#include "node.h"
+#include "stylesheetedit/extendedcolordialog.h"
+#include "stylesheetedit_p.h"
+
+#include <QGridLayout>
+#include <QLabel>
+#include <QMenu>
+#include <QWidgetAction>
+#include <QtDebug>
+
+/*
+   The suggestion menus of the parser and the edits made from them. They
+   need widgets so they are built with the editor and not with the parser
+   library, which only parses.
+*/
+
+class IconLabel : public QWidget
+{
+public:
+  IconLabel(const QIcon& icon, const QString& text, QWidget* parent);
+};
+
+//! The icons of the suggestion menus, loaded from the editor resources the
+//! first time that a menu is shown.
+struct MenuIcons
+{
+  QIcon invalid = QIcon(":/icons/invalid");
+  QIcon valid = QIcon(":/icons/valid");
+  QIcon addSemiColon = QIcon(":/icons/add-scolon");
+  QIcon addDColon = QIcon(":/icons/add-dcolon");
+  QIcon addColon = QIcon(":/icons/add-colon");
+  QIcon bad = QIcon(":/icons/bad");
+  QIcon badSemiColon = QIcon(":/icons/bad-scolon");
+  QIcon badColon = QIcon(":/icons/bad-colon");
+  QIcon badDColon = QIcon(":/icons/bad-dcolon");
+  QIcon no = QIcon(":/icons/no");
+  QIcon fuzzy = QIcon(":/icons/fuzzy");
+};
+
+static const MenuIcons&
+menuIcons()
+{
+  static const MenuIcons icons;
+  return icons;
+}
+
+//! The menus are only built for a StylesheetEditor, which is the widget
+//! that they belong to.
+static QWidget*
+editorWidget(StylesheetView* view)
+{
+  return static_cast<StylesheetEditor*>(view);
+}
+
+IconLabel::IconLabel(const QIcon& icon, const QString& text, QWidget* parent)
+  : QWidget(parent)
+{
+  auto layout = new QGridLayout;
+  //  setContentsMargins(0, 0, 0, 0);
+  //  layout->setContentsMargins(0, 0, 0, 0);
+  setLayout(layout);
+  auto iconLbl = new QLabel(this);
+  auto pix = icon.pixmap(QSize(16, 16));
+  iconLbl->setPixmap(pix);
+  layout->addWidget(iconLbl, 0, 0);
+  auto textLbl = new QLabel(text, this);
+  layout->addWidget(textLbl, 0, 1);
+}
+
+void
+Parser::updateContextMenu(QMap<int, QString> matches,
+                          WidgetNode* node,
+                          const QPoint& pos,
+                          QMenu** suggestionsMenu)
+{
+  QString typeName;
+  (*suggestionsMenu)->clear();
+
+  switch (node->type()) {
+    case NodeType::WidgetType:
+      typeName = "widget";
+      break;
+  }
+
+  QAction* act =
+    (*suggestionsMenu)
+      ->addSection(menuIcons().invalid,
+                   tr("%1 is not a valid %2 name").arg(node->name(), typeName));
+  act->setData(pos);
+  (*suggestionsMenu)->addSeparator();
+
+  updateMenu(matches, node, pos, suggestionsMenu, SectionType::WidgetName);
+}
+
+void
+Parser::updatePropertyContextMenu(
+  PropertyNode* property,
+  const QPoint& pos,
+  QMenu** suggestionsMenu,
+  QMap<int, QString> matches = QMap<int, QString>())
+{
+  QAction* act;
+  (*suggestionsMenu)->clear();
+
+  if (!property->isValidPropertyName()) {
+    act = (*suggestionsMenu)
+            ->addSection(
+              menuIcons().invalid,
+              tr("%1 is not a valid property name").arg(property->name()));
+    act->setData(pos);
+    (*suggestionsMenu)->addAction(act);
+    (*suggestionsMenu)->addSeparator();
+    updateMenu(
+      matches, property, pos, suggestionsMenu, SectionType::PropertyName);
+  } else if (!property->hasPropertyMarker()) {
+    act = new QAction(
+      menuIcons().invalid,
+      tr("%1 is missing a property marker (:)").arg(property->name()));
+    (*suggestionsMenu)->addAction(act);
+    (*suggestionsMenu)->addSeparator();
+    act =
+      new QAction(menuIcons().addColon, tr("Add property marker (:)"));
+    act->setData(pos);
+    (*suggestionsMenu)->addAction(act);
+    setMenuData(act, property, SectionType::PropertyMarker);
+    connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+  } else if (!property->hasPropertyEndMarker()) {
+    act =
+      new QAction(menuIcons().badSemiColon,
+                  tr("%1 is missing an end marker (;)").arg(property->name()));
+    (*suggestionsMenu)->addAction(act);
+    (*suggestionsMenu)->addSeparator();
+    act = new QAction(menuIcons().addSemiColon,
+                      tr("Add property end marker (;)"));
+    act->setData(pos);
+    (*suggestionsMenu)->addAction(act);
+    setMenuData(act, property, SectionType::PropertyEndMarker);
+    connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+  } else {
+    act =
+      new QAction(menuIcons().valid,
+                  tr("Property %1 appears to be valid!").arg(property->name()));
+    act->setData(pos);
+    (*suggestionsMenu)->addAction(act);
+    (*suggestionsMenu)->addSeparator();
+  }
+}
+
+QWidgetAction*
+Parser::getWidgetAction(const QIcon& icon, const QString& text, QMenu* menu)
+{
+  auto lbl = new IconLabel(icon, text, editorWidget(m_editor));
+  auto act = new QWidgetAction(menu);
+  act->setDefaultWidget(lbl);
+  return act;
+}
+
+void
+Parser::updateSubControlMenu(WidgetNode* widget,
+                             const QString& name,
+                             QPoint pos,
+                             QMenu** suggestionsMenu)
+{
+  if (!widget->isSubControlValid(pos)) {
+    if (widget->isSubControlFuzzy(pos, m_datastore)) {
+      auto matches = widget->subControl(pos)->fuzzyMatches(m_datastore);
+      (*suggestionsMenu)->clear();
+      auto widgetact = getWidgetAction(
+        menuIcons().fuzzy,
+        tr("Fuzzy sub control %1.<br>Possible values showing below.").arg(name),
+        *suggestionsMenu);
+      (*suggestionsMenu)->addAction(widgetact);
+      (*suggestionsMenu)->addSeparator();
+      updateMenu(matches,
+                 widget,
+                 pos,
+                 suggestionsMenu,
+                 SectionType::FuzzyWidgetSubControl);
+    } else if (widget->isSubControlBad(pos)) {
+      if (widget->isSubControl()) {
+        auto matches = m_datastore->fuzzySearchSubControl(name);
+        (*suggestionsMenu)->clear();
+        auto widgetact = getWidgetAction(menuIcons().fuzzy,
+                                         tr("Sub control %1 does not match <br>"
+                                            "supplied widget %2.<br>"
+                                            "Possible sub controls are.")
+                                           .arg(name, widget->name()),
+                                         *suggestionsMenu);
+        (*suggestionsMenu)->addAction(widgetact);
+        (*suggestionsMenu)->addSeparator();
+        auto act = new QAction(menuIcons().addDColon,
+                               tr("Change to sub control marker (::)"));
+        (*suggestionsMenu)->addAction(act);
+        setMenuData(act, widget, SectionType::WidgetSubControlMarker);
+        connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+        (*suggestionsMenu)->addSeparator();
+        updateMenu(matches,
+                   widget,
+                   pos,
+                   suggestionsMenu,
+                   SectionType::FuzzyWidgetSubControl);
+      } else if (widget->isPseudoState()) {
+        auto matches = m_datastore->fuzzySearchSubControl(name);
+        (*suggestionsMenu)->clear();
+        auto widgetact =
+          getWidgetAction(menuIcons().fuzzy,
+                          tr("Pseudo state %1 does not match <br>"
+                             "supplied widget %2.<br>"
+                             "Possible states are.")
+                            .arg(name, widget->name()),
+                          *suggestionsMenu);
+        (*suggestionsMenu)->addAction(widgetact);
+        (*suggestionsMenu)->addSeparator();
+        updateMenu(matches,
+                   widget,
+                   pos,
+                   suggestionsMenu,
+                   SectionType::FuzzyWidgetSubControl);
+      }
+    } else if (!widget->doesMarkerMatch(SubControlState)) {
+      (*suggestionsMenu)->clear();
+      auto widgetact = getWidgetAction(
+        menuIcons().badColon,
+        tr("Sub control %1 does not match<br>pseudo state marker (::)")
+          .arg(name),
+        *suggestionsMenu);
+      (*suggestionsMenu)->addAction(widgetact);
+      (*suggestionsMenu)->addSeparator();
+      auto act = new QAction(menuIcons().addDColon,
+                             tr("Change to sub control marker (::)"));
+      (*suggestionsMenu)->addAction(act);
+      setMenuData(act, widget, SectionType::WidgetSubControlMarker);
+      connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+    }
+  } else if (widget->isSubControlBad(pos)) {
+    auto subcontrols =
+      m_datastore->possibleSubControlsForWidget(widget->name());
+    (*suggestionsMenu)->clear();
+    auto widgetact =
+      getWidgetAction(menuIcons().invalid,
+                      tr("Sub control %1 does not match widget %2<br>"
+                         "possible sub controls are:")
+                        .arg(name)
+                        .arg(widget->name()),
+                      *suggestionsMenu);
+    (*suggestionsMenu)->addAction(widgetact);
+    (*suggestionsMenu)->addSeparator();
+    updateMenu(subcontrols,
+               widget,
+               pos,
+               suggestionsMenu,
+               SectionType::BadWidgetSubControl);
+  }
+}
+
+void
+Parser::updatePseudoStateMenu(WidgetNode* widget,
+                              QPoint pos,
+                              QMenu** suggestionsMenu)
+{
+  auto pseudoState = widget->pseudoState(pos);
+  if (pseudoState) {
+    auto name = pseudoState->name();
+    if (widget->isSubControlFuzzy(pos, m_datastore)) {
+      auto matches = pseudoState->fuzzyMatches(m_datastore);
+      (*suggestionsMenu)->clear();
+      auto widgetact = getWidgetAction(
+        menuIcons().fuzzy,
+        tr("Fuzzy pseudo state name.<br>Possible values showing below.")
+          .arg(name),
+        *suggestionsMenu);
+      (*suggestionsMenu)->addAction(widgetact);
+      (*suggestionsMenu)->addSeparator();
+      updateMenu(matches,
+                 widget,
+                 pos,
+                 suggestionsMenu,
+                 SectionType::FuzzyWidgetPseudoState);
+    } else if (!widget->doesMarkerMatch(PseudostateState)) {
+      (*suggestionsMenu)->clear();
+      auto widgetact = getWidgetAction(
+        menuIcons().badDColon,
+        tr("Pseudo state %1 does not match<br>sub control marker (:)")
+          .arg(name),
+        *suggestionsMenu);
+      (*suggestionsMenu)->addAction(widgetact);
+      (*suggestionsMenu)->addSeparator();
+      auto act = new QAction(menuIcons().addColon,
+                             tr("Change to pseudo state marker (:)"));
+      (*suggestionsMenu)->addAction(act);
+      setMenuData(act, widget, SectionType::WidgetPseudoStateMarker);
+      connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+    }
+  }
+}
+
+void
+Parser::updateValidPropertyValueContextMenu(QMultiMap<int, QString> matches,
+                                            QPoint pos,
+                                            PropertyNode* property,
+                                            const QString& valueName,
+                                            QMenu** suggestionsMenu)
+{
+  (*suggestionsMenu)->clear();
+
+  auto keys = matches.keys(valueName);
+  for (auto& key : keys) {
+    matches.remove(key, valueName);
+  }
+
+  auto act = getWidgetAction(
+    menuIcons().valid,
+    tr("%1 is a valid value for %2.<br>Other suggestions are : ")
+      .arg(valueName, property->name()),
+    *suggestionsMenu);
+  (*suggestionsMenu)->addAction(act);
+  (*suggestionsMenu)->addSeparator();
+
+  updateMenu(matches, property, pos, suggestionsMenu, SectionType::None);
+}
+
+void
+Parser::setMenuData(QAction* act,
+                    Node* node,
+                    SectionType type,
+                    const QString& oldName,
+                    int offset,
+                    int index)
+{
+  MenuData data;
+  data.node = node;
+  data.type = type;
+  data.oldName = oldName;
+  data.offset = offset;
+  data.index = index;
+  QVariant v;
+  v.setValue<MenuData>(data);
+  act->setData(v);
+}
+
+void
+Parser::updateInvalidPropertyValueContextMenu(QMultiMap<int, QString> matches,
+                                              QPoint pos,
+                                              PropertyNode* property,
+                                              const QString& valueName,
+                                              QMenu** suggestionsMenu)
+{
+  (*suggestionsMenu)->clear();
+
+  auto keys = matches.keys(valueName);
+  for (auto& key : keys) {
+    matches.remove(key, valueName);
+  }
+
+  auto act = getWidgetAction(
+    menuIcons().invalid,
+    tr("%1 is an invalid value for %2.<br>Possible suggestions are : ")
+      .arg(valueName, property->name()),
+    *suggestionsMenu);
+  (*suggestionsMenu)->addAction(act);
+  (*suggestionsMenu)->addSeparator();
+
+  updateMenu(matches,
+             property,
+             pos,
+             suggestionsMenu,
+             SectionType::PropertyValue,
+             valueName);
+}
+
+void
+Parser::updateInvalidNameAndPropertyValueContextMenu(
+  QMultiMap<int, QPair<QString, QString>> matches,
+  PropertyNode* nNode,
+  const QString& valueName,
+  const QPoint& pos,
+  QMenu** suggestionsMenu)
+{
+  (*suggestionsMenu)->clear();
+
+  (*suggestionsMenu)
+    ->addSection(menuIcons().invalid,
+                 tr("%1 is not a valid property value for %2")
+                   .arg(valueName, nNode->name()));
+  if (matches.isEmpty()) {
+    (*suggestionsMenu)
+      ->addSection(menuIcons().no, tr("No suggestions are available!"));
+    return;
+  }
+
+  auto reversed = sortLastNValues(matches);
+
+  QString s("%1 : %2");
+  for (auto& pair : reversed) {
+    auto act = new QAction(s.arg(pair.first, pair.second));
+    (*suggestionsMenu)->addAction(act);
+    QVariant v;
+    v.setValue(qMakePair<NamedNode*, QPoint>(nNode, pos));
+    act->setData(v);
+    connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+  }
+
+  if (reversed.size() > 0) {
+    (*suggestionsMenu)->setEnabled(true);
+  }
+}
+
+void
+Parser::updateMenu(QStringList matches,
+                   Node* nNode,
+                   QPoint pos,
+                   QMenu** suggestionsMenu,
+                   SectionType type,
+                   const QString& oldName)
+{
+  QAction* act;
+
+  if (matches.isEmpty()) {
+    (*suggestionsMenu)
+      ->addSection(menuIcons().no, tr("No suggestions are available!"));
+    return;
+  }
+
+  auto reversed = reverseList(matches, m_datastore->maxSuggestionCount());
+
+  for (auto& match : reversed) {
+    act = new QAction(match);
+    act->setData(pos);
+    (*suggestionsMenu)->addAction(act);
+    setMenuData(act, nNode, type, oldName);
+    connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+  }
+
+  if (reversed.size() > 0) {
+    (*suggestionsMenu)->setEnabled(true);
+  }
+}
+
+void
+Parser::updateMenu(QMap<int, QString> matches,
+                   Node* nNode,
+                   QPoint pos,
+                   QMenu** suggestionsMenu,
+                   SectionType type,
+                   const QString& oldName,
+                   int offset,
+                   int index)
+{
+  QAction* act;
+
+  if (matches.isEmpty()) {
+    (*suggestionsMenu)
+      ->addSection(menuIcons().no, tr("No suggestions are available!"));
+    return;
+  }
+
+  auto reversed = reverseLastNValues(matches);
+
+  for (auto& key : reversed) {
+    act = new QAction(matches.value(key));
+    (*suggestionsMenu)->addAction(act);
+    setMenuData(act, nNode, type, oldName, offset, index);
+    connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+  }
+
+  if (reversed.size() > 0) {
+    (*suggestionsMenu)->setEnabled(true);
+  }
+}
+
+QList<int>
+Parser::reverseLastNValues(QMultiMap<int, QString> matches)
+{
+  //  QMultiMap<int, QString> rMatches;
+  auto keys = matches.keys();
+  QList<int> reversed;
+  QList<int>::reverse_iterator i;
+
+  for (i = keys.rbegin(); i != keys.rend(); ++i) {
+    if (reversed.size() > m_datastore->maxSuggestionCount()) {
+      break;
+    }
+
+    reversed << *i;
+  }
+
+  return reversed;
+}
+
+QStringList
+Parser::reverseList(QStringList list, int count)
+{
+  std::reverse(list.begin(), list.end());
+  return list.mid(0, count - 1);
+}
+
+QList<QPair<QString, QString>>
+Parser::sortLastNValues(QMultiMap<int, QPair<QString, QString>> matches)
+{
+  //  QMultiMap<int, QPair<QString, QString>> rMatches;
+  QList<QPair<QString, QString>> sorted;
+  auto values = matches.values();
+  for (auto& v : values) {
+    auto lf = v.first.length();
+    if (sorted.size() == 0) {
+      sorted.append(v);
+      continue;
+    } else {
+      bool success = false;
+      for (int i = 0; i < sorted.length(); i++) {
+        if (i == m_datastore->maxSuggestionCount())
+          return sorted;
+        auto spair = sorted.at(i);
+        if (spair.first.length() > lf) {
+          sorted.insert(i, v);
+          success = true;
+        }
+      } // end for
+      if (!success) {
+        sorted.append(v);
+      }
+      continue;
+    }
+  } // end for
+  return sorted;
+}
+
+void
+Parser::updateColorDialogMenu(QAction* act,
+                              PropertyNode* property,
+                              const QString& name,
+                              int offset,
+                              int index,
+                              QMenu** suggestionsMenu)
+{
+  MenuData data;
+  data.node = property;
+  data.type = SectionType::ColorDialog;
+  data.oldName = name;
+  data.offset = offset;
+  data.index = index;
+  QVariant v;
+  v.setValue<MenuData>(data);
+  act->setData(v);
+  (*suggestionsMenu)->addAction(act);
+  connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+}
+
+QMenu*
+Parser::handleMouseClicked(const QPoint& pos)
+{
+  auto section = nodeForPoint(pos);
+
+  QMenu* suggestionsMenu = new QMenu(tr("&Suggestions"));
+
+  if (section.node && section.node != m_datastore->currentNode()) {
+    switch (section.node->type()) {
+
+      case NodeType::WidgetType: {
+        auto widget = node_cast<WidgetNode>(section.node);
+        switch (section.type) {
+          case WidgetName: {
+            if (widget->isNameFuzzy(m_datastore)) {
+              auto matches = widget->fuzzyMatches(m_datastore);
+              suggestionsMenu->clear();
+              auto widgetact = getWidgetAction(
+                menuIcons().fuzzy,
+                tr("Fuzzy widget name.<br>Possible values showing below.")
+                  .arg(widget->subControl(pos)->name()),
+                suggestionsMenu);
+              suggestionsMenu->addAction(widgetact);
+              suggestionsMenu->addSeparator();
+              updateMenu(matches,
+                         widget,
+                         pos,
+                         &suggestionsMenu,
+                         SectionType::FuzzyWidgetName);
+            } else {
+              qWarning();
+            }
+            break;
+          }
+          case WidgetSubControlName: {
+            auto name = widget->subControl(pos)->name();
+            updateSubControlMenu(widget, name, pos, &suggestionsMenu);
+            break;
+          }
+          case SectionType::WidgetSubControlMarker: {
+            auto name = widget->subControl(pos)->name();
+            updateSubControlMenu(widget, name, pos, &suggestionsMenu);
+            break;
+          }
+          case WidgetPseudoState: {
+            updatePseudoStateMenu(widget, pos, &suggestionsMenu);
+            break;
+          }
+          case SectionType::WidgetPseudoStateMarker: {
+            updatePseudoStateMenu(widget, pos, &suggestionsMenu);
+            break;
+          }
+          case WidgetPropertyName: {
+            qWarning();
+            break;
+          }
+          case SectionType::WidgetPropertyMarker: {
+            qWarning();
+            break;
+          }
+          case WidgetPropertyValue: {
+            qWarning();
+            break;
+          }
+          case WidgetPropertyEndMarker: {
+            qWarning();
+            break;
+          }
+        }
+      } // end WidgetType
+
+      case NodeType::PropertyType: {
+        auto property = node_cast<PropertyNode>(section.node);
+        switch (section.type) {
+          case SectionType::PropertyName: {
+            auto minCount = property->minCount();
+            auto maxCount = property->maxCount();
+            auto count = property->valueCount();
+
+            if (count > maxCount) {
+              suggestionsMenu->clear();
+              auto widgetact =
+                getWidgetAction(menuIcons().bad,
+                                tr("Too many values %1, maximum is %2")
+                                  .arg(count)
+                                  .arg(maxCount),
+                                suggestionsMenu);
+              suggestionsMenu->addAction(widgetact);
+            } else if (count < minCount) {
+              suggestionsMenu->clear();
+              auto widgetact = getWidgetAction(
+                menuIcons().bad,
+                tr("Not enough values, should be %1").arg(minCount),
+                suggestionsMenu);
+              suggestionsMenu->addAction(widgetact);
+            } else if (!property->hasPropertyEndMarker() &&
+                       !property->isFinalProperty()) {
+              suggestionsMenu->clear();
+              auto widgetact =
+                getWidgetAction(menuIcons().badDColon,
+                                tr("Property has no end marker (;)"),
+                                suggestionsMenu);
+              suggestionsMenu->addAction(widgetact);
+              suggestionsMenu->addSeparator();
+              auto act =
+                new QAction(menuIcons().addColon, tr("Add end marker"));
+              suggestionsMenu->addAction(act);
+              setMenuData(act, property, SectionType::PropertyEndMarker);
+              connect(act, &QAction::triggered, this, &Parser::suggestionMade);
+            } else {
+              if (property->isValidPropertyName()) {
+                updatePropertyContextMenu(property, pos, &suggestionsMenu);
+              } else {
+                auto matches = property->fuzzyMatches(m_datastore);
+                updatePropertyContextMenu(
+                  property, pos, &suggestionsMenu, matches);
+              }
+            }
+            break;
+          }
+          case SectionType::PropertyValue: {
+            auto valName = property->value(section.position);
+            auto status = property->valueStatus(section.position);
+            QString message;
+            while (status) {
+              auto name = property->statusName(status);
+              switch (status->state()) {
+                case GoodValue: {
+                  if (QColor::isValidColor(name)) {
+                    message = tr("Color value is good: %1").arg(name);
+                    suggestionsMenu->clear();
+                    auto widgetact = getWidgetAction(
+                      menuIcons().invalid, message, suggestionsMenu);
+                    suggestionsMenu->addAction(widgetact);
+                    suggestionsMenu->addSeparator();
+                    auto act = new QAction(menuIcons().addColon,
+                                           tr("Call ColorDialog."));
+                    updateColorDialogMenu(act,
+                                          property,
+                                          name,
+                                          status->offset(),
+                                          section.position,
+                                          &suggestionsMenu);                  }
+                  break;
+                }
+                case BadValue: {
+                  if (property->valueRect(status).contains(pos)) {
+                    for (auto i = 0; i < status->sectionCount(); i++) {
+                      if (property->sectionRect(status, i).contains(pos)) {
+                        auto state = status->sectionState(i);
+                        switch (state) {
+                          case BadValueName:
+                            message = tr("Bad value name %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case FuzzyValueName:
+                            message = tr("Value name is fuzzy %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case FuzzyColorValue:
+                            message = tr("Color name is fuzzy %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case BadColorValue:
+                            message = tr("Color name is bad %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case BadUrlValue:
+                            message = tr("URL value is bad %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case BadValueCount:
+                            message = tr("Wrong number of parameters %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case RepeatValueName:
+                            message = tr("Value name was repeated %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case BadNumericalValue:
+                            message = tr("Numerical parameter is bad %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                          case BadNumericalValue_31:
+                            message =
+                              tr("Numerical parameter should be 0-31 : %1")
+                                .arg(property->sectionName(status, i));
+                            break;
+                          case BadNumericalValue_100:
+                            message =
+                              tr("Numerical parameter should be 0-100 : %1")
+                                .arg(property->sectionName(status, i));
+                            break;
+                          case BadNumericalValue_255:
+                            message =
+                              tr("Numerical parameter should be 0-255 : %1")
+                                .arg(property->sectionName(status, i));
+                            break;
+                          case BadNumericalValue_359:
+                            message =
+                              tr("Numerical parameter should be 0-359 : %1")
+                                .arg(property->sectionName(status, i));
+                            break;
+                          case BadLengthUnit:
+                            message =
+                              tr("Should have a unit (px, pt, em, ex) : %1")
+                                .arg(property->sectionName(status, i));
+                            break;
+                          case BadFontUnit:
+                            message = tr("Should have a unit (px, pt) : %1")
+                                        .arg(property->sectionName(status, i));
+                            break;
+                        }
+                        suggestionsMenu->clear();
+                        auto widgetact = getWidgetAction(
+                          menuIcons().invalid, message, suggestionsMenu);
+                        suggestionsMenu->addAction(widgetact);
+                      }
+                    }
+                  }
+                  break;
+                }
+                case BadHashColorValue: {
+                  message = tr("Color value is bad: %1").arg(name);
+                  suggestionsMenu->clear();
+                  auto widgetact = getWidgetAction(
+                    menuIcons().invalid, message, suggestionsMenu);
+                  suggestionsMenu->addAction(widgetact);
+                  suggestionsMenu->addSeparator();
+                  auto act = new QAction(menuIcons().addColon,
+                                         tr("Call ColorDialog."));
+                  updateColorDialogMenu(act,
+                                        property,
+                                        name,
+                                        status->offset(),
+                                        section.position,
+                                        &suggestionsMenu);
+                  break;
+                }
+                case BadColorValue: {
+                  message = tr("Color value is bad: %1").arg(name);
+                  suggestionsMenu->clear();
+                  auto widgetact = getWidgetAction(
+                    menuIcons().invalid, message, suggestionsMenu);
+                  suggestionsMenu->addAction(widgetact);
+                  suggestionsMenu->addSeparator();
+                  auto act = new QAction(menuIcons().addColon,
+                                         tr("Call ColorDialog."));
+                  updateColorDialogMenu(act,
+                                        property,
+                                        name,
+                                        status->offset(),
+                                        section.position,
+                                        &suggestionsMenu);
+                  break;
+                }
+                case FuzzyColorValue: {
+                  auto matches =
+                    m_datastore->fuzzySearchColorNames(name);
+                  message = tr("Color name is fuzzy: %1").arg(name);
+                  suggestionsMenu->clear();
+                  auto widgetact = getWidgetAction(
+                    menuIcons().invalid, message, suggestionsMenu);
+                  suggestionsMenu->addAction(widgetact);
+                  suggestionsMenu->addSeparator();
+                  auto act = new QAction(
+                    menuIcons().addColon,
+                    tr("Fuzzy color %1.<br>Possible values showing below."));
+                  act->setData(pos);
+                  updateMenu(matches,
+                             property,
+                             pos,
+                             &suggestionsMenu,
+                             SectionType::FuzzyPropertyValue,
+                             name,
+                             status->offset());
+                  break;
+                }
+              }
+              status = status->next();
+            }
+            break;
+          }
+          case SectionType::Comment: {
+            qWarning();
+            break;
+          }
+          case SectionType::PropertyMarker: {
+            qWarning();
+            // TODO marker errors? maybe :: or ;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  return suggestionsMenu;
+}
+
+TextPosition
+Parser::updateTextChange(int position,
+                         const QString& oldName,
+                         const QString& newName)
+{
+  auto cursor = m_datastore->getCursorForPosition(position);
+  cursor.movePosition(QTextCursor::Right,
+                      QTextCursor::KeepAnchor,
+                      oldName.length()); // selection
+  cursor.insertText(newName);
+  // existing positions at position will have followed the new text.
+  return m_datastore->textPosition(position);
+}
+
+void
+Parser::actionPropertyNameChange(PropertyNode* property, const QString& newName)
+{
+  auto oldName = property->name();
+
+  auto cursor = updateTextChange(property->position(), oldName, newName);
+
+  if (m_datastore->containsProperty(newName))
+    property->setPropertyNameCheck(NodeState::ValidNameState);
+  else if (!m_datastore->fuzzySearchProperty(newName).isEmpty()) {
+    property->setPropertyNameCheck(NodeState::FuzzyPropertyState);
+  } else {
+    property->setPropertyNameCheck(NodeState::BadNodeState);
+  }
+  property->setName(newName);
+  property->setCursor(cursor);
+  emit rehighlightBlock(m_editor->document()->findBlock(cursor.position()));
+}
+
+void
+Parser::actionPropertyValueChange(PropertyNode* property,
+                                  const QString& oldName,
+                                  const QString& newName)
+{
+  auto index = property->indexOf(oldName);
+  auto position = property->valuePosition(index);
+
+  auto cursor = updateTextChange(position, oldName, newName);
+
+  property->setValue(index, newName);
+  property->setStateFlag(index, ValidPropertyValueState);
+  property->setValueOffset(index, cursor);
+  emit rehighlightBlock(m_editor->document()->findBlock(position));
+}
+
+void
+Parser::actionPropertyMarker(PropertyNode* property)
+{
+  int position = property->position() + property->name().length();
+  auto cursor = m_datastore->getCursorForPosition(position);
+  cursor.insertText(":");
+  property->setPropertyMarkerCursor(m_datastore->textPosition(position));
+  property->setPropertyMarker(true);
+  emit rehighlightBlock(cursor.block());
+}
+
+void
+Parser::actionPropertyEndMarker(PropertyNode* property)
+{
+  int position = property->position() + property->length();
+  auto cursor = m_datastore->getCursorForPosition(position);
+  cursor.insertText(";");
+  property->setPropertyEndMarkerCursor(m_datastore->textPosition(position));
+  property->setPropertyEndMarker(true);
+  emit rehighlightBlock(cursor.block());
+}
+
+void
+Parser::suggestionMade(bool)
+{
+  auto act = qobject_cast<QAction*>(sender());
+
+  if (act) {
+    handleSuggestions(act);
+  }
+}
+
+void
+Parser::handleSuggestions(QAction* act)
+{
+  QVariant v = act->data();
+  auto menuData = v.value<MenuData>();
+  auto node = menuData.node;
+  auto type = menuData.type;
+  auto oldName = menuData.oldName;
+  auto offset = menuData.offset;
+  auto index = menuData.index;
+  QPoint pos = act->data().toPoint();
+
+  if (node) {
+    auto newName = act->text();
+
+    switch (type) {
+      case ColorDialog: {
+        auto property = node_cast<PropertyNode>(node);
+        auto colorDlg = new ExtendedColorDialog(editorWidget(m_editor));
+        auto literal = parseColor(oldName);
+        if (literal.isValid()) {
+          colorDlg->setColor(
+            ColorType::Primary, QColor::fromRgba(literal.rgb), oldName);
+        } else if (QColor::isValidColor(oldName)) {
+          colorDlg->setColor(ColorType::Primary, QColor(oldName), oldName);
+        }
+        if (colorDlg->exec() == QDialog::Accepted) {
+          auto color = colorDlg->color(ColorType::Primary);
+          if (color.isValid()) {
+            QString value;
+            if (color.alpha() == 255)
+              value = color.name(QColor::HexRgb);
+            else
+              value = color.name(QColor::HexArgb);
+            auto cursor = updateTextChange(offset, oldName, value);
+            property->setValueName(index, value);
+            property->setValueState(index, PropertyValueState::GoodValue);
+            // reset offset.
+            property->setValueOffset(index, cursor);
+          }
+        }
+        break;
+      }
+      case FuzzyPropertyValue: {
+        auto property = node_cast<PropertyNode>(node);
+        auto cursor = updateTextChange(offset, oldName, newName);
+        property->setValueName(index, newName);
+        property->setValueState(index, PropertyValueState::GoodValue);
+        property->setValueOffset(index, cursor);
+        break;
+      }
+      case FuzzyWidgetName: {
+        auto widget = node_cast<WidgetNode>(node);
+        updateTextChange(widget->position(), widget->name(), newName);
+        widget->setName(newName);
+        widget->setWidgetCheck(NodeState::WidgetState);
+        if (widget->hasSubControl()) {
+          auto subcontrol = widget->subControl(pos);
+          auto [type, state] =
+            checkType(subcontrol->position(), subcontrol->name(), BadNodeState);
+          switch (state) {
+            case NodeState::SubControlState:
+            case NodeState::FuzzySubControlState:
+              widget->setSubControlMarkerCursor(subcontrol->cursor());
+              widget->setWidgetCheck(state);
+              break;
+            case NodeState::PseudostateState:
+            case NodeState::FuzzyPseudostateState:
+              //              widget->setPseudoStateMarkerCursor(widget->extensionCursor());
+              //              widget->setWidgetCheck(check);
+              break;
+            default:
+              qWarning();
+              break;
+          }
+        }
+        break;
+      }
+      case BadWidgetSubControl:
+      case FuzzyWidgetPseudoState:
+      case FuzzyWidgetSubControl: {
+        auto widget = node_cast<WidgetNode>(node);
+        auto subcontrol = widget->subControl(pos);
+        if (subcontrol) {
+          oldName = subcontrol->name();
+          updateTextChange(subcontrol->namePosition(), oldName, newName);
+          subcontrol->setName(newName);
+        }
+        break;
+      }
+      case WidgetPseudoStateMarker: {
+        auto widget = node_cast<WidgetNode>(node);
+        if (widget->hasPseudoStates()) {
+          auto pseudostate = widget->pseudoState(pos);
+          if (pseudostate) {
+            updateTextChange(pseudostate->position(), "::", ":");
+          }
+        }
+        break;
+      }
+      case WidgetSubControlPseudoStateMarker: {
+        auto widget = node_cast<WidgetNode>(node);
+        if (widget->hasSubControls()) {
+          auto subcontrol = widget->subControl(pos);
+          if (subcontrol) {
+            if (subcontrol->hasPseudoStates()) {
+              auto pseudostate = widget->pseudoState(pos);
+              if (pseudostate) {
+                updateTextChange(pseudostate->position(), "::", ":");
+              }
+            }
+          }
+        }
+        break;
+      }
+      case WidgetSubControlMarker: {
+        auto widget = node_cast<WidgetNode>(node);
+        if (widget->hasSubControls()) {
+          auto subcontrol = widget->subControl(pos);
+          if (subcontrol) {
+            updateTextChange(subcontrol->position(), ":", "::");
+          }
+        }
+        break;
+      }
+      case WidgetName:
+      case WidgetPropertyName:
+      case WidgetPropertyValue:
+      case WidgetPropertyMarker:
+      case WidgetPropertyEndMarker:
+      case WidgetStartBrace:
+      case WidgetEndBrace:
+        qWarning();
+        break;
+
+      case Comment:
+        break;
+
+      case SectionType::PropertyName: {
+        m_datastore->setHasSuggestion(true);
+        actionPropertyNameChange(node_cast<PropertyNode>(node), newName);
+        break;
+      }
+      case SectionType::PropertyValue: {
+        m_datastore->setHasSuggestion(true);
+        actionPropertyValueChange(
+          node_cast<PropertyNode>(node), oldName, newName);
+        break;
+      }
+      case SectionType::PropertyMarker: {
+        m_datastore->setHasSuggestion(true);
+        actionPropertyMarker(node_cast<PropertyNode>(node));
+        break;
+      }
+      case SectionType::PropertyEndMarker: {
+        m_datastore->setHasSuggestion(true);
+        actionPropertyEndMarker(node_cast<PropertyNode>(node));
+        break;
+      }
+    }
+
+    emit rehighlight();
+  }
+}
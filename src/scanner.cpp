@@ -0,0 +1,326 @@
+/*
+   Copyright 2020 Simon Meaden
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy of this
+   software and associated documentation files (the "Software"), to deal in the Software
+   without restriction, including without limitation the rights to use, copy, modify, merge,
+   publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+                                                                         persons to whom the Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all copies or
+   substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+   INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+    PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+   OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+      SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "scanner.h"
+
+#include <QtAlgorithms>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCANNER_AVX2
+#elif (defined(__GNUC__) || defined(__clang__)) &&                            \
+  (defined(__x86_64__) || defined(__i386__))
+// Without -mavx2 the AVX2 scans are still built, for the avx2 target only,
+// and are used if the cpu supports them.
+#include <immintrin.h>
+#define SCANNER_AVX2
+#define SCANNER_AVX2_DISPATCH
+#endif
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCANNER_SSE2
+#endif
+
+#if defined(SCANNER_AVX2_DISPATCH)
+#define SCANNER_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define SCANNER_AVX2_TARGET
+#endif
+
+// The vector helpers are overloaded on the vector type so that the scans
+// below are written once for both widths. Comparisons are signed so any
+// code unit of 0x8000 or above never matches an ASCII range.
+
+#if defined(SCANNER_SSE2)
+static inline __m128i
+load(const ushort* data, __m128i)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+static inline __m128i
+equal(__m128i v, short c)
+{
+  return _mm_cmpeq_epi16(v, _mm_set1_epi16(c));
+}
+
+static inline __m128i
+inRange(__m128i v, short low, short high)
+{
+  return _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16(low - 1)),
+                       _mm_cmpgt_epi16(_mm_set1_epi16(high + 1), v));
+}
+
+static inline __m128i
+either(__m128i a, __m128i b)
+{
+  return _mm_or_si128(a, b);
+}
+
+static inline __m128i
+both(__m128i a, __m128i b)
+{
+  return _mm_and_si128(a, b);
+}
+
+static inline __m128i
+without(__m128i a, __m128i b)
+{
+  return _mm_andnot_si128(b, a);
+}
+
+static inline __m128i
+toLower(__m128i v)
+{
+  return _mm_or_si128(v, _mm_set1_epi16(0x20));
+}
+
+//! Two bits per code unit, both set when the code unit matched.
+static inline uint
+laneMask(__m128i v)
+{
+  return uint(_mm_movemask_epi8(v)) & 0xffff;
+}
+#endif
+
+#if defined(SCANNER_AVX2)
+SCANNER_AVX2_TARGET static inline __m256i
+load(const ushort* data, __m256i)
+{
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+}
+
+SCANNER_AVX2_TARGET static inline __m256i
+equal(__m256i v, short c)
+{
+  return _mm256_cmpeq_epi16(v, _mm256_set1_epi16(c));
+}
+
+SCANNER_AVX2_TARGET static inline __m256i
+inRange(__m256i v, short low, short high)
+{
+  return _mm256_and_si256(_mm256_cmpgt_epi16(v, _mm256_set1_epi16(low - 1)),
+                          _mm256_cmpgt_epi16(_mm256_set1_epi16(high + 1), v));
+}
+
+SCANNER_AVX2_TARGET static inline __m256i
+either(__m256i a, __m256i b)
+{
+  return _mm256_or_si256(a, b);
+}
+
+SCANNER_AVX2_TARGET static inline __m256i
+both(__m256i a, __m256i b)
+{
+  return _mm256_and_si256(a, b);
+}
+
+SCANNER_AVX2_TARGET static inline __m256i
+without(__m256i a, __m256i b)
+{
+  return _mm256_andnot_si256(b, a);
+}
+
+SCANNER_AVX2_TARGET static inline __m256i
+toLower(__m256i v)
+{
+  return _mm256_or_si256(v, _mm256_set1_epi16(0x20));
+}
+
+SCANNER_AVX2_TARGET static inline uint
+laneMask(__m256i v)
+{
+  return uint(_mm256_movemask_epi8(v));
+}
+#endif
+
+#if defined(SCANNER_AVX2_DISPATCH) && !defined(__clang__)
+// the matches and the generic scans below pass 256 bit vectors to the avx2
+// helpers when they are used by the avx2 scans. They are always inlined into
+// those, so no vector is passed between functions built for different
+// targets.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+struct SpaceMatch
+{
+  bool stopAtNewline;
+
+  bool matches(ushort c) const
+  {
+    return (c == ' ' || (c >= '\t' && c <= '\r')) &&
+           !(stopAtNewline && c == '\n');
+  }
+
+  //! Returns the laneMask() of the code units in v that match.
+  template<class V>
+  Q_ALWAYS_INLINE uint matches(const V& v) const
+  {
+    auto match = either(equal(v, ' '), inRange(v, '\t', '\r'));
+    return laneMask(stopAtNewline ? without(match, equal(v, '\n')) : match);
+  }
+};
+
+struct NameMatch
+{
+  bool matches(ushort c) const
+  {
+    return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ||
+           (c >= '0' && c <= '9') || c == '-';
+  }
+
+  template<class V>
+  Q_ALWAYS_INLINE uint matches(const V& v) const
+  {
+    return laneMask(
+      either(either(inRange(toLower(v), 'a', 'z'), inRange(v, '0', '9')),
+             equal(v, '-')));
+  }
+};
+
+//! Skips whole vectors of matching code units, returning the index of the
+//! first code unit that does not match or of the unscanned tail.
+template<class V, class Match>
+static Q_ALWAYS_INLINE int
+skipVectors(const ushort* data, int pos, int length, const Match& match)
+{
+  const int lanes = int(sizeof(V) / sizeof(ushort));
+  const uint all = (lanes == 16 ? 0xffffffffu : 0xffffu);
+
+  for (; pos + lanes <= length; pos += lanes) {
+    auto mask = ~match.matches(load(data + pos, V())) & all;
+    if (mask) {
+      return pos + int(qCountTrailingZeroBits(mask)) / 2;
+    }
+  }
+  return pos;
+}
+
+#if defined(SCANNER_AVX2)
+//! Returns true if the AVX2 scans can be used on this cpu.
+static bool
+hasAvx2()
+{
+#if defined(SCANNER_AVX2_DISPATCH)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+#else
+  return true;
+#endif
+}
+
+template<class Match>
+SCANNER_AVX2_TARGET static int
+skipVectorsAvx2(const ushort* data, int pos, int length, const Match& match)
+{
+  return skipVectors<__m256i>(data, pos, length, match);
+}
+#endif
+
+template<class Match>
+static int
+skipMatching(const QString& text, int pos, const Match& match)
+{
+  auto data = text.utf16();
+  int length = text.length();
+
+#if defined(SCANNER_AVX2)
+  if (hasAvx2()) {
+    pos = skipVectorsAvx2(data, pos, length, match);
+  }
+#endif
+#if defined(SCANNER_SSE2)
+  pos = skipVectors<__m128i>(data, pos, length, match);
+#endif
+
+  while (pos < length && match.matches(data[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+//! Searches whole vectors for a '*' followed by a '/', comparing each code
+//! unit with '*' and the one after it with '/'.
+template<class V>
+static Q_ALWAYS_INLINE int
+findCommentEndIn(const ushort* data, int& pos, int length)
+{
+  const int lanes = int(sizeof(V) / sizeof(ushort));
+
+  for (; pos + lanes < length; pos += lanes) {
+    auto mask = laneMask(both(equal(load(data + pos, V()), '*'),
+                              equal(load(data + pos + 1, V()), '/')));
+    if (mask) {
+      return pos + int(qCountTrailingZeroBits(mask)) / 2;
+    }
+  }
+  return -1;
+}
+
+#if defined(SCANNER_AVX2)
+SCANNER_AVX2_TARGET static int
+findCommentEndAvx2(const ushort* data, int& pos, int length)
+{
+  return findCommentEndIn<__m256i>(data, pos, length);
+}
+#endif
+
+#if defined(SCANNER_AVX2_DISPATCH) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+int
+Scanner::skipSpaces(const QString& text, int pos, bool stopAtNewline)
+{
+  return skipMatching(text, pos, SpaceMatch{ stopAtNewline });
+}
+
+int
+Scanner::skipName(const QString& text, int pos)
+{
+  return skipMatching(text, pos, NameMatch());
+}
+
+int
+Scanner::findCommentEnd(const QString& text, int pos)
+{
+  auto data = text.utf16();
+  int length = text.length();
+  int end = -1;
+
+#if defined(SCANNER_AVX2)
+  if (hasAvx2() && (end = findCommentEndAvx2(data, pos, length)) >= 0) {
+    return end;
+  }
+#endif
+#if defined(SCANNER_SSE2)
+  if ((end = findCommentEndIn<__m128i>(data, pos, length)) >= 0) {
+    return end;
+  }
+#endif
+
+  for (; pos + 1 < length; pos++) {
+    if (data[pos] == '*' && data[pos + 1] == '/') {
+      return pos;
+    }
+  }
+  return end;
+}
@@ -0,0 +1,46 @@
+/*
+   Copyright 2020 Simon Meaden
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy of this
+   software and associated documentation files (the "Software"), to deal in the Software
+   without restriction, including without limitation the rights to use, copy, modify, merge,
+   publish, distribute, sublicense, and/or sell copies of the Software, and to permit
+                                                                         persons to whom the Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all copies or
+   substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+   INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+    PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+   OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+      SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <QString>
+
+//! Bulk scans of the stylesheet text used by the tokenizer.
+//!
+//! The scans test several UTF-16 code units at a time, using SSE2 when the
+//! compiler targets it, AVX2 when the cpu supports it and a scalar loop
+//! otherwise. Only ASCII is recognised, a scan stops at the first non-ASCII
+//! code unit so that the caller can classify it with QChar.
+class Scanner
+{
+public:
+  //! Returns the index of the first character at or after pos that is not
+  //! ASCII whitespace. If stopAtNewline is true a newline also stops the
+  //! scan.
+  static int skipSpaces(const QString& text, int pos, bool stopAtNewline);
+  //! Returns the index of the first character at or after pos that is not
+  //! an ASCII letter, digit or '-'.
+  static int skipName(const QString& text, int pos);
+  //! Returns the index of the "*/" at or after pos that ends a comment, or
+  //! -1 if there is none.
+  static int findCommentEnd(const QString& text, int pos);
+};
+
+#endif // SCANNER_H
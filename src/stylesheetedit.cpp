@@ -33,6 +33,7 @@
 #include "stylesheetedit_p.h"
 #include "stylesheethighlighter.h"
 
+#include <QMessageBox>
 #include <QtDebug>
 
 StylesheetEdit::StylesheetEdit(QWidget* parent)
@@ -90,6 +91,42 @@ StylesheetEdit::showNewlineMarkers()
   return m_editor->showNewlineMarkers();
 }
 
+void
+StylesheetEdit::setBackgroundParse(bool background)
+{
+  m_editor->setBackgroundParse(background);
+}
+
+bool
+StylesheetEdit::isBackgroundParse()
+{
+  return m_editor->isBackgroundParse();
+}
+
+void
+StylesheetEdit::setLazyFuzzySearch(bool lazy)
+{
+  m_editor->setLazyFuzzySearch(lazy);
+}
+
+bool
+StylesheetEdit::isLazyFuzzySearch()
+{
+  return m_editor->isLazyFuzzySearch();
+}
+
+void
+StylesheetEdit::setParallelParse(bool parallel)
+{
+  m_editor->setParallelParse(parallel);
+}
+
+bool
+StylesheetEdit::isParallelParse()
+{
+  return m_editor->isParallelParse();
+}
+
 QString
 StylesheetEdit::styleSheet() const
 {
@@ -630,7 +667,6 @@ StylesheetEditor::StylesheetEditor(DataStore* datastore, QWidget* parent)
   , m_parser(new Parser(m_datastore, this))
   , m_highlighter(new StylesheetHighlighter(this, m_datastore))
   , m_parseComplete(false)
-  , m_oldSection(new NodeSection(this))
 {
   m_datastore->setEditor(this);
   setFont(QFont("Source Code Pro", 9));
@@ -661,6 +697,10 @@ StylesheetEditor::setup(BookmarkArea* bookmarkArea,
           &Parser::rehighlightBlock,
           this,
           &StylesheetEditor::handleRehighlightBlock);
+  connect(m_parser,
+          &Parser::braceMatchChanged,
+          this,
+          &StylesheetEditor::handleBraceMatchChanged);
 
   connect(this,
           &QPlainTextEdit::cursorPositionChanged,
@@ -948,6 +988,23 @@ StylesheetEditor::errorMsg(const char* text)
   qWarning() << "Yaml parsing error : " << text;
 }
 
+bool
+StylesheetEditor::saveXmlConfig(const QString& filename)
+{
+  auto path = QDir(m_datastore->configDir()).filePath(filename + ".xml");
+  auto overwrite = false;
+  if (QFile::exists(path)) {
+    if (QMessageBox::question(this,
+                              tr("File already exists!"),
+                              tr("Press Yes to Overwrite")) ==
+        QMessageBox::No) {
+      return false;
+    }
+    overwrite = true;
+  }
+  return m_datastore->saveXmlScheme(filename, overwrite);
+}
+
 void
 StylesheetEditor::loadYamlConfig(const QString& filename)
 {
@@ -1232,15 +1289,23 @@ StylesheetEditor::addCustomWidgetPropertyValues(const QString& widget,
 void
 StylesheetEditor::setPlainText(const QString& text)
 {
+  // The highlighter is detached while the text is replaced so that the
+  // document is only highlighted once, with the new nodes, when it is
+  // given back.
+  disconnect(document(),
+             &QTextDocument::contentsChange,
+             this,
+             &StylesheetEditor::documentChanged);
+  m_highlighter->setDocument(nullptr);
   QPlainTextEdit::setPlainText(text);
   calculateLineNumber(textCursor());
   m_parser->parseInitialText(text);
+  m_highlighter->setDocument(document());
   connect(document(),
           &QTextDocument::contentsChange,
           this,
           &StylesheetEditor::documentChanged,
           Qt::UniqueConnection);
-  handleRehighlight();
 }
 
 void
@@ -1255,16 +1320,40 @@ StylesheetEditor::handleRehighlightBlock(const QTextBlock& block)
   m_highlighter->rehighlightBlock(block);
 }
 
-DataStore*
-StylesheetEditor::datastore()
+void
+StylesheetEditor::handleBraceMatchChanged(QList<int> positions, bool matched)
 {
-  return m_datastore;
+  m_matchedBraces = positions;
+  m_bracesMatched = matched;
+  updateBraceSelections();
+}
+
+//! The matched braces are extra selections rather than block formats so
+//! that they can follow the cursor without rehighlighting the document.
+void
+StylesheetEditor::updateBraceSelections()
+{
+  QList<QTextEdit::ExtraSelection> selections;
+  auto format = (m_bracesMatched ? m_highlighter->braceMatchFormat()
+                                 : m_highlighter->badBraceMatchFormat());
+
+  for (auto position : m_matchedBraces) {
+    QTextEdit::ExtraSelection selection;
+    selection.format = format;
+    selection.cursor = QTextCursor(document());
+    selection.cursor.setPosition(position);
+    selection.cursor.movePosition(QTextCursor::NextCharacter,
+                                  QTextCursor::KeepAnchor);
+    selections.append(selection);
+  }
+
+  setExtraSelections(selections);
 }
 
 void
 StylesheetEditor::handleParseComplete()
 {
-  m_highlighter->rehighlight();
+  // the parser has already rehighlighted the blocks that changed.
   setLineNumber(1);
   m_parseComplete = true;
   emit lineNumber(currentLineNumber());
@@ -1283,6 +1372,42 @@ StylesheetEditor::showNewlineMarkers()
   return m_parser->showLineMarkers();
 }
 
+void
+StylesheetEditor::setBackgroundParse(bool background)
+{
+  m_parser->setBackgroundParse(background);
+}
+
+bool
+StylesheetEditor::isBackgroundParse()
+{
+  return m_parser->isBackgroundParse();
+}
+
+void
+StylesheetEditor::setLazyFuzzySearch(bool lazy)
+{
+  m_parser->setLazyFuzzySearch(lazy);
+}
+
+bool
+StylesheetEditor::isLazyFuzzySearch()
+{
+  return m_parser->isLazyFuzzySearch();
+}
+
+void
+StylesheetEditor::setParallelParse(bool parallel)
+{
+  m_parser->setParallelParse(parallel);
+}
+
+bool
+StylesheetEditor::isParallelParse()
+{
+  return m_parser->isParallelParse();
+}
+
 // void
 // StylesheetEditorPrivate::setShowNewlineMarkers(bool show)
 //{
@@ -1953,21 +2078,21 @@ StylesheetEditor::setBraceMatchFormat(QBrush color,
                                       QTextCharFormat::UnderlineStyle style)
 {
   m_highlighter->setBraceMatchFormat(color, back, font, underline, style);
-  m_highlighter->rehighlight();
+  updateBraceSelections();
 }
 
 void
 StylesheetEditor::setBraceMatchFormat(QTextCharFormat format)
 {
   m_highlighter->setBraceMatchFormat(format);
-  m_highlighter->rehighlight();
+  updateBraceSelections();
 }
 
 void
 StylesheetEditor::setBadBraceMatchFormat(QTextCharFormat format)
 {
   m_highlighter->setBadBraceMatchFormat(format);
-  m_highlighter->rehighlight();
+  updateBraceSelections();
 }
 
 void
@@ -2428,16 +2553,6 @@ StylesheetEditor::cursorPositionHasChanged()
   m_parser->handleCursorPositionChanged(textCursor());
 }
 
-void
-StylesheetEditor::suggestionMade(bool)
-{
-  auto act = dynamic_cast<QAction*>(sender());
-
-  if (act) {
-    m_parser->handleSuggestions(act);
-  }
-}
-
 void StylesheetEditor::bookmarkMenuRequested(QPoint /*pos*/)
 {
   qWarning();
@@ -41,6 +41,7 @@
 #include "stylesheetedit/labelledlineedit.h"
 #include "stylesheetedit/labelledspinbox.h"
 #include "stylesheethighlighter.h"
+#include "stylesheetview.h"
 
 /// \cond DO_NOT_DOCUMENT
 
@@ -56,7 +57,9 @@ class Emitter;
 class Node;
 }
 
-class StylesheetEditor : public QPlainTextEdit
+class StylesheetEditor
+  : public QPlainTextEdit
+  , public StylesheetView
 {
   Q_OBJECT
 public:
@@ -66,10 +69,7 @@ public:
   void setup(BookmarkArea* bookmarkArea, LineNumberArea* linenumberArea);
   void saveYamlConfig(const QString& filename = QString());
   void loadYamlConfig(const QString& filename = QString());
-  bool saveXmlConfig(const QString& filename = QString())
-  {
-    return m_datastore->saveXmlScheme(filename);
-  }
+  bool saveXmlConfig(const QString& filename = QString());
   bool loadXmlConfig(const QString& filename = QString())
   {
     return m_datastore->loadXmlTheme(filename);
@@ -81,6 +81,13 @@ public:
   void setShowNewlineMarkers(bool show);
   bool showNewlineMarkers();
 
+  void setBackgroundParse(bool background);
+  bool isBackgroundParse();
+  void setLazyFuzzySearch(bool lazy);
+  bool isLazyFuzzySearch();
+  void setParallelParse(bool parallel);
+  bool isParallelParse();
+
   QString styleSheet() const;
   void setStyleSheet(const QString& stylesheet);
   bool checkStylesheetColors(StylesheetData* data,
@@ -370,8 +377,25 @@ public:
 
   void handleRehighlight();
   void handleRehighlightBlock(const QTextBlock& block);
+  void handleBraceMatchChanged(QList<int> positions, bool matched);
 
-  DataStore* datastore();
+  DataStore* datastore() override { return m_datastore; }
+  QTextDocument* document() const override
+  {
+    return QPlainTextEdit::document();
+  }
+  QFontMetrics fontMetrics() const override
+  {
+    return QPlainTextEdit::fontMetrics();
+  }
+  QRect cursorRect(const QTextCursor& cursor) const override
+  {
+    return QPlainTextEdit::cursorRect(cursor);
+  }
+  QTextCursor cursorForPosition(const QPoint& pos) const override
+  {
+    return QPlainTextEdit::cursorForPosition(pos);
+  }
 
 signals:
   void lineNumber(int);
@@ -389,16 +413,17 @@ private:
   QString m_stylesheet;
   bool m_parseComplete;
   int m_bookmarkLineNumber;
+  QList<int> m_matchedBraces;
+  bool m_bracesMatched = false;
   //  QString m_configDir;
   //  QString m_configFile;
 
   QMenu *m_contextMenu, *m_suggestionsMenu;
-  NodeSection* m_oldSection;
+  NodeSection m_oldSection;
 
   //  void setupConfiguration();
 
   void setLineNumber(int lineNumber);
-  void suggestionMade(bool);
   void bookmarkMenuRequested(QPoint pos);
   void linenumberMenuRequested(QPoint pos);
   QString getValueAtCursor(int anchor, const QString& text);
@@ -418,6 +443,7 @@ private:
 
   //  void updateLeftArea(const QRect& rect, int dy);
   void updateLineNumberArea();
+  void updateBraceSelections();
   QTextCursor currentCursor() const;
   void setCurrentCursor(const QTextCursor& currentCursor);
   void setLineData(QTextCursor cursor);
@@ -327,14 +327,12 @@ StylesheetHighlighter::formatProperty(PropertyNode* property,
 
   NodeState check;
   PropertyStatus* status;
-  QString value;
   bool breakLoop = false;
 
   for (int i = 0; i < property->count(); i++) {
     status = property->valueStatus(i);
-    value = property->value(i);
     check = property->check(i);
-    length = value.length();
+    length = status->length();
     breakLoop = false;
 
     while (status) {
@@ -434,21 +432,10 @@ StylesheetHighlighter::formatProperty(PropertyNode* property,
   }
 }
 
-bool
-StylesheetHighlighter::checkForEmpty(const QString& text)
-{
-  if (text.isEmpty() || text.trimmed().isEmpty()) {
-    return true;
-  }
-  return false;
-}
-
 void
 StylesheetHighlighter::highlightBlock(const QString& text)
 {
-  auto nodes = m_datastore->nodes();
-
-  if (text.isEmpty() || nodes.isEmpty()) {
+  if (text.isEmpty()) {
     return;
   }
 
@@ -456,29 +443,20 @@ StylesheetHighlighter::highlightBlock(const QString& text)
   auto blockStart = block.position();
   auto blockEnd = blockStart + block.text().length();
 
-  auto keys = nodes.keys();
-  for (auto& key : keys) {
-    auto node = nodes.value(key);
+  // only the nodes that overlap this block.
+  m_datastore->nodesInRange(blockStart, blockEnd, m_blockNodes);
+  for (auto node : m_blockNodes) {
     auto type = node->type();
-    int nodeStart = node->position();
-    auto length = node->length();
-    auto nodeEnd = nodeStart + length;
+    int length;
     int position;
 
-    if (nodeEnd < blockStart) {
-      continue;
-
-    } else if (nodeStart >= blockEnd) {
-      break;
-    }
-
     switch (type) {
       case NodeType::NewlineType:
         break;
 
         //      case NodeType::FuzzyWidgetType:
       case WidgetsType: {
-        auto widgets = qobject_cast<WidgetNodes*>(node);
+        auto widgets = node_cast<WidgetNodes>(node);
         if (widgets) {
           for (auto& widget : widgets->widgets()) {
             position = widget->position();
@@ -574,10 +552,9 @@ StylesheetHighlighter::highlightBlock(const QString& text)
 
       case NodeType::PropertyType: {
         //        qDebug() << type << " text : " << text;
-        PropertyNode* property = qobject_cast<PropertyNode*>(node);
-        auto t = m_editor->toPlainText();
-        bool finalBlock = checkForEmpty(t.mid(property->end()));
-        formatProperty(property, blockStart, blockEnd, finalBlock);
+        PropertyNode* property = node_cast<PropertyNode>(node);
+        formatProperty(
+          property, blockStart, blockEnd, property->isFinalProperty());
         break;
       }
 
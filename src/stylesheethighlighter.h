@@ -24,9 +24,11 @@
 
 #include <QList>
 #include <QSyntaxHighlighter>
+#include <QVector>
 
 class StylesheetEditor;
 class DataStore;
+class Node;
 class PseudoState;
 class SubControl;
 class IDSelector;
@@ -275,6 +277,8 @@ public:
 private:
   StylesheetEditor* m_editor;
   DataStore* m_datastore;
+  // reused by highlightBlock() so that no block allocates.
+  QVector<Node*> m_blockNodes;
   QTextCharFormat m_baseFormat;
   QTextCharFormat m_widgetFormat;
   QTextCharFormat m_badWidgetFormat;
@@ -326,7 +330,6 @@ private:
                       int blockStart,
                       int blockEnd,
                       bool finalBlock = false);
-  bool checkForEmpty(const QString& text);
   void formatControlBase(ControlBase* control,
                          int blockStart,
                          int blockEnd,
@@ -0,0 +1,223 @@
+/*
+   Copyright 2020 Simon Meaden
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+*/
+#include "stylesheetedit/stylesheetparser.h"
+
+#include "datastore.h"
+#include "node.h"
+#include "parser.h"
+
+StylesheetParser::StylesheetParser(QObject* parent)
+  : QObject(parent)
+  , m_datastore(new DataStore())
+  , m_parser(new Parser(m_datastore, nullptr, this))
+{}
+
+StylesheetParser::~StylesheetParser()
+{
+  // the nodes belong to the parser so it must go first.
+  delete m_parser;
+  delete m_datastore;
+}
+
+void
+StylesheetParser::parse(const QString& text)
+{
+  m_parser->parseInitialText(text);
+}
+
+QMap<int, Node*>
+StylesheetParser::nodes() const
+{
+  QMap<int, Node*> nodes;
+  auto snapshot = m_datastore->nodes();
+  for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it) {
+    nodes.insert(it.key().position(), it.value());
+  }
+  return nodes;
+}
+
+QList<StylesheetDiagnostic>
+StylesheetParser::diagnostics() const
+{
+  QList<StylesheetDiagnostic> diagnostics;
+
+  for (auto node : m_datastore->nodes()) {
+    if (auto widgets = node_cast<WidgetNodes>(node)) {
+      widgetDiagnostics(widgets, diagnostics);
+    } else if (auto property = node_cast<PropertyNode>(node)) {
+      // a property outside of a rule needs no end marker if it is last.
+      propertyDiagnostics(property, property->isFinalProperty(), diagnostics);
+    }
+  }
+
+  return diagnostics;
+}
+
+void
+StylesheetParser::setParallelParse(bool parallel)
+{
+  m_parser->setParallelParse(parallel);
+}
+
+bool
+StylesheetParser::isParallelParse() const
+{
+  return m_parser->isParallelParse();
+}
+
+void
+StylesheetParser::widgetDiagnostics(
+  WidgetNodes* widgets,
+  QList<StylesheetDiagnostic>& diagnostics) const
+{
+  for (auto widget : widgets->widgets()) {
+    if (!widget->isNameValid()) {
+      diagnostics.append({ StylesheetDiagnostic::BadWidget,
+                           widget->position(),
+                           widget->name().length(),
+                           widget->name(),
+                           widget->isNameFuzzy(m_datastore) });
+    }
+
+    if (widget->hasIdSelector()) {
+      controlDiagnostics(
+        widget->idSelector(), StylesheetDiagnostic::BadIdSelector, diagnostics);
+    }
+
+    if (widget->hasSubControl()) {
+      for (auto subcontrol : *(widget->subControls())) {
+        controlDiagnostics(
+          subcontrol, StylesheetDiagnostic::BadSubControl, diagnostics);
+      }
+    }
+  }
+
+  if (widgets->hasStartBrace() && !widgets->hasEndBrace()) {
+    diagnostics.append({ StylesheetDiagnostic::MissingEndBrace,
+                         widgets->startBracePosition(),
+                         1,
+                         QStringLiteral("{"),
+                         false });
+  } else if (!widgets->hasStartBrace() && widgets->hasEndBrace()) {
+    diagnostics.append({ StylesheetDiagnostic::MissingStartBrace,
+                         widgets->endBracePosition(),
+                         1,
+                         QStringLiteral("}"),
+                         false });
+  }
+
+  for (int i = 0; i < widgets->propertyCount(); i++) {
+    auto property = widgets->property(i);
+    if (property) {
+      propertyDiagnostics(
+        property, widgets->isFinalProperty(property), diagnostics);
+    }
+  }
+}
+
+void
+StylesheetParser::controlDiagnostics(
+  ControlBase* control,
+  StylesheetDiagnostic::Kind kind,
+  QList<StylesheetDiagnostic>& diagnostics) const
+{
+  if (!control->isValid()) {
+    diagnostics.append({ kind,
+                         control->namePosition(),
+                         control->name().length(),
+                         control->name(),
+                         control->isFuzzy(m_datastore) });
+  }
+
+  if (control->hasPseudoStates()) {
+    for (auto state : *(control->pseudoStates())) {
+      if (!state->isValid()) {
+        diagnostics.append({ StylesheetDiagnostic::BadPseudoState,
+                             state->namePosition(),
+                             state->name().length(),
+                             state->name(),
+                             state->isFuzzy(m_datastore) });
+      }
+    }
+  }
+}
+
+void
+StylesheetParser::propertyDiagnostics(
+  PropertyNode* property,
+  bool finalProperty,
+  QList<StylesheetDiagnostic>& diagnostics) const
+{
+  auto position = property->position();
+  auto name = property->name();
+  auto count = property->valueCount();
+
+  if (!property->isValidPropertyName()) {
+    diagnostics.append({ StylesheetDiagnostic::BadPropertyName,
+                         position,
+                         name.length(),
+                         name,
+                         property->isFuzzyName(m_datastore) });
+  } else if (!property->hasPropertyMarker()) {
+    diagnostics.append({ StylesheetDiagnostic::MissingPropertyMarker,
+                         position,
+                         name.length(),
+                         name,
+                         false });
+  } else if (count > property->maxCount() || count < property->minCount()) {
+    diagnostics.append({ StylesheetDiagnostic::BadValueCount,
+                         position,
+                         name.length(),
+                         name,
+                         false });
+  }
+
+  for (int i = 0; i < property->count(); i++) {
+    for (auto status = property->valueStatus(i); status;
+         status = status->next()) {
+      switch (status->state()) {
+        case GoodName:
+        case GoodValueName:
+        case GoodValue:
+          break;
+        default:
+          diagnostics.append({ StylesheetDiagnostic::BadPropertyValue,
+                               status->offset(),
+                               status->length(),
+                               status->name(m_parser->text()),
+                               (status->state() == FuzzyName ||
+                                status->state() == FuzzyValueName ||
+                                status->state() == FuzzyColorValue) });
+          break;
+      }
+    }
+  }
+
+  if (property->isValidPropertyName() && !property->hasPropertyEndMarker() &&
+      !finalProperty) {
+    diagnostics.append({ StylesheetDiagnostic::MissingPropertyEndMarker,
+                         position,
+                         name.length(),
+                         name,
+                         false });
+  }
+}
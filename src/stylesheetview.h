@@ -0,0 +1,48 @@
+/*
+  Copyright 2020 Simon Meaden
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+        */
+#ifndef STYLESHEETVIEW_H
+#define STYLESHEETVIEW_H
+
+#include <QFontMetrics>
+#include <QPoint>
+#include <QRect>
+#include <QTextCursor>
+
+class DataStore;
+class QTextDocument;
+
+//! What the parser, the nodes and the datastore need from the view that
+//! shows the stylesheet. StylesheetEditor implements it, the parser library
+//! only ever sees this interface so it never calls a widget. Without a view,
+//! as in StylesheetParser, the nodes have no geometry.
+class StylesheetView
+{
+public:
+  virtual ~StylesheetView() = default;
+
+  virtual DataStore* datastore() = 0;
+  virtual QTextDocument* document() const = 0;
+  virtual QFontMetrics fontMetrics() const = 0;
+  virtual QRect cursorRect(const QTextCursor& cursor) const = 0;
+  virtual QTextCursor cursorForPosition(const QPoint& pos) const = 0;
+};
+
+#endif // STYLESHEETVIEW_H
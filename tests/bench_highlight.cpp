@@ -0,0 +1,91 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "stylesheetedit/stylesheetedit.h"
+
+#include "stylesheetedit_p.h"
+#include "stylesheethighlighter.h"
+
+#include <QApplication>
+
+#include <benchmark/benchmark.h>
+
+/*
+   Highlights a stylesheet of 5000 properties. Formatting a property must not
+   copy the document, so the time should grow linearly with the number of
+   properties.
+*/
+
+class HighlightEdit : public StylesheetEdit
+{
+public:
+  using StylesheetEdit::editor;
+};
+
+static QString
+stylesheet(int properties)
+{
+  QString text;
+  for (int i = 0; i < properties / 5; i++) {
+    text += QStringLiteral("QPushButton#button%1 {\n"
+                           "  color: red;\n"
+                           "  background-color: rgb(10, 20, 30);\n"
+                           "  border: 1px solid #102030;\n"
+                           "  margin: 2px 4px;\n"
+                           "  font-size: 10pt;\n"
+                           "}\n")
+              .arg(i);
+  }
+  return text;
+}
+
+static void
+BM_Highlight(benchmark::State& state)
+{
+  HighlightEdit edit;
+  edit.setPlainText(stylesheet(int(state.range(0))));
+  auto highlighter = edit.editor()->highlighter();
+
+  for (auto _ : state) {
+    highlighter->rehighlight();
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_Highlight)
+  ->Arg(1000)
+  ->Arg(5000)
+  ->Unit(benchmark::kMillisecond);
+
+int
+main(int argc, char* argv[])
+{
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+  QApplication app(argc, argv);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,96 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "common.h"
+
+#include <QStringList>
+#include <QVector>
+
+#include <benchmark/benchmark.h>
+
+/*
+   Reads a million mixed length literals, as checkLength() sees them, with
+   lexNumber() and with the toLower()/left()/toDouble() slicing that it
+   replaced.
+*/
+
+static const QVector<QString>&
+literals()
+{
+  static const QVector<QString> literals = [] {
+    static const char* const units[] = { "px", "pt", "em", "ex", "%", "",
+                                         "PX", "Em" };
+    QVector<QString> literals;
+    literals.reserve(1 << 20);
+    for (int i = 0; i < (1 << 20); i++) {
+      auto number = (i % 3 == 0 ? QString::number(i % 1000)
+                                : QString::number((i % 5000) / 7.0, 'g', 5));
+      if (i % 11 == 0) {
+        number.prepend('-');
+      }
+      literals.append(number + QLatin1String(units[i % 8]));
+    }
+    return literals;
+  }();
+  return literals;
+}
+
+static void
+BM_LexNumber(benchmark::State& state)
+{
+  auto& values = literals();
+  for (auto _ : state) {
+    int good = 0;
+    for (auto& value : values) {
+      auto literal = parseNumber(value);
+      good += (literal.isValid() && literal.unit != NoLengthUnit);
+    }
+    benchmark::DoNotOptimize(good);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * values.size());
+}
+BENCHMARK(BM_LexNumber)->Unit(benchmark::kMillisecond);
+
+//! The old checkLength(), without the status that it allocated.
+static void
+BM_SliceToDouble(benchmark::State& state)
+{
+  auto& values = literals();
+  for (auto _ : state) {
+    int good = 0;
+    for (auto& value : values) {
+      bool ok = false;
+      auto lvalue = value.toLower();
+      if (lvalue.endsWith("px") || lvalue.endsWith("pt") ||
+          lvalue.endsWith("em") || lvalue.endsWith("ex")) {
+        value.left(value.length() - 2).toDouble(&ok);
+      } else if (lvalue.endsWith("%")) {
+        value.left(value.length() - 1).toDouble(&ok);
+      }
+      good += ok;
+    }
+    benchmark::DoNotOptimize(good);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * values.size());
+}
+BENCHMARK(BM_SliceToDouble)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,161 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "datastore.h"
+#include "scanner.h"
+
+#include <QFile>
+
+#include <benchmark/benchmark.h>
+
+/*
+   Tokenizes src/known_css.css, as the parser does, and compares the bulk
+   scans of the tokenizer with the QChar loops that they replaced.
+*/
+
+static const QString&
+knownCss()
+{
+  static const QString text = [] {
+    QFile file(QStringLiteral(KNOWN_CSS));
+    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+      qFatal("Unable to read %s", KNOWN_CSS);
+    }
+    return QString::fromUtf8(file.readAll());
+  }();
+  return text;
+}
+
+static DataStore*
+datastore()
+{
+  static DataStore datastore;
+  return &datastore;
+}
+
+static void
+BM_NextToken(benchmark::State& state)
+{
+  auto& text = knownCss();
+  auto store = datastore();
+  int64_t tokens = 0;
+
+  for (auto _ : state) {
+    int pos = 0;
+    while (store->nextToken(text, pos).kind != Token::End) {
+      tokens++;
+    }
+    benchmark::DoNotOptimize(pos);
+  }
+
+  state.SetItemsProcessed(tokens);
+  state.SetBytesProcessed(int64_t(state.iterations()) * text.size() * 2);
+  state.counters["tokens/s"] =
+    benchmark::Counter(double(tokens), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_NextToken);
+
+//! The whitespace and name runs of the corpus as the tokenizer used to skip
+//! them, one QChar at a time.
+static void
+BM_ScanRunsQChar(benchmark::State& state)
+{
+  auto& text = knownCss();
+  auto data = text.constData();
+  int length = text.length();
+  int64_t runs = 0;
+
+  for (auto _ : state) {
+    int pos = 0;
+    while (pos < length) {
+      if (data[pos].isSpace()) {
+        while (pos < length && data[pos].isSpace()) {
+          pos++;
+        }
+      } else if (data[pos].isLetterOrNumber() || data[pos] == '-') {
+        while (pos < length &&
+               (data[pos].isLetterOrNumber() || data[pos] == '-')) {
+          pos++;
+        }
+      } else {
+        pos++;
+      }
+      runs++;
+    }
+    benchmark::DoNotOptimize(pos);
+  }
+
+  state.SetItemsProcessed(runs);
+  state.SetBytesProcessed(int64_t(state.iterations()) * length * 2);
+}
+BENCHMARK(BM_ScanRunsQChar);
+
+//! The same runs skipped by the Scanner.
+static void
+BM_ScanRunsScanner(benchmark::State& state)
+{
+  auto& text = knownCss();
+  auto data = text.constData();
+  int length = text.length();
+  int64_t runs = 0;
+
+  for (auto _ : state) {
+    int pos = 0;
+    while (pos < length) {
+      auto next = Scanner::skipSpaces(text, pos, false);
+      if (next == pos) {
+        next = Scanner::skipName(text, pos);
+      }
+      if (next == pos) {
+        // non-ASCII text is left to QChar, as the tokenizer does.
+        next = pos + 1;
+        while (next < length && data[next].unicode() > 0x7f &&
+               data[next].isLetterOrNumber()) {
+          next++;
+        }
+      }
+      pos = next;
+      runs++;
+    }
+    benchmark::DoNotOptimize(pos);
+  }
+
+  state.SetItemsProcessed(runs);
+  state.SetBytesProcessed(int64_t(state.iterations()) * length * 2);
+}
+BENCHMARK(BM_ScanRunsScanner);
+
+//! Comment bodies, searched for the "*/" that ends them.
+static void
+BM_FindCommentEnd(benchmark::State& state)
+{
+  auto comment = QStringLiteral("/*") +
+                 knownCss().left(4096).replace(QStringLiteral("*/"),
+                                               QStringLiteral("* ")) +
+                 QStringLiteral("*/");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Scanner::findCommentEnd(comment, 2));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * comment.size() * 2);
+}
+BENCHMARK(BM_FindCommentEnd);
+
+BENCHMARK_MAIN();
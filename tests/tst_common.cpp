@@ -0,0 +1,280 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "common.h"
+
+#include <gtest/gtest.h>
+
+TEST(LexNumber, Integer)
+{
+  auto literal = lexNumber(u"42;");
+  EXPECT_TRUE(literal.isValid());
+  EXPECT_TRUE(literal.isInteger);
+  EXPECT_EQ(literal.value, 42.0);
+  EXPECT_EQ(literal.unit, NoLengthUnit);
+  EXPECT_EQ(literal.numberLength, 2);
+  EXPECT_EQ(literal.length, 2);
+}
+
+TEST(LexNumber, Signs)
+{
+  EXPECT_EQ(lexNumber(u"-3").value, -3.0);
+  EXPECT_TRUE(lexNumber(u"-3").isInteger);
+  EXPECT_EQ(lexNumber(u"+3").value, 3.0);
+  EXPECT_EQ(lexNumber(u"+3").numberLength, 2);
+  EXPECT_FALSE(lexNumber(u"+-3").isValid());
+  EXPECT_FALSE(lexNumber(u"-").isValid());
+}
+
+TEST(LexNumber, Real)
+{
+  auto literal = lexNumber(u"1.5px");
+  EXPECT_FALSE(literal.isInteger);
+  EXPECT_EQ(literal.value, 1.5);
+  EXPECT_EQ(literal.unit, PxLengthUnit);
+  EXPECT_EQ(literal.numberLength, 3);
+  EXPECT_EQ(literal.length, 5);
+
+  EXPECT_EQ(lexNumber(u"2e3").value, 2000.0);
+  EXPECT_FALSE(lexNumber(u"2e3").isInteger);
+}
+
+TEST(LexNumber, Units)
+{
+  struct
+  {
+    const char16_t* text;
+    LengthUnit unit;
+    int length;
+  } cases[] = {
+    { u"10px", PxLengthUnit, 4 },     { u"10PX", PxLengthUnit, 4 },
+    { u"10pt", PtLengthUnit, 4 },     { u"10em", EmLengthUnit, 4 },
+    { u"10ex", ExLengthUnit, 4 },     { u"10%", PercentLengthUnit, 3 },
+    { u"10 px", NoLengthUnit, 2 },    { u"10cm", NoLengthUnit, 2 },
+    { u"10p", NoLengthUnit, 2 },
+  };
+  for (auto& c : cases) {
+    auto literal = lexNumber(c.text);
+    EXPECT_EQ(literal.unit, c.unit) << QString::fromUtf16(c.text).toStdString();
+    EXPECT_EQ(literal.length, c.length)
+      << QString::fromUtf16(c.text).toStdString();
+    EXPECT_EQ(literal.value, 10.0);
+  }
+}
+
+TEST(LexNumber, ExponentIsNotAUnit)
+{
+  // "1em" is one em, the 'e' does not start an exponent.
+  auto literal = lexNumber(u"1em");
+  EXPECT_EQ(literal.value, 1.0);
+  EXPECT_EQ(literal.unit, EmLengthUnit);
+  EXPECT_EQ(literal.length, 3);
+
+  literal = lexNumber(u"2ex");
+  EXPECT_EQ(literal.value, 2.0);
+  EXPECT_EQ(literal.unit, ExLengthUnit);
+}
+
+TEST(LexNumber, NotANumber)
+{
+  EXPECT_FALSE(lexNumber(u"").isValid());
+  EXPECT_FALSE(lexNumber(u"px").isValid());
+  EXPECT_FALSE(lexNumber(u"red").isValid());
+  EXPECT_FALSE(lexNumber(u"½").isValid());
+  EXPECT_EQ(lexNumber(u"px").length, 0);
+
+  // std::from_chars() reads these but a stylesheet does not.
+  EXPECT_FALSE(lexNumber(u"inf").isValid());
+  EXPECT_FALSE(lexNumber(u"-Infinity").isValid());
+  EXPECT_FALSE(lexNumber(u"nan").isValid());
+  EXPECT_FALSE(lexNumber(u"NaN").isValid());
+  EXPECT_FALSE(lexNumber(u"nanpx").isValid());
+  EXPECT_FALSE(lexNumber(u"+inf").isValid());
+  EXPECT_FALSE(parseNumber(u"infpx").isValid());
+}
+
+TEST(ParseNumber, WholeText)
+{
+  EXPECT_TRUE(parseNumber(u" 12px ").isValid());
+  EXPECT_EQ(parseNumber(u" 12px ").unit, PxLengthUnit);
+  EXPECT_FALSE(parseNumber(u"12px solid").isValid());
+  EXPECT_FALSE(parseNumber(u"12pxx").isValid());
+  EXPECT_FALSE(parseNumber(u"").isValid());
+}
+
+TEST(ParseColor, Hash)
+{
+  auto color = parseColor(u"#f00");
+  EXPECT_EQ(color.form, ColorLiteral::HashColor);
+  EXPECT_TRUE(color.isValid());
+  EXPECT_EQ(color.rgb, qRgb(255, 0, 0));
+
+  EXPECT_EQ(parseColor(u"#102030").rgb, qRgb(0x10, 0x20, 0x30));
+  EXPECT_EQ(parseColor(u"#80102030").rgb, qRgba(0x10, 0x20, 0x30, 0x80));
+  EXPECT_EQ(parseColor(u"#fff000000").rgb, qRgb(255, 0, 0));
+  EXPECT_EQ(parseColor(u"#ffff00000000").rgb, qRgb(255, 0, 0));
+
+  EXPECT_FALSE(parseColor(u"#ff").isValid());
+  EXPECT_FALSE(parseColor(u"#ggg").isValid());
+  EXPECT_EQ(parseColor(u"#ggg").form, ColorLiteral::HashColor);
+}
+
+TEST(ParseColor, MatchesQColor)
+{
+  for (auto text : { u"#123", u"#abcdef", u"#7f123456" }) {
+    auto name = QString::fromUtf16(text);
+    EXPECT_EQ(parseColor(text).rgb, QColor(name).rgba())
+      << name.toStdString();
+  }
+}
+
+TEST(ParseColor, Rgb)
+{
+  auto color = parseColor(u"rgb(10, 20, 30)");
+  EXPECT_EQ(color.form, ColorLiteral::RgbColor);
+  EXPECT_TRUE(color.isFunction());
+  EXPECT_TRUE(color.isValid());
+  EXPECT_EQ(color.count, 3);
+  EXPECT_EQ(color.rgb, qRgb(10, 20, 30));
+  EXPECT_EQ(color.components[1].offset, 8);
+  EXPECT_EQ(color.components[1].length, 2);
+
+  EXPECT_EQ(parseColor(u"RGBA(0x10, 100%, 0%, 128)").rgb,
+            qRgba(16, 255, 0, 128));
+  EXPECT_EQ(parseColor(u"rgb(50%, 0, 0)").rgb, qRgb(128, 0, 0));
+}
+
+TEST(ParseColor, OutOfRange)
+{
+  auto color = parseColor(u"rgb(10, 256, 30)");
+  EXPECT_FALSE(color.isValid());
+  EXPECT_EQ(color.components[0].state, GoodValue);
+  EXPECT_EQ(color.components[1].state, BadNumericalValue_255);
+
+  color = parseColor(u"hsv(360, 10, 10)");
+  EXPECT_EQ(color.components[0].state, BadNumericalValue_359);
+
+  color = parseColor(u"rgb(101%, 0, 0)");
+  EXPECT_EQ(color.components[0].state, BadNumericalValue_100);
+}
+
+TEST(ParseColor, ComponentCount)
+{
+  auto color = parseColor(u"rgb(1, 2)");
+  EXPECT_EQ(color.count, 2);
+  EXPECT_EQ(color.expected, 3);
+  EXPECT_FALSE(color.isValid());
+
+  color = parseColor(u"rgba(1, 2, 3, 4, 5)");
+  EXPECT_EQ(color.count, 5);
+  EXPECT_FALSE(color.isValid());
+}
+
+TEST(ParseColor, Hsv)
+{
+  EXPECT_EQ(parseColor(u"hsv(120, 255, 255)").rgb,
+            QColor::fromHsv(120, 255, 255).rgba());
+  EXPECT_EQ(parseColor(u"hsla(240, 255, 128, 10)").rgb,
+            QColor::fromHsl(240, 255, 128, 10).rgba());
+}
+
+TEST(ParseColor, NotAColor)
+{
+  EXPECT_EQ(parseColor(u"red").form, ColorLiteral::NoColor);
+  EXPECT_EQ(parseColor(u"").form, ColorLiteral::NoColor);
+  EXPECT_FALSE(parseColor(u"rgb").isValid());
+}
+
+TEST(OffsetMap, Shift)
+{
+  // an insertion of 3 at 10.
+  EXPECT_EQ(OffsetMap::shift(5, 10, 0, 3), 5);
+  EXPECT_EQ(OffsetMap::shift(10, 10, 0, 3), 13);
+  EXPECT_EQ(OffsetMap::shift(20, 10, 0, 3), 23);
+  // a removal of 4 at 10.
+  EXPECT_EQ(OffsetMap::shift(9, 10, 4, 0), 9);
+  EXPECT_EQ(OffsetMap::shift(12, 10, 4, 0), 10);
+  EXPECT_EQ(OffsetMap::shift(14, 10, 4, 0), 10);
+  EXPECT_EQ(OffsetMap::shift(20, 10, 4, 0), 16);
+  // a replacement of 4 by 2 at 10.
+  EXPECT_EQ(OffsetMap::shift(12, 10, 4, 2), 12);
+  EXPECT_EQ(OffsetMap::shift(20, 10, 4, 2), 18);
+}
+
+TEST(OffsetMap, MapFollowsEdits)
+{
+  OffsetMap map;
+  int revision = map.revision();
+  map.addEdit(0, 0, 5);
+  map.addEdit(100, 10, 0);
+  EXPECT_EQ(map.revision(), revision + 2);
+  EXPECT_EQ(map.pendingEdits(), 2);
+
+  EXPECT_EQ(map.map(50, revision), 55);
+  EXPECT_EQ(revision, map.revision());
+  // already up to date so nothing moves.
+  EXPECT_EQ(map.map(50, revision), 50);
+}
+
+TEST(OffsetMap, ClearKeepsTheRevision)
+{
+  OffsetMap map;
+  map.addEdit(0, 0, 1);
+  map.addEdit(0, 0, 1);
+  auto revision = map.revision();
+  map.clear();
+  EXPECT_EQ(map.pendingEdits(), 0);
+  EXPECT_EQ(map.revision(), revision);
+
+  map.addEdit(0, 0, 1);
+  EXPECT_EQ(map.map(10, revision), 11);
+}
+
+TEST(TextPosition, FollowsTheMap)
+{
+  OffsetMap map;
+  TextPosition a(10, &map), b(20, &map);
+  map.addEdit(15, 0, 10);
+  EXPECT_EQ(a.position(), 10);
+  EXPECT_EQ(b.position(), 30);
+
+  map.addEdit(0, 5, 0);
+  EXPECT_EQ(a.position(), 5);
+  EXPECT_EQ(b.position(), 25);
+  EXPECT_TRUE(a < b);
+}
+
+TEST(TextPosition, NullAndUnmapped)
+{
+  TextPosition null;
+  EXPECT_TRUE(null.isNull());
+  EXPECT_EQ(null.position(), -1);
+
+  TextPosition fixed(7, nullptr);
+  EXPECT_EQ(fixed.position(), 7);
+
+  OffsetMap map;
+  map.addEdit(0, 0, 3);
+  fixed.setOffsetMap(&map);
+  EXPECT_EQ(fixed.position(), 7);
+  map.addEdit(0, 0, 3);
+  EXPECT_EQ(fixed.position(), 10);
+}
@@ -0,0 +1,75 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "stylesheetedit/stylesheetparser.h"
+
+#include <QCoreApplication>
+#include <QtDebug>
+
+/*
+   Parses a stylesheet with StylesheetParser under a QCoreApplication. This
+   only links the parser library so it fails to build if the library needs
+   widgets again.
+*/
+
+static bool
+check(bool condition, const char* message)
+{
+  if (!condition) {
+    qWarning() << "FAILED :" << message;
+  }
+  return condition;
+}
+
+int
+main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  StylesheetParser parser;
+  parser.parse(QStringLiteral("QPushButton {\n"
+                              "  color: red;\n"
+                              "  colr: blue;\n"
+                              "}\n"
+                              "QLabel {\n"
+                              "  background-color: green\n"));
+
+  auto diagnostics = parser.diagnostics();
+  bool badName = false, missingBrace = false;
+  for (auto& diagnostic : diagnostics) {
+    if (diagnostic.kind == StylesheetDiagnostic::BadPropertyName &&
+        diagnostic.text == QStringLiteral("colr")) {
+      badName = true;
+    } else if (diagnostic.kind == StylesheetDiagnostic::MissingEndBrace) {
+      missingBrace = true;
+    }
+  }
+
+  bool ok = true;
+  ok &= check(!parser.nodes().isEmpty(), "no nodes were parsed");
+  ok &= check(badName, "the bad property name was not reported");
+  ok &= check(missingBrace, "the missing end brace was not reported");
+
+  parser.parse(QStringLiteral("QLabel { color: red; }\n"));
+  ok &= check(parser.diagnostics().isEmpty(), "a good stylesheet has errors");
+
+  return (ok ? 0 : 1);
+}
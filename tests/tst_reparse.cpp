@@ -0,0 +1,151 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "datastore.h"
+#include "node.h"
+#include "parser.h"
+#include "stylesheetview.h"
+
+#include <QTextDocument>
+
+#include <gtest/gtest.h>
+
+/*
+   Edits a document and checks that the nodes of the incremental reparse are
+   the nodes that a full parse of the new text gives.
+*/
+
+//! A view without a layout, only the document is needed to parse.
+class TestView : public StylesheetView
+{
+public:
+  explicit TestView(DataStore* datastore)
+    : m_datastore(datastore)
+  {}
+
+  DataStore* datastore() override { return m_datastore; }
+  QTextDocument* document() const override { return &m_document; }
+  QFontMetrics fontMetrics() const override { return QFontMetrics(QFont()); }
+  QRect cursorRect(const QTextCursor&) const override { return QRect(); }
+  QTextCursor cursorForPosition(const QPoint&) const override
+  {
+    return QTextCursor();
+  }
+
+private:
+  DataStore* m_datastore;
+  mutable QTextDocument m_document;
+};
+
+//! The top level nodes as position:type:length.
+static QStringList
+layout(DataStore& datastore)
+{
+  QStringList layout;
+  for (auto node : datastore.nodes()) {
+    layout.append(QStringLiteral("%1:%2:%3")
+                    .arg(node->position())
+                    .arg(int(node->type()))
+                    .arg(node->length()));
+  }
+  return layout;
+}
+
+class Reparse : public ::testing::Test
+{
+protected:
+  Reparse()
+    : view(&datastore)
+    , parser(&datastore, &view)
+  {
+    datastore.setEditor(&view);
+  }
+
+  void load(const QString& text)
+  {
+    view.document()->setPlainText(text);
+    parser.parseInitialText(text);
+    QObject::connect(view.document(),
+                     &QTextDocument::contentsChange,
+                     &parser,
+                     &Parser::handleDocumentChanged);
+  }
+
+  void remove(int position, int length)
+  {
+    QTextCursor cursor(view.document());
+    cursor.setPosition(position);
+    cursor.setPosition(position + length, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+  }
+
+  //! The layout of a full parse of text.
+  static QStringList parsed(const QString& text)
+  {
+    DataStore datastore;
+    TestView view(&datastore);
+    Parser parser(&datastore, &view);
+    datastore.setEditor(&view);
+    view.document()->setPlainText(text);
+    parser.parseInitialText(text);
+    return layout(datastore);
+  }
+
+  DataStore datastore;
+  TestView view;
+  Parser parser;
+};
+
+TEST_F(Reparse, DeleteFirstSelector)
+{
+  load(QStringLiteral("QLabel { color: red; }\n"
+                      "QPushButton { color: blue; }\n"));
+  remove(0, 7);
+
+  auto text = view.document()->toPlainText();
+  ASSERT_TRUE(text.startsWith(QLatin1Char('{')));
+  EXPECT_EQ(layout(datastore), parsed(text));
+}
+
+TEST_F(Reparse, DeleteSelectorBeforeBrace)
+{
+  load(QStringLiteral("QLabel { color: red; }\n"
+                      "QPushButton { color: blue; }\n"));
+  remove(23, 12);
+
+  auto text = view.document()->toPlainText();
+  ASSERT_EQ(text.mid(23, 1), QStringLiteral("{"));
+  EXPECT_EQ(layout(datastore), parsed(text));
+  EXPECT_EQ(node_cast<WidgetNodes>(datastore.nodes().first())->position(), 0);
+}
+
+TEST_F(Reparse, RetypeSelector)
+{
+  load(QStringLiteral("QLabel { color: red; }\n"
+                      "QPushButton { color: blue; }\n"));
+  remove(23, 12);
+  QTextCursor cursor(view.document());
+  cursor.setPosition(23);
+  cursor.insertText(QStringLiteral("QFrame "));
+
+  auto text = view.document()->toPlainText();
+  EXPECT_EQ(layout(datastore), parsed(text));
+}
@@ -0,0 +1,132 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "scanner.h"
+
+#include <gtest/gtest.h>
+
+/*
+   The scans must give the same answer whichever of the AVX2, SSE2 and scalar
+   paths finds it, so each test moves the answer across the widths of the
+   vectors.
+*/
+
+TEST(Scanner, SkipSpacesStopsAtEveryOffset)
+{
+  for (int n = 0; n < 70; n++) {
+    auto text = QString(n, ' ') + QStringLiteral("x");
+    EXPECT_EQ(Scanner::skipSpaces(text, 0, false), n) << n;
+  }
+}
+
+TEST(Scanner, SkipSpacesFromPosition)
+{
+  auto text = QStringLiteral("abc") + QString(40, ' ') + QStringLiteral("d");
+  EXPECT_EQ(Scanner::skipSpaces(text, 0, false), 0);
+  EXPECT_EQ(Scanner::skipSpaces(text, 3, false), 43);
+  EXPECT_EQ(Scanner::skipSpaces(text, 44, false), 44);
+}
+
+TEST(Scanner, SkipSpacesAllAsciiWhitespace)
+{
+  auto text = QStringLiteral(" \t\n\v\f\r \t\n\v\f\r \t\n\v\f\r \t\n\v\f\rx");
+  EXPECT_EQ(Scanner::skipSpaces(text, 0, false), text.length() - 1);
+}
+
+TEST(Scanner, SkipSpacesStopAtNewline)
+{
+  for (int n = 0; n < 40; n++) {
+    auto text = QString(n, ' ') + QStringLiteral("\n  x");
+    EXPECT_EQ(Scanner::skipSpaces(text, 0, true), n) << n;
+    EXPECT_EQ(Scanner::skipSpaces(text, 0, false), n + 3) << n;
+  }
+}
+
+TEST(Scanner, SkipSpacesStopsAtNonAscii)
+{
+  // a no-break space is a space but not an ASCII one, and the low byte of
+  // a high code unit must not be mistaken for an ASCII space.
+  for (auto c : { 0x00a0, 0x2009, 0x8020, 0xff09 }) {
+    auto text = QString(20, ' ') + QChar(c) + QString(20, ' ');
+    EXPECT_EQ(Scanner::skipSpaces(text, 0, false), 20) << c;
+  }
+}
+
+TEST(Scanner, SkipSpacesAtEnd)
+{
+  EXPECT_EQ(Scanner::skipSpaces(QString(), 0, false), 0);
+  EXPECT_EQ(Scanner::skipSpaces(QString(33, ' '), 0, false), 33);
+  EXPECT_EQ(Scanner::skipSpaces(QString(33, ' '), 33, false), 33);
+}
+
+TEST(Scanner, SkipNameStopsAtEveryOffset)
+{
+  const QString name = QStringLiteral("abcdefghijklmnopqrstuvwxyz-ABCDEFGHIJ"
+                                      "KLMNOPQRSTUVWXYZ-0123456789");
+  for (int n = 0; n < name.length(); n++) {
+    auto text = name.left(n) + QStringLiteral(":x");
+    EXPECT_EQ(Scanner::skipName(text, 0), n) << n;
+  }
+}
+
+TEST(Scanner, SkipNameStopsAtPunctuation)
+{
+  for (auto c : QStringLiteral(" {}:;,#.()\"'/*@[]_`~")) {
+    auto text = QString(20, 'a') + c + QString(20, 'a');
+    EXPECT_EQ(Scanner::skipName(text, 0), 20) << c.unicode();
+  }
+}
+
+TEST(Scanner, SkipNameStopsAtNonAscii)
+{
+  // 0x8041 and 0x0141 must not look like 'A' or 'a'.
+  for (auto c : { 0x00e9, 0x0141, 0x8041, 0xff21 }) {
+    auto text = QString(20, 'a') + QChar(c) + QString(20, 'a');
+    EXPECT_EQ(Scanner::skipName(text, 0), 20) << c;
+  }
+}
+
+TEST(Scanner, FindCommentEndAtEveryOffset)
+{
+  for (int n = 0; n < 70; n++) {
+    auto text = QString(n, 'a') + QStringLiteral("*/ b");
+    EXPECT_EQ(Scanner::findCommentEnd(text, 0), n) << n;
+  }
+}
+
+TEST(Scanner, FindCommentEndNeedsBothCharacters)
+{
+  for (int n = 0; n < 40; n++) {
+    auto text = QString(n, '*') + QStringLiteral("x/ * / ");
+    EXPECT_EQ(Scanner::findCommentEnd(text, 0), -1) << n;
+  }
+  EXPECT_EQ(Scanner::findCommentEnd(QStringLiteral("**/"), 0), 1);
+  EXPECT_EQ(Scanner::findCommentEnd(QString(40, 'a') + '*', 0), -1);
+  EXPECT_EQ(Scanner::findCommentEnd(QString(), 0), -1);
+}
+
+TEST(Scanner, FindCommentEndFromPosition)
+{
+  auto text = QStringLiteral("*/") + QString(30, ' ') + QStringLiteral("*/");
+  EXPECT_EQ(Scanner::findCommentEnd(text, 0), 0);
+  EXPECT_EQ(Scanner::findCommentEnd(text, 1), 32);
+  EXPECT_EQ(Scanner::findCommentEnd(text, 33), -1);
+}
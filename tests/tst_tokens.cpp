@@ -0,0 +1,181 @@
+/*
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "datastore.h"
+
+#include <gtest/gtest.h>
+
+class NextToken : public ::testing::Test
+{
+protected:
+  static void SetUpTestSuite() { datastore = new DataStore(); }
+  static void TearDownTestSuite()
+  {
+    delete datastore;
+    datastore = nullptr;
+  }
+
+  //! Splits text into tokens, giving each as kind:text.
+  static QStringList tokens(const QString& text, bool showLineMarkers = false)
+  {
+    QStringList tokens;
+    int pos = 0;
+    while (true) {
+      auto token = datastore->nextToken(text, pos, showLineMarkers);
+      if (token.kind == Token::End) {
+        EXPECT_EQ(token.offset, text.length());
+        break;
+      }
+      tokens.append(QString::number(token.kind) + ':' +
+                    token.toString(text));
+      if (token.kind == Token::Newline) {
+        pos++;
+      }
+    }
+    return tokens;
+  }
+
+  static DataStore* datastore;
+};
+
+DataStore* NextToken::datastore = nullptr;
+
+static QString
+expected(std::initializer_list<std::pair<Token::Kind, const char*>> tokens)
+{
+  QStringList list;
+  for (auto& token : tokens) {
+    list.append(QString::number(token.first) + ':' +
+                QString::fromUtf8(token.second));
+  }
+  return list.join(' ');
+}
+
+TEST_F(NextToken, Rule)
+{
+  auto result = tokens(QStringLiteral("QPushButton { color: red; }"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "QPushButton" },
+                       { Token::Symbol, "{" },
+                       { Token::Name, "color" },
+                       { Token::Symbol, ":" },
+                       { Token::Name, "red" },
+                       { Token::Symbol, ";" },
+                       { Token::Symbol, "}" } }));
+}
+
+TEST_F(NextToken, NoBlanksBetweenTokens)
+{
+  auto result = tokens(QStringLiteral("QLabel{color:red;}"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "QLabel" },
+                       { Token::Symbol, "{" },
+                       { Token::Name, "color" },
+                       { Token::Symbol, ":" },
+                       { Token::Name, "red" },
+                       { Token::Symbol, ";" },
+                       { Token::Symbol, "}" } }));
+}
+
+TEST_F(NextToken, ConsecutiveSymbols)
+{
+  // each symbol is a token of its own except "::".
+  auto result = tokens(QStringLiteral("QTabBar::tab:hover{};;"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "QTabBar" },
+                       { Token::Symbol, "::" },
+                       { Token::Name, "tab" },
+                       { Token::Symbol, ":" },
+                       { Token::Name, "hover" },
+                       { Token::Symbol, "{" },
+                       { Token::Symbol, "}" },
+                       { Token::Symbol, ";" },
+                       { Token::Symbol, ";" } }));
+}
+
+TEST_F(NextToken, Numbers)
+{
+  auto result = tokens(QStringLiteral("1.5px -2 10%"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "1.5px" },
+                       { Token::Name, "-2" },
+                       { Token::Name, "10" },
+                       { Token::Symbol, "%" } }));
+}
+
+TEST_F(NextToken, NestedBrackets)
+{
+  auto text = QStringLiteral(
+    "qlineargradient(stop: 0 rgb(0, 0, 0), stop: 1 \"a)\") red");
+  auto result = tokens(text);
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Bracketed,
+                         "qlineargradient(stop: 0 rgb(0, 0, 0), stop: 1 "
+                         "\"a)\")" },
+                       { Token::Name, "red" } }));
+}
+
+TEST_F(NextToken, Quoted)
+{
+  auto result = tokens(QStringLiteral("\"a b;\" x"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Quoted, "\"a b;\"" }, { Token::Name, "x" } }));
+}
+
+TEST_F(NextToken, Comment)
+{
+  int pos = 0;
+  auto text = QStringLiteral("  /* a */");
+  auto token = datastore->nextToken(text, pos);
+  EXPECT_EQ(token.kind, Token::CommentStart);
+  EXPECT_EQ(token.offset, 2);
+  EXPECT_EQ(token.length, 2);
+  EXPECT_EQ(pos, 4);
+}
+
+TEST_F(NextToken, Newlines)
+{
+  auto result = tokens(QStringLiteral("a\n  b"), true);
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "a" },
+                       { Token::Newline, "\n" },
+                       { Token::Name, "b" } }));
+
+  result = tokens(QStringLiteral("a\n  b"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "a" }, { Token::Name, "b" } }));
+}
+
+TEST_F(NextToken, NonAsciiNames)
+{
+  auto result = tokens(QStringLiteral("naïve éa-b"));
+  EXPECT_EQ(result.join(' '),
+            expected({ { Token::Name, "naïve" }, { Token::Name, "éa-b" } }));
+}
+
+TEST_F(NextToken, LongNameAndBlanks)
+{
+  auto name = QString(100, 'a');
+  auto text = QString(50, ' ') + name + QString(50, '\t') + ';';
+  EXPECT_EQ(tokens(text).join(' '),
+            expected({ { Token::Name, qPrintable(name) },
+                       { Token::Symbol, ";" } }));
+}